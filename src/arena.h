@@ -6,29 +6,91 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <assert.h>
 
+// Where the regions of an arena come from. The default backend gets selected at build time with
+// 'ARENA_MMAP' or 'ARENA_HUGEPAGE' and is malloc otherwise.
+typedef enum {
+  ARENA_BACKEND_DEFAULT = 0,
+  ARENA_BACKEND_MALLOC,
+  // Maps the regions directly and rounds them up to whole pages.
+  ARENA_BACKEND_MMAP,
+  // Like mmap, but regions of at least one huge page get aligned to it and transparent huge pages
+  // get requested, so big arenas need fewer TLB entries.
+  ARENA_BACKEND_HUGEPAGE,
+  ARENA_BACKEND_COUNT
+} e_arena_backend;
+
+// How big a new region gets. A region is always big enough for the allocation which needs it.
+typedef enum {
+  // Every region doubles the capacity of the one before, up to 'REGION_MAX_CAPACITY'. Large
+  // inputs need only a few regions this way.
+  ARENA_GROWTH_GEOMETRIC = 0,
+  // Every region has 'REGION_CHUNK_CAPACITY'.
+  ARENA_GROWTH_FIXED,
+  ARENA_GROWTH_COUNT
+} e_arena_growth;
+
 typedef struct region region_t;
 
 struct region {
   region_t* next;
   size_t capacity;
   size_t count;
+  // Bytes of the mapping for regions from mmap and 0 for regions from malloc.
+  size_t mapped;
   uintptr_t data[];
 };
 
+// An arena initialized with '{0}' grows geometrically and uses the default backend.
 typedef struct {
   region_t *begin, *end;
+  e_arena_growth growth;
+  e_arena_backend backend;
 } arena_t;
 
-#define REGION_DEFAULT_CAPACITY 1024 // 1 kb
+// A checkpoint of an arena. Rewinding to it frees everything allocated after it, but keeps the
+// regions for the following allocations. The region is stored as its position in the list,
+// because 'arena_realloc' may move a region.
+typedef struct {
+  size_t region;
+  size_t count;
+} arena_mark_t;
 
-region_t* region_alloc(size_t capacity);
+typedef struct {
+  // Bytes of all allocations.
+  size_t bytesInUse;
+  // Bytes of all regions, including the ones which are not used right now.
+  size_t bytesHeld;
+  size_t regionsHeld;
+  // Unused bytes at the end of the regions before the current one. They can't be used anymore,
+  // because allocations only continue in the current region or the ones after it.
+  size_t bytesWasted;
+} arena_stats_t;
+
+// The capacities are in words.
+#define REGION_DEFAULT_CAPACITY 1024    // 8 kb
+#define REGION_MAX_CAPACITY (1 << 20)   // 8 mb
+#define REGION_CHUNK_CAPACITY (1 << 16) // 512 kb
+
+#define ARENA_HUGEPAGE_SIZE ((size_t) 2 << 20)
+
+region_t* region_alloc(size_t capacity, e_arena_backend backend);
 void region_free(region_t* region);
 
 void* arena_alloc(arena_t* arena, size_t size_bytes);
+// The alignment must be a power of two. Alignments below the word size get rounded up to it.
+void* arena_alloc_aligned(arena_t* arena, size_t size_bytes, size_t alignment);
 void* arena_realloc(arena_t* arena, void* oldptr, size_t oldsz, size_t newsz);
+void arena_reset(arena_t* arena);
 void arena_free(arena_t* arena);
+// Frees the regions of an empty arena which don't fit into 'maxBytes'. Returns the bytes it holds.
+size_t arena_trim(arena_t* arena, size_t maxBytes);
+
+arena_mark_t arena_mark(const arena_t* arena);
+void arena_rewind(arena_t* arena, arena_mark_t mark);
+arena_stats_t arena_stats(const arena_t* arena);
 
 #define ARENA_DA_INIT_CAP 256
 
@@ -50,73 +112,275 @@ void arena_free(arena_t* arena);
 
 #endif // _ARENA_H_
 
-#ifdef ARENA_IMPLEMENTATION
+// The implementation only gets included once, even if other headers include the arena as well.
+#if defined(ARENA_IMPLEMENTATION) && !defined(_ARENA_IMPLEMENTATION_)
+#define _ARENA_IMPLEMENTATION_
 
 #include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+  #define ARENA_MMAP_SUPPORTED
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+#if defined(ARENA_HUGEPAGE)
+  #define ARENA_DEFAULT_BACKEND ARENA_BACKEND_HUGEPAGE
+#elif defined(ARENA_MMAP)
+  #define ARENA_DEFAULT_BACKEND ARENA_BACKEND_MMAP
+#else
+  #define ARENA_DEFAULT_BACKEND ARENA_BACKEND_MALLOC
+#endif
+
+// Maps at least 'size' bytes and stores the size of the mapping. Falls back to malloc on targets
+// without mmap.
+static region_t* region_map(size_t size, bool hugepage, size_t* mapped)
+{
+#ifdef ARENA_MMAP_SUPPORTED
+  size_t page = (size_t) sysconf(_SC_PAGESIZE);
+  size_t length = (size + page - 1) / page * page;
+
+  if (hugepage && length >= ARENA_HUGEPAGE_SIZE)
+  {
+    // Huge pages only get used for the parts of a mapping which are aligned to them, so one more
+    // huge page gets mapped and the unaligned ends get unmapped again.
+    length = (length + ARENA_HUGEPAGE_SIZE - 1) / ARENA_HUGEPAGE_SIZE * ARENA_HUGEPAGE_SIZE;
+
+    char* base = mmap(NULL, length + ARENA_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (base == MAP_FAILED)
+      return NULL;
 
-region_t* region_alloc(size_t capacity)
+    char* aligned = (char*) (((uintptr_t) base + ARENA_HUGEPAGE_SIZE - 1) & ~(uintptr_t) (ARENA_HUGEPAGE_SIZE - 1));
+
+    if (aligned > base)
+      munmap(base, (size_t) (aligned - base));
+    munmap(aligned + length, (size_t) (base + ARENA_HUGEPAGE_SIZE - aligned));
+
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, length, MADV_HUGEPAGE);
+#endif
+
+    *mapped = length;
+    return (region_t*) aligned;
+  }
+
+  void* memory = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (memory == MAP_FAILED)
+    return NULL;
+
+  *mapped = length;
+  return (region_t*) memory;
+#else
+  (void) hugepage;
+  *mapped = 0;
+  return (region_t*) malloc(size);
+#endif
+}
+
+region_t* region_alloc(size_t capacity, e_arena_backend backend)
 {
   // size = size-of(REGION) + size-of(DATA in REGION) * capacity
   size_t regionSize = sizeof(region_t) + sizeof(uintptr_t) * capacity;
-  
-  region_t* region = (region_t*) malloc(regionSize);
+  size_t mapped = 0;
+  region_t* region = NULL;
+
+  if (backend == ARENA_BACKEND_DEFAULT)
+    backend = ARENA_DEFAULT_BACKEND;
+
+  if (backend == ARENA_BACKEND_MALLOC)
+    region = (region_t*) malloc(regionSize);
+  else
+    region = region_map(regionSize, backend == ARENA_BACKEND_HUGEPAGE, &mapped);
+
   assert(region && "Not enough memory!");
   region->next = NULL;
-  region->capacity = capacity;
+  // A mapping gets rounded up to whole pages, which can be used as well.
+  region->capacity = mapped ? (mapped - sizeof(region_t)) / sizeof(uintptr_t) : capacity;
   region->count = 0;
+  region->mapped = mapped;
   return region;
 }
 
 void region_free(region_t* region)
 {
+#ifdef ARENA_MMAP_SUPPORTED
+  if (region->mapped)
+  {
+    munmap(region, region->mapped);
+    return;
+  }
+#endif
+
   free(region);
 }
 
-void* arena_alloc(arena_t* arena, size_t size_bytes)
+// Grows the region to at least 'capacity' words. Regions from malloc get grown with realloc,
+// which can remap big regions without copying them. Mappings can't be grown portably, so the used
+// part gets copied into a new one. The region may move.
+static region_t* region_grow(region_t* region, size_t capacity, e_arena_backend backend)
+{
+  if (!region->mapped)
+  {
+    region_t* grown = (region_t*) realloc(region, sizeof(region_t) + sizeof(uintptr_t) * capacity);
+    assert(grown && "Not enough memory!");
+    grown->capacity = capacity;
+    return grown;
+  }
+
+  region_t* grown = region_alloc(capacity, backend);
+  grown->next = region->next;
+  grown->count = region->count;
+  memcpy(grown->data, region->data, region->count * sizeof(uintptr_t));
+  region_free(region);
+  return grown;
+}
+
+// The capacity of a new region for an allocation of 'size' words.
+static size_t arena_region_capacity(const arena_t* arena, size_t size)
+{
+  size_t capacity = REGION_DEFAULT_CAPACITY;
+
+  switch (arena->growth)
+  {
+    case ARENA_GROWTH_GEOMETRIC:
+      if (arena->end)
+        capacity = arena->end->capacity < REGION_MAX_CAPACITY / 2 ? arena->end->capacity * 2 : REGION_MAX_CAPACITY;
+      break;
+    case ARENA_GROWTH_FIXED:
+      capacity = REGION_CHUNK_CAPACITY;
+      break;
+    case ARENA_GROWTH_COUNT:
+    default:
+      assert(0 && "Invalid arena growth!");
+  }
+
+  return size > capacity ? size : capacity;
+}
+
+// The words to skip at the top of the region, so the next allocation is aligned to 'alignment'.
+static size_t region_padding(const region_t* region, size_t alignment)
+{
+  uintptr_t top = (uintptr_t) &region->data[region->count];
+  return ((alignment - (top & (alignment - 1))) & (alignment - 1)) / sizeof(uintptr_t);
+}
+
+void* arena_alloc_aligned(arena_t* arena, size_t size_bytes, size_t alignment)
 {
   size_t size = (size_bytes + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
-  
+
   assert(arena);
-  
+  assert(alignment > 0 && (alignment & (alignment - 1)) == 0 && "The alignment must be a power of two!");
+
+  if (alignment < sizeof(uintptr_t))
+    alignment = sizeof(uintptr_t);
+
+  // A new region can start at any word, so it needs room for the biggest padding.
+  size_t regionSize = size + alignment / sizeof(uintptr_t) - 1;
+
   if (!arena->end)
   {
     assert(!arena->begin); // Begin was already set.
-    arena->end = region_alloc(size > REGION_DEFAULT_CAPACITY ? size : REGION_DEFAULT_CAPACITY);
+    arena->end = region_alloc(arena_region_capacity(arena, regionSize), arena->backend);
     arena->begin = arena->end;
   }
 
-  while (arena->end->count + size > arena->end->capacity && arena->end->next) {
+  while (arena->end->count + region_padding(arena->end, alignment) + size > arena->end->capacity && arena->end->next) {
     arena->end = arena->end->next;
   }
 
-  if (arena->end->count + size > arena->end->capacity)
+  if (arena->end->count + region_padding(arena->end, alignment) + size > arena->end->capacity)
   {
     assert(!arena->end->next); // The next after current end was already set.
-    arena->end->next = region_alloc(size > REGION_DEFAULT_CAPACITY ? size : REGION_DEFAULT_CAPACITY);
+    arena->end->next = region_alloc(arena_region_capacity(arena, regionSize), arena->backend);
     arena->end = arena->end->next;
   }
 
+  arena->end->count += region_padding(arena->end, alignment);
+
   void* result = &arena->end->data[arena->end->count];
   arena->end->count += size;
   return result;
 }
 
+void* arena_alloc(arena_t* arena, size_t size_bytes)
+{
+  return arena_alloc_aligned(arena, size_bytes, sizeof(uintptr_t));
+}
+
+// Grows the region with 'region_grow' and updates the link to it and the end of the arena.
+static region_t* arena_grow_region(arena_t* arena, region_t* region, size_t capacity)
+{
+  region_t* previous = NULL;
+
+  if (region != arena->begin)
+    for (previous = arena->begin; previous->next != region; previous = previous->next);
+
+  region_t* grown = region_grow(region, capacity, arena->backend);
+
+  if (previous)
+    previous->next = grown;
+  else
+    arena->begin = grown;
+
+  arena->end = grown;
+  return grown;
+}
+
+// A block at the top of the current region grows in place, so growing dynamic arrays don't leave
+// their old copies behind. If it is the only block of the region, the region itself grows.
 void* arena_realloc(arena_t* arena, void* oldptr, size_t oldsz, size_t newsz)
 {
+  assert(arena);
+
   if (newsz <= oldsz)
     return oldptr;
-  
-  void *newptr = arena_alloc(arena, newsz);
-  char *newptr_char = (char*)newptr;
-  char *oldptr_char = (char*)oldptr;
-  
-  for (size_t i = 0; i < oldsz; ++i) {
-    newptr_char[i] = oldptr_char[i];
+
+  if (!oldptr || oldsz == 0)
+    return arena_alloc(arena, newsz);
+
+  size_t oldSize = (oldsz + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+  size_t newSize = (newsz + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+  region_t* end = arena->end;
+
+  if (end && oldSize <= end->count && (uintptr_t*) oldptr == &end->data[end->count - oldSize])
+  {
+    if (end->count - oldSize + newSize <= end->capacity)
+    {
+      end->count += newSize - oldSize;
+      return oldptr;
+    }
+
+    if (end->count == oldSize)
+    {
+      end = arena_grow_region(arena, end, newSize);
+      end->count = newSize;
+      return end->data;
+    }
+
+    // The old block gets freed, the new one can't be placed over it anyway.
+    end->count -= oldSize;
   }
 
+  void* newptr = arena_alloc(arena, newsz);
+  memcpy(newptr, oldptr, oldsz);
   return newptr;
 }
 
+// Makes the memory of all regions reusable without freeing them, so following allocations
+// don't need to call malloc again.
+void arena_reset(arena_t* arena)
+{
+  assert(arena);
+
+  for (region_t* region = arena->begin; region; region = region->next)
+    region->count = 0;
+
+  arena->end = arena->begin;
+}
+
 void arena_free(arena_t* arena)
 {
   assert(arena);
@@ -133,4 +397,105 @@ void arena_free(arena_t* arena)
   arena->end = NULL;
 }
 
+// The bytes a region holds, including its header.
+static size_t region_bytes(const region_t* region)
+{
+  return region->mapped ? region->mapped : sizeof(region_t) + region->capacity * sizeof(uintptr_t);
+}
+
+size_t arena_trim(arena_t* arena, size_t maxBytes)
+{
+  assert(arena);
+
+  size_t held = 0;
+  region_t** link = &arena->begin;
+
+  // The regions at the begin get kept, because allocations start there after a reset.
+  while (*link && held + region_bytes(*link) <= maxBytes)
+  {
+    assert((*link)->count == 0 && "Only empty arenas can be trimmed!");
+    held += region_bytes(*link);
+    link = &(*link)->next;
+  }
+
+  region_t* region = *link;
+  *link = NULL;
+
+  while (region)
+  {
+    assert(region->count == 0 && "Only empty arenas can be trimmed!");
+    region_t* tmp = region;
+    region = region->next;
+    region_free(tmp);
+  }
+
+  arena->end = arena->begin;
+  return held;
+}
+
+arena_mark_t arena_mark(const arena_t* arena)
+{
+  assert(arena);
+
+  arena_mark_t mark = {0};
+
+  if (!arena->end)
+    return mark;
+
+  for (region_t* region = arena->begin; region != arena->end; region = region->next)
+    mark.region++;
+
+  mark.count = arena->end->count;
+  return mark;
+}
+
+// Allocations only continue in the current region or the ones after it, so everything after the
+// mark lives in its region behind 'count' or in the regions after it.
+void arena_rewind(arena_t* arena, arena_mark_t mark)
+{
+  assert(arena);
+
+  // The arena was empty at the mark.
+  if (mark.region == 0 && mark.count == 0)
+  {
+    arena_reset(arena);
+    return;
+  }
+
+  region_t* marked = arena->begin;
+
+  for (size_t i = 0; marked && i < mark.region; ++i)
+    marked = marked->next;
+
+  assert(marked && "The mark is not from this arena!");
+  marked->count = mark.count;
+
+  for (region_t* region = marked->next; region; region = region->next)
+    region->count = 0;
+
+  arena->end = marked;
+}
+
+arena_stats_t arena_stats(const arena_t* arena)
+{
+  assert(arena);
+
+  arena_stats_t stats = {0};
+  bool beforeEnd = arena->end != NULL;
+
+  for (region_t* region = arena->begin; region; region = region->next)
+  {
+    if (region == arena->end)
+      beforeEnd = false;
+    else if (beforeEnd)
+      stats.bytesWasted += (region->capacity - region->count) * sizeof(uintptr_t);
+
+    stats.bytesInUse += region->count * sizeof(uintptr_t);
+    stats.bytesHeld += region_bytes(region);
+    stats.regionsHeld++;
+  }
+
+  return stats;
+}
+
 #endif // ARENA_IMPLEMENTATION
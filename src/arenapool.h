@@ -0,0 +1,187 @@
+#ifndef _ARENAPOOL_H_
+#define _ARENAPOOL_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <threads.h>
+
+#include "helpers.h"
+#include "arena.h"
+
+
+// Every thread which evaluates expressions needs its own arena. The arena pool keeps the idle
+// arenas of every thread, so an expression gets an arena whose regions are already allocated and
+// touched, and giving it back needs no lock. Only the amount of retained memory is shared between
+// the threads, so all pools together never keep more than the limit.
+//
+// A released arena gets reset. If the pool is full or the limit is reached, the regions which
+// don't fit get freed. The pool of a thread gets freed when the thread exits, the pool of the main
+// thread with 'arena_pool_thread_free'.
+#define ARENA_POOL_MAX_ARENAS 4
+#define ARENA_POOL_DEFAULT_LIMIT ((size_t) 256 << 20) // 256 mb
+// Overrides the limit in megabytes.
+#define ARENA_POOL_LIMIT_ENV "CCALC_ARENA_LIMIT"
+
+
+typedef struct {
+  arena_t idle[ARENA_POOL_MAX_ARENAS];
+  size_t idleCount;
+} arena_pool_t;
+
+
+static tss_t arenaPoolKey;
+static once_flag arenaPoolOnce = ONCE_FLAG_INIT;
+static _Atomic size_t arenaPoolRetained = 0;
+static _Atomic size_t arenaPoolLimit = ARENA_POOL_DEFAULT_LIMIT;
+
+
+static void arena_pool_destroy(void* data)
+{
+  arena_pool_t* pool = (arena_pool_t*) data;
+
+  for (size_t i = 0; i < pool->idleCount; ++i)
+  {
+    atomic_fetch_sub(&arenaPoolRetained, arena_stats(&pool->idle[i]).bytesHeld);
+    arena_free(&pool->idle[i]);
+  }
+
+  free(pool);
+}
+
+static void arena_pool_init()
+{
+  if (tss_create(&arenaPoolKey, arena_pool_destroy) != thrd_success)
+    UNREACHABLE("arena_pool_init: Could not create the thread storage!");
+
+  const char* env = getenv(ARENA_POOL_LIMIT_ENV);
+  long megabytes = env ? strtol(env, NULL, 10) : -1;
+
+  if (megabytes >= 0)
+    atomic_store(&arenaPoolLimit, (size_t) megabytes << 20);
+}
+
+// The pool of the calling thread. Gets created on the first use.
+static arena_pool_t* arena_pool_get()
+{
+  call_once(&arenaPoolOnce, arena_pool_init);
+
+  arena_pool_t* pool = (arena_pool_t*) tss_get(arenaPoolKey);
+
+  if (!pool)
+  {
+    pool = (arena_pool_t*) calloc(1, sizeof(arena_pool_t));
+    assert(pool && "Not enough memory!");
+
+    if (tss_set(arenaPoolKey, pool) != thrd_success)
+      UNREACHABLE("arena_pool_get: Could not set the thread storage!");
+  }
+
+  return pool;
+}
+
+// Takes up to 'bytes' of the limit. Returns how many bytes were taken.
+static size_t arena_pool_reserve(size_t bytes)
+{
+  size_t limit = atomic_load(&arenaPoolLimit);
+  size_t retained = atomic_load(&arenaPoolRetained);
+  size_t reserved;
+
+  do {
+    reserved = retained < limit ? limit - retained : 0;
+    if (reserved > bytes)
+      reserved = bytes;
+  } while (!atomic_compare_exchange_weak(&arenaPoolRetained, &retained, retained + reserved));
+
+  return reserved;
+}
+
+
+// Returns an idle arena of the calling thread or a new one, if the pool is empty.
+arena_t arena_pool_acquire()
+{
+  arena_pool_t* pool = arena_pool_get();
+
+  if (pool->idleCount == 0)
+    return (arena_t) {0};
+
+  arena_t arena = pool->idle[--pool->idleCount];
+  atomic_fetch_sub(&arenaPoolRetained, arena_stats(&arena).bytesHeld);
+  return arena;
+}
+
+// Gives the arena back to the pool of the calling thread. Everything allocated from it becomes
+// invalid and the arena is empty afterwards.
+void arena_pool_release(arena_t* arena)
+{
+  ASSERT_NULL(arena);
+
+  arena_pool_t* pool = arena_pool_get();
+
+  if (pool->idleCount == ARENA_POOL_MAX_ARENAS)
+  {
+    arena_free(arena);
+    return;
+  }
+
+  arena_reset(arena);
+
+  size_t reserved = arena_pool_reserve(arena_stats(arena).bytesHeld);
+  size_t held = arena_trim(arena, reserved);
+
+  // The trimmed regions don't count against the limit.
+  atomic_fetch_sub(&arenaPoolRetained, reserved - held);
+
+  if (arena->begin)
+    pool->idle[pool->idleCount++] = *arena;
+
+  *arena = (arena_t) {0};
+}
+
+// Fills the pool of the calling thread with 'count' arenas, which already hold at least 'bytes'
+// each, so the first expressions don't wait for malloc or page faults either.
+void arena_pool_warm(size_t count, size_t bytes)
+{
+  arena_t arenas[ARENA_POOL_MAX_ARENAS];
+
+  if (count > ARENA_POOL_MAX_ARENAS)
+    count = ARENA_POOL_MAX_ARENAS;
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    arenas[i] = arena_pool_acquire();
+    memset(arena_alloc(&arenas[i], bytes), 0, bytes);
+  }
+
+  for (size_t i = count; i > 0; --i)
+    arena_pool_release(&arenas[i - 1]);
+}
+
+// Frees the idle arenas of the calling thread. The other threads free theirs when they exit.
+void arena_pool_thread_free()
+{
+  call_once(&arenaPoolOnce, arena_pool_init);
+
+  arena_pool_t* pool = (arena_pool_t*) tss_get(arenaPoolKey);
+
+  if (!pool)
+    return;
+
+  tss_set(arenaPoolKey, NULL);
+  arena_pool_destroy(pool);
+}
+
+// The bytes all pools retain right now.
+size_t arena_pool_retained()
+{
+  return atomic_load(&arenaPoolRetained);
+}
+
+// Sets the limit of the retained memory of all pools. Arenas which are already in a pool keep
+// their memory until they get acquired again.
+void arena_pool_set_limit(size_t bytes)
+{
+  call_once(&arenaPoolOnce, arena_pool_init);
+  atomic_store(&arenaPoolLimit, bytes);
+}
+
+#endif // _ARENAPOOL_H_
@@ -0,0 +1,447 @@
+#ifndef _ASTPOOL_H_
+#define _ASTPOOL_H_
+
+#include <stdint.h>
+
+#include "nodemap.h"
+
+
+// A compact form of the AST. All nodes live in one pool and are addressed by 32 bit indices. The
+// fields are stored as structure-of-arrays, so a binop only needs 14 bytes instead of the 40 of a
+// 'node_t'. The nodes are stored in post-order, so the children of a node always have smaller
+// indices and evaluating is a single sequential walk over the pool.
+typedef uint32_t ast_index_t;
+
+#define AST_INDEX_INVALID UINT32_MAX
+
+// The operands of a fused multiply-add 'a * b + addend'. Like in the bytecode the product does not
+// get its own node, only its operands.
+typedef struct {
+  ast_index_t a;
+  ast_index_t b;
+  ast_index_t addend;
+} ast_pool_fma_t;
+
+typedef struct {
+  // 'e_node_type' of every node.
+  uint8_t* types;
+  // 'e_node_binop_type' of binops, 'e_node_func_type' of functions and 'e_fma_flags' of fused
+  // multiply-adds.
+  uint8_t* ops;
+  // The lhs of binops, the argument of functions and parens, the index into 'constants' of
+  // constants, the slot of variables and the index into 'fmas' of fused multiply-adds.
+  ast_index_t* lhs;
+  // The rhs of binops.
+  ast_index_t* rhs;
+  uint32_t* cursors;
+  size_t count;
+  size_t capacity;
+
+  double* constants;
+  size_t constantCount;
+  size_t constantCapacity;
+
+  ast_pool_fma_t* fmas;
+  size_t fmaCount;
+  size_t fmaCapacity;
+
+  // The name of every variable slot, NULL if the slot is not used.
+  const char** variableNames;
+  size_t variableCount;
+
+  // Pre allocated value of every node, so evaluating does not allocate.
+  double* values;
+  ast_index_t root;
+} ast_pool_t;
+
+
+#define ast_pool_bytes_per_node(pool) (sizeof(*(pool)->types) + sizeof(*(pool)->ops) + sizeof(*(pool)->lhs) + sizeof(*(pool)->rhs) + sizeof(*(pool)->cursors))
+
+// The memory of the nodes, constants and fused multiply-adds without the evaluation values.
+#define ast_pool_bytes(pool) ((pool)->count * ast_pool_bytes_per_node(pool) + (pool)->constantCount * sizeof(double) + (pool)->fmaCount * sizeof(ast_pool_fma_t))
+
+
+static ast_index_t ast_pool_add(arena_t* arena, ast_pool_t* pool, const node_t* node, uint8_t op, ast_index_t lhs, ast_index_t rhs)
+{
+  assert(pool->count < AST_INDEX_INVALID && "Too many nodes!");
+  assert(node->cursor <= UINT32_MAX && "Cursor out of range!");
+
+  if (pool->count >= pool->capacity)
+  {
+    size_t oldCapacity = pool->capacity;
+    size_t newCapacity = oldCapacity == 0 ? ARENA_DA_INIT_CAP : oldCapacity * 2;
+
+    pool->types   = arena_realloc(arena, pool->types,   oldCapacity * sizeof(*pool->types),   newCapacity * sizeof(*pool->types));
+    pool->ops     = arena_realloc(arena, pool->ops,     oldCapacity * sizeof(*pool->ops),     newCapacity * sizeof(*pool->ops));
+    pool->lhs     = arena_realloc(arena, pool->lhs,     oldCapacity * sizeof(*pool->lhs),     newCapacity * sizeof(*pool->lhs));
+    pool->rhs     = arena_realloc(arena, pool->rhs,     oldCapacity * sizeof(*pool->rhs),     newCapacity * sizeof(*pool->rhs));
+    pool->cursors = arena_realloc(arena, pool->cursors, oldCapacity * sizeof(*pool->cursors), newCapacity * sizeof(*pool->cursors));
+    pool->capacity = newCapacity;
+  }
+
+  ast_index_t index = (ast_index_t) pool->count++;
+  pool->types[index] = (uint8_t) node->type;
+  pool->ops[index] = op;
+  pool->lhs[index] = lhs;
+  pool->rhs[index] = rhs;
+  pool->cursors[index] = (uint32_t) node->cursor;
+  return index;
+}
+
+static ast_index_t ast_pool_add_constant(arena_t* arena, ast_pool_t* pool, const node_t* node)
+{
+  if (pool->constantCount >= pool->constantCapacity)
+  {
+    size_t oldCapacity = pool->constantCapacity;
+    size_t newCapacity = oldCapacity == 0 ? ARENA_DA_INIT_CAP : oldCapacity * 2;
+
+    pool->constants = arena_realloc(arena, pool->constants, oldCapacity * sizeof(double), newCapacity * sizeof(double));
+    pool->constantCapacity = newCapacity;
+  }
+
+  pool->constants[pool->constantCount] = node->as.constant;
+  return ast_pool_add(arena, pool, node, 0, (ast_index_t) pool->constantCount++, AST_INDEX_INVALID);
+}
+
+static ast_index_t ast_pool_add_fma(arena_t* arena, ast_pool_t* pool, const node_t* node, ast_pool_fma_t operands)
+{
+  if (pool->fmaCount >= pool->fmaCapacity)
+  {
+    size_t oldCapacity = pool->fmaCapacity;
+    size_t newCapacity = oldCapacity == 0 ? ARENA_DA_INIT_CAP : oldCapacity * 2;
+
+    pool->fmas = arena_realloc(arena, pool->fmas, oldCapacity * sizeof(ast_pool_fma_t), newCapacity * sizeof(ast_pool_fma_t));
+    pool->fmaCapacity = newCapacity;
+  }
+
+  pool->fmas[pool->fmaCount] = operands;
+  return ast_pool_add(arena, pool, node, (uint8_t) node->as.fma.flags, (ast_index_t) pool->fmaCount++, AST_INDEX_INVALID);
+}
+
+static ast_index_t ast_pool_add_variable(arena_t* arena, ast_pool_t* pool, const node_t* node)
+{
+  size_t slot = node->as.variable.index;
+  assert(slot < AST_INDEX_INVALID && "Variable slot out of range!");
+
+  if (slot >= pool->variableCount)
+  {
+    pool->variableNames = arena_realloc(arena, pool->variableNames, pool->variableCount * sizeof(const char*), (slot + 1) * sizeof(const char*));
+
+    for (size_t i = pool->variableCount; i <= slot; ++i)
+      pool->variableNames[i] = NULL;
+
+    pool->variableCount = slot + 1;
+  }
+
+  pool->variableNames[slot] = node->as.variable.name;
+  return ast_pool_add(arena, pool, node, 0, (ast_index_t) slot, AST_INDEX_INVALID);
+}
+
+
+// Frames for the explicit post-order walk, so deeply nested trees can't overflow the C stack.
+typedef struct {
+  const node_t* node;
+  bool expanded;
+} ast_pool_frame_t;
+
+typedef struct {
+  ast_pool_frame_t* items;
+  size_t capacity;
+  size_t count;
+} ast_pool_frame_stack_t;
+
+typedef struct {
+  ast_index_t* items;
+  size_t capacity;
+  size_t count;
+} ast_pool_index_stack_t;
+
+#define ast_pool_frame_push(a, stack, n) arena_da_append((a), (stack), ((ast_pool_frame_t) { .node = (n), .expanded = false }))
+
+
+// Remembers the index of the added node, so further uses of a shared node get the same index.
+static void ast_pool_push_index(arena_t* arena, ast_pool_index_stack_t* indices, node_map_t* added, const node_t* node, ast_index_t index)
+{
+  node_map_put(arena, added, node, index);
+  arena_da_append(arena, indices, index);
+}
+
+
+// Converts the tree into a node pool. If the tree is a DAG every shared node only gets added once.
+// Everything gets allocated from the arena.
+ast_pool_t ast_pool_from_node(arena_t* arena, const node_t* root)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(root);
+
+  ast_pool_t pool = {0};
+  ast_pool_frame_stack_t frames = {0};
+  // The indices of the finished children which wait for their parent.
+  ast_pool_index_stack_t indices = {0};
+  node_map_t added = {0};
+
+  ast_pool_frame_push(arena, &frames, root);
+
+  while (frames.count > 0)
+  {
+    ast_pool_frame_t* frame = &frames.items[frames.count - 1];
+    const node_t* node = frame->node;
+
+    const uint32_t* index = frame->expanded ? NULL : node_map_get(&added, node);
+
+    if (index)
+    {
+      arena_da_append(arena, &indices, *index);
+      frames.count--;
+      continue;
+    }
+
+    switch (node->type)
+    {
+      case NT_CONSTANT:
+        ast_pool_push_index(arena, &indices, &added, node, ast_pool_add_constant(arena, &pool, node));
+        frames.count--;
+        break;
+      case NT_VARIABLE:
+        ast_pool_push_index(arena, &indices, &added, node, ast_pool_add_variable(arena, &pool, node));
+        frames.count--;
+        break;
+      case NT_BINOP:
+      {
+        if (!frame->expanded)
+        {
+          // The rhs gets pushed first so the lhs gets added first.
+          frame->expanded = true;
+          ast_pool_frame_push(arena, &frames, node->as.binop.rhs);
+          ast_pool_frame_push(arena, &frames, node->as.binop.lhs);
+          break;
+        }
+
+        ast_index_t rhs = indices.items[--indices.count];
+        ast_index_t lhs = indices.items[--indices.count];
+        ast_pool_push_index(arena, &indices, &added, node, ast_pool_add(arena, &pool, node, (uint8_t) node->as.binop.type, lhs, rhs));
+        frames.count--;
+        break;
+      }
+      case NT_FUNCTION:
+      case NT_PAREN:
+      {
+        if (!frame->expanded)
+        {
+          frame->expanded = true;
+          ast_pool_frame_push(arena, &frames, node->type == NT_FUNCTION ? node->as.func.arg : node->as.paren.arg);
+          break;
+        }
+
+        uint8_t op = node->type == NT_FUNCTION ? (uint8_t) node->as.func.type : 0;
+        ast_index_t arg = indices.items[--indices.count];
+        ast_pool_push_index(arena, &indices, &added, node, ast_pool_add(arena, &pool, node, op, arg, AST_INDEX_INVALID));
+        frames.count--;
+        break;
+      }
+      case NT_FMA:
+      {
+        bool addendFirst = is_bit_set(node->as.fma.flags, FMA_ADDEND_FIRST);
+
+        const node_t* product = node->as.fma.product;
+
+        if (!frame->expanded)
+        {
+          // The operands get pushed in reverse, so they get added in the order of evaluation. The
+          // product node itself never gets added, like in 'compiler_execute'.
+          frame->expanded = true;
+
+          if (!addendFirst)
+            ast_pool_frame_push(arena, &frames, node->as.fma.addend);
+
+          ast_pool_frame_push(arena, &frames, product->as.binop.rhs);
+          ast_pool_frame_push(arena, &frames, product->as.binop.lhs);
+
+          if (addendFirst)
+            ast_pool_frame_push(arena, &frames, node->as.fma.addend);
+          break;
+        }
+
+        indices.count -= 3;
+        const ast_index_t* operands = &indices.items[indices.count];
+        ast_pool_fma_t fma = {
+          .a      = addendFirst ? operands[1] : operands[0],
+          .b      = addendFirst ? operands[2] : operands[1],
+          .addend = addendFirst ? operands[0] : operands[2],
+        };
+
+        ast_pool_push_index(arena, &indices, &added, node, ast_pool_add_fma(arena, &pool, node, fma));
+        frames.count--;
+        break;
+      }
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+
+  assert(indices.count == 1 && "Unbalanced tree!");
+
+  pool.root = indices.items[0];
+  pool.values = (double*) arena_alloc(arena, pool.count * sizeof(double));
+  return pool;
+}
+
+
+
+// Evaluates the pool like 'ast_eval_value' evaluates the tree. The children come before their
+// parents, so every node gets evaluated once in index order and the first failing division is
+// the same one the tree evaluation reports.
+double ast_pool_eval(const ast_pool_t* pool, const double* variables, eval_status_t* status)
+{
+  ASSERT_NULL(pool);
+  ASSERT_NULL(status);
+  assert((pool->variableCount == 0 || variables) && "The expression uses variables but no values were given!");
+
+  double* values = pool->values;
+  *status = EVAL_STATUS_SUCCESS();
+
+  for (size_t i = 0; i < pool->count; ++i)
+  {
+    const ast_index_t lhs = pool->lhs[i];
+
+    switch ((e_node_type) pool->types[i])
+    {
+      case NT_CONSTANT:
+        values[i] = pool->constants[lhs];
+        break;
+      case NT_VARIABLE:
+        values[i] = variables[lhs];
+        break;
+      case NT_BINOP:
+      {
+        const ast_index_t rhs = pool->rhs[i];
+
+        switch ((e_node_binop_type) pool->ops[i])
+        {
+          case NO_ADD: values[i] = values[lhs] + values[rhs]; break;
+          case NO_SUB: values[i] = values[lhs] - values[rhs]; break;
+          case NO_MUL: values[i] = values[lhs] * values[rhs]; break;
+          case NO_DIV:
+          {
+            if (values[rhs] == 0)
+            {
+              *status = EVAL_STATUS_ERROR(ES_DIVISION_BY_ZERO, pool->cursors[rhs]);
+              return NAN;
+            }
+            values[i] = values[lhs] / values[rhs];
+            break;
+          }
+          case NO_POW: values[i] = pow(values[lhs], values[rhs]); break;
+          case NO_COUNT:
+          default:
+            UNREACHABLE("Invalid binop-node-type!");
+        }
+        break;
+      }
+      case NT_FUNCTION:
+        values[i] = nodeFunctionImpls[pool->ops[i]](values[lhs]);
+        break;
+      case NT_PAREN:
+        values[i] = values[lhs];
+        break;
+      case NT_FMA:
+      {
+        const ast_pool_fma_t* fma = &pool->fmas[lhs];
+        values[i] = fma_apply((e_fma_flags) pool->ops[i], values[fma->a], values[fma->b], values[fma->addend]);
+        break;
+      }
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+
+  return values[pool->root];
+}
+
+
+
+// Prints the same output as 'print_node_ex'.
+void ast_pool_print_ex(const ast_pool_t* pool, ast_index_t index, bool indented, size_t deph)
+{
+  ASSERT_NULL(pool);
+  assert(index < pool->count && "Invalid node index!");
+
+  const ast_index_t lhs = pool->lhs[index];
+
+  switch ((e_node_type) pool->types[index]) {
+    case NT_CONSTANT:
+    {
+      _PRINT_DEPTH_SPACES(indented, deph);
+      printf(DOUBLE_PRINT_FORMAT, pool->constants[lhs]);
+      break;
+    }
+    case NT_BINOP:
+    {
+      _PRINT_DEPTH_SPACES(indented, deph);
+      printf("%s(", nodeBinopTypeNames[pool->ops[index]]);
+      if (indented) printf("\n");
+      ast_pool_print_ex(pool, lhs, indented, deph + 1);
+      printf(",%s", indented ? "\n" : " ");
+      ast_pool_print_ex(pool, pool->rhs[index], indented, deph + 1);
+      if (indented) printf("\n");
+      _PRINT_DEPTH_SPACES(indented, deph);
+      printf(")");
+      break;
+    }
+    case NT_FUNCTION:
+    case NT_PAREN:
+    {
+      bool isFunction = pool->types[index] == NT_FUNCTION;
+      bool isArgTypeConst = pool->types[lhs] == NT_CONSTANT || pool->types[lhs] == NT_VARIABLE;
+
+      _PRINT_DEPTH_SPACES(indented, deph);
+      printf("%s(", isFunction ? nodeFunctionTypeNames[pool->ops[index]] : "paren");
+      if (indented && !isArgTypeConst) printf("\n");
+      ast_pool_print_ex(pool, lhs, indented, !isArgTypeConst ? deph + 1 : 0);
+      if (indented && !isArgTypeConst) printf("\n");
+      _PRINT_DEPTH_SPACES(indented, !isArgTypeConst ? deph : 0);
+      printf(")");
+      break;
+    }
+    case NT_VARIABLE:
+    {
+      _PRINT_DEPTH_SPACES(indented, deph);
+      if (pool->variableNames[lhs]) printf("%s", pool->variableNames[lhs]);
+      else printf("var[%u]", lhs);
+      break;
+    }
+    case NT_FMA:
+    {
+      const ast_pool_fma_t* fma = &pool->fmas[lhs];
+
+      _PRINT_DEPTH_SPACES(indented, deph);
+      printf("%s(", fma_type_name(pool->ops[index]));
+      if (indented) printf("\n");
+      ast_pool_print_ex(pool, fma->a, indented, deph + 1);
+      printf(",%s", indented ? "\n" : " ");
+      ast_pool_print_ex(pool, fma->b, indented, deph + 1);
+      printf(",%s", indented ? "\n" : " ");
+      ast_pool_print_ex(pool, fma->addend, indented, deph + 1);
+      if (indented) printf("\n");
+      _PRINT_DEPTH_SPACES(indented, deph);
+      printf(")");
+      break;
+    }
+    case NT_COUNT:
+    default:
+      UNREACHABLE("Invalid node-type!");
+  }
+}
+
+void ast_pool_print(const ast_pool_t* pool, bool indented)
+{
+  ASSERT_NULL(pool);
+
+  printf("Printing AST pool (%zu nodes, %zu bytes):\n", pool->count, ast_pool_bytes(pool));
+  ast_pool_print_ex(pool, pool->root, indented, 0);
+  printf("\n");
+}
+
+#endif // _ASTPOOL_H_
@@ -0,0 +1,297 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stdint.h>
+
+#include "compiler.h"
+#include "optimizer.h"
+#include "simdmath.h"
+
+
+// Batch evaluation runs one compiled expression over many rows of variable values. The values are
+// given as structure-of-arrays, so every variable slot has its own column of values.
+//
+// The rows are processed in tiles. Every slot of the value stack holds a whole tile, so every
+// instruction gets dispatched once per tile and runs over vectors of 'SIMD_VECTOR_SIZE' lanes.
+// The functions use the vectorized kernels of 'simdmath.h'.
+#define BATCH_MAX_TILE_SIZE 256
+// Very deep expressions get smaller tiles, so the tile stack does not grow without a limit.
+#define BATCH_MAX_STACK_BYTES (1u << 22)
+
+static_assert(BATCH_MAX_TILE_SIZE % SIMD_VECTOR_SIZE == 0, "The tile size must be a multiple of the vector size");
+
+
+// The form of the polynomials in a single variable with fast math.
+typedef enum {
+  // Keeps the polynomials like they were written.
+  BATCH_POLY_WRITTEN,
+  BATCH_POLY_HORNER,
+  // Needs more operations than Horner form, but they are independent of each other.
+  BATCH_POLY_ESTRIN,
+
+  BATCH_POLY_COUNT
+} e_batch_poly_form;
+
+// Horner form needs the fewest operations and is the fastest form of the polynomial benchmarks for
+// every vector size.
+#define BATCH_POLY_DEFAULT BATCH_POLY_HORNER
+
+
+typedef struct {
+  const bytecode_t* bc;
+  // Rows per tile. Always a multiple of 'SIMD_VECTOR_SIZE'.
+  size_t tileSize;
+  // 'bc->stackSize' tiles. Executing writes into the stack and the temps, so a batch must only be
+  // executed by one thread at a time.
+  simd_vector_t* stack;
+  // 'bc->tempCount' tiles.
+  simd_vector_t* temps;
+} batch_t;
+
+
+// Returns the optimizer passes for an expression which gets evaluated with 'batch_execute'. Without
+// fast math these are the default passes. With fast math the polynomials get the given form and the
+// multiplications and additions only get fused if the vectors have FMA instructions, because the
+// batch would else call 'fma' of libm for every lane, which is a few times slower.
+e_optimizer_flags batch_optimizer_flags(bool fastMath, e_batch_poly_form form)
+{
+  if (!fastMath)
+    return OPT_DEFAULT;
+
+  e_optimizer_flags flags = OPT_FAST_MATH;
+
+#ifndef SIMD_NATIVE_FMA
+  unset_bit(flags, OPT_CONTRACT_FMA);
+#endif
+
+  switch (form)
+  {
+    case BATCH_POLY_WRITTEN: return flags & ~OPT_POLYNOMIAL;
+    case BATCH_POLY_HORNER:  return flags;
+    case BATCH_POLY_ESTRIN:  return flags | OPT_POLY_ESTRIN;
+    case BATCH_POLY_COUNT:
+    default: UNREACHABLE("Batch-Polynomial-Form not implemented!");
+  }
+}
+
+
+// Prepares the bytecode for batch evaluation. The tile stack gets allocated from the arena, so
+// executing does not allocate. The bytecode must outlive the result.
+batch_t batch_compile(arena_t* arena, const bytecode_t* bc)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(bc);
+  assert(!bc->isError && bc->code.count > 0 && "Invalid bytecode!");
+
+  batch_t batch = { .bc = bc, .tileSize = BATCH_MAX_TILE_SIZE };
+
+  size_t tiles = bc->stackSize + bc->tempCount;
+
+  while (batch.tileSize > SIMD_VECTOR_SIZE && tiles * batch.tileSize * sizeof(double) > BATCH_MAX_STACK_BYTES)
+    batch.tileSize /= 2;
+
+  // The temp tiles follow the stack tiles.
+  size_t bytes = tiles * batch.tileSize * sizeof(double);
+  batch.stack = arena_alloc_aligned(arena, bytes, sizeof(simd_vector_t));
+  batch.temps = batch.stack + bc->stackSize * (batch.tileSize / SIMD_VECTOR_SIZE);
+
+  return batch;
+}
+
+
+// Marks every row of the tile which divides by zero and was not already marked. Like in the vm
+// only the first error of a row gets reported.
+static size_t batch_mark_division_by_zero(const double* divisors, size_t rows, bool* failed, eval_status_t* statuses, size_t base, size_t cursor)
+{
+  size_t failedCount = 0;
+
+  for (size_t r = 0; r < rows; ++r)
+  {
+    if (divisors[r] != 0 || failed[r])
+      continue;
+
+    failed[r] = true;
+    failedCount++;
+
+    if (statuses)
+      statuses[base + r] = EVAL_STATUS_ERROR(ES_DIVISION_BY_ZERO, cursor);
+  }
+
+  return failedCount;
+}
+
+
+// Evaluates the expression for every row. 'columns[slot][row]' is the value of the variable slot
+// in that row and 'results[row]' receives the result. Rows which fail get 'NAN' as result and,
+// if 'statuses' is not NULL, the same error status 'vm_execute' would report for that row.
+// Returns the amount of failed rows. The tile stack of the batch gets used as scratch memory, so
+// threads which evaluate the same expression need their own batch from 'batch_compile'.
+size_t batch_execute(batch_t* batch, const double* const* columns, size_t rowCount, double* results, eval_status_t* statuses)
+{
+  ASSERT_NULL(batch);
+  ASSERT_NULL(results);
+  assert((batch->bc->variableCount == 0 || columns) && "The expression uses variables but no columns were given!");
+
+  const bytecode_t* bc = batch->bc;
+  const instruction_t* code = bc->code.items;
+  const size_t tileVectors = batch->tileSize / SIMD_VECTOR_SIZE;
+
+  bool failed[BATCH_MAX_TILE_SIZE] = {0};
+  size_t failedTotal = 0;
+
+  for (size_t base = 0; base < rowCount; base += batch->tileSize)
+  {
+    const size_t rows = rowCount - base < batch->tileSize ? rowCount - base : batch->tileSize;
+    const size_t vectors = (rows + SIMD_VECTOR_SIZE - 1) / SIMD_VECTOR_SIZE;
+    size_t failedCount = 0;
+
+    // Points to the next free tile of the stack.
+    simd_vector_t* sp = batch->stack;
+
+    for (const instruction_t* ip = code; ip < code + bc->code.count; ++ip)
+    {
+      switch (ip->op)
+      {
+        case BC_PUSH_CONST:
+        {
+          simd_vector_t value;
+          for (size_t i = 0; i < SIMD_VECTOR_SIZE; ++i)
+            value[i] = bc->constants.items[ip->operand];
+
+          for (size_t v = 0; v < vectors; ++v)
+            sp[v] = value;
+          sp += tileVectors;
+          break;
+        }
+        case BC_LOAD_VAR:
+        {
+          // The lanes after the last row are set to 1, so they never divide by zero.
+          double* lanes = (double*) sp;
+          memcpy(lanes, columns[ip->operand] + base, rows * sizeof(double));
+          for (size_t r = rows; r < vectors * SIMD_VECTOR_SIZE; ++r)
+            lanes[r] = 1;
+          sp += tileVectors;
+          break;
+        }
+        case BC_ADD:
+        {
+          sp -= tileVectors;
+          simd_vector_t* lhs = sp - tileVectors;
+          for (size_t v = 0; v < vectors; ++v)
+            lhs[v] += sp[v];
+          break;
+        }
+        case BC_SUB:
+        {
+          sp -= tileVectors;
+          simd_vector_t* lhs = sp - tileVectors;
+          for (size_t v = 0; v < vectors; ++v)
+            lhs[v] -= sp[v];
+          break;
+        }
+        case BC_MUL:
+        {
+          sp -= tileVectors;
+          simd_vector_t* lhs = sp - tileVectors;
+          for (size_t v = 0; v < vectors; ++v)
+            lhs[v] *= sp[v];
+          break;
+        }
+        case BC_DIV:
+        {
+          sp -= tileVectors;
+          simd_vector_t* lhs = sp - tileVectors;
+          simd_mask_t zeroLanes = {0};
+
+          for (size_t v = 0; v < vectors; ++v)
+          {
+            zeroLanes |= sp[v] == 0;
+            lhs[v] /= sp[v];
+          }
+
+          if (simd_any(zeroLanes))
+            failedCount += batch_mark_division_by_zero((const double*) sp, rows, failed, statuses, base, bc->cursors.items[ip - code]);
+          break;
+        }
+        case BC_POW:
+        {
+          sp -= tileVectors;
+          double* lhs = (double*) (sp - tileVectors);
+          const double* rhs = (const double*) sp;
+          for (size_t r = 0; r < rows; ++r)
+            lhs[r] = pow(lhs[r], rhs[r]);
+          break;
+        }
+        case BC_CALL:
+        {
+          simdFunctionImpls[ip->operand]((double*) (sp - tileVectors), vectors * SIMD_VECTOR_SIZE);
+          break;
+        }
+        case BC_STORE_TEMP:
+        {
+          memcpy(batch->temps + ip->operand * tileVectors, sp - tileVectors, vectors * sizeof(simd_vector_t));
+          break;
+        }
+        case BC_LOAD_TEMP:
+        {
+          memcpy(sp, batch->temps + ip->operand * tileVectors, vectors * sizeof(simd_vector_t));
+          sp += tileVectors;
+          break;
+        }
+        case BC_FMA:
+        {
+          // The operands are in the order they were evaluated, the result replaces the first.
+          sp -= 2 * tileVectors;
+          simd_vector_t* first = sp - tileVectors;
+          bool addendFirst = is_bit_set(ip->operand, FMA_ADDEND_FIRST);
+          bool negateProduct = is_bit_set(ip->operand, FMA_NEGATE_PRODUCT);
+          bool negateAddend = is_bit_set(ip->operand, FMA_NEGATE_ADDEND);
+
+          const simd_vector_t* a = addendFirst ? sp : first;
+          const simd_vector_t* b = addendFirst ? sp + tileVectors : sp;
+          const simd_vector_t* c = addendFirst ? first : sp + tileVectors;
+
+          for (size_t v = 0; v < vectors; ++v)
+            first[v] = simd_fma_vector(negateProduct ? -a[v] : a[v], b[v], negateAddend ? -c[v] : c[v]);
+          break;
+        }
+        case BC_COUNT:
+        default:
+          UNREACHABLE("Invalid bytecode-op!");
+      }
+    }
+
+    const double* values = (const double*) batch->stack;
+
+    if (failedCount == 0)
+    {
+      memcpy(results + base, values, rows * sizeof(double));
+
+      if (statuses)
+        for (size_t r = 0; r < rows; ++r)
+          statuses[base + r] = EVAL_STATUS_SUCCESS();
+
+      continue;
+    }
+
+    for (size_t r = 0; r < rows; ++r)
+    {
+      if (failed[r])
+      {
+        results[base + r] = NAN;
+        failed[r] = false;
+      }
+      else
+      {
+        results[base + r] = values[r];
+        if (statuses) statuses[base + r] = EVAL_STATUS_SUCCESS();
+      }
+    }
+
+    failedTotal += failedCount;
+  }
+
+  return failedTotal;
+}
+
+#endif // _BATCH_H_
@@ -0,0 +1,1415 @@
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include <time.h>
+
+#include "darray.h"
+#include "jit.h"
+#include "astpool.h"
+#include "optimizer.h"
+#include "batch.h"
+#include "mathtest.h"
+#include "simdmath.h"
+#include "numformat.h"
+#include "exprfile.h"
+
+#ifdef __linux__
+  #define BENCH_PERF_SUPPORTED
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+
+// Every measurement runs at least this many instructions so short expressions still get
+// a stable timing.
+#define BENCH_MIN_INSTRUCTIONS 50000000
+
+
+static double bench_now()
+{
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+// Keeps the compiler from removing the benchmarked calls.
+static volatile double benchSink;
+
+
+
+// Small deterministic pseudo random generator, so every run benchmarks the same expressions.
+static uint32_t bench_random(uint32_t* state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return *state >> 16;
+}
+
+// Random value between 0.5 and 1.0.
+static double bench_random_value(uint32_t* state)
+{
+  return 0.5 + (double) (bench_random(state) % 1024) / 2048.0;
+}
+
+// Builds a right leaning chain 'c0 OP (c1 OP (c2 OP ...))' with 'length' operators, which gives the
+// deepest possible tree for the amount of nodes. The operators are picked randomly, so the dispatch
+// can't be predicted from a short pattern. The constants stay between 0.5 and 1.0, so the result
+// neither overflows nor divides by zero. With 'variableCount' > 0 every second operand is a random
+// variable slot, which must also get values between 0.5 and 1.0.
+static node_t* bench_build_chain(arena_t* arena, size_t length, bool withFunctions, size_t variableCount)
+{
+  static const e_node_binop_type ops[] = { NO_ADD, NO_SUB, NO_MUL, NO_ADD, NO_SUB, NO_MUL, NO_DIV };
+  static const e_node_func_type funcs[] = { NF_ATAN, NF_COS, NF_TANH };
+
+  uint32_t state = 42;
+  node_t* node = node_constant(arena, 0, 0.5);
+
+  for (size_t i = 0; i < length; ++i)
+  {
+    node_t* operand = variableCount > 0 && i % 2 == 0
+        ? node_variable(arena, 0, bench_random(&state) % variableCount, NULL)
+        : node_constant(arena, 0, bench_random_value(&state));
+
+    node = node_binop(arena, 0, ops[bench_random(&state) % ARRAY_LEN(ops)], operand, node);
+
+    if (withFunctions && bench_random(&state) % 4 == 0)
+      node = node_func(arena, 0, funcs[bench_random(&state) % ARRAY_LEN(funcs)], node);
+  }
+
+  return node;
+}
+
+// Results are compared bitwise, so '0' and '-0' differ. Every NAN is the same result: Its sign and
+// payload are out of scope, because 'pow' of libm and the operand order of the evaluators pick them.
+static bool bench_same_result(double a, double b)
+{
+  if (isnan(a) || isnan(b))
+    return isnan(a) && isnan(b);
+
+  return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// The batch evaluation uses the vectorized math functions, whose small errors can add up over
+// long expressions.
+static bool bench_close_result(double a, double b)
+{
+  return bench_same_result(a, b) || fabs(a - b) <= 1e-9 * fabs(b);
+}
+
+
+typedef double (*bench_eval_func_t)(void* expr, eval_status_t* status);
+
+static double bench_eval_ast(void* expr, eval_status_t* status)       { return ast_eval_value((const node_t*) expr, NULL, status); }
+static double bench_eval_pool(void* expr, eval_status_t* status)      { return ast_pool_eval((const ast_pool_t*) expr, NULL, status); }
+static double bench_eval_switch(void* expr, eval_status_t* status)    { return vm_execute_switch((bytecode_t*) expr, NULL, status); }
+#ifdef VM_THREADED_DISPATCH_SUPPORTED
+static double bench_eval_threaded(void* expr, eval_status_t* status)  { return vm_execute_threaded((bytecode_t*) expr, NULL, status); }
+#endif
+static double bench_eval_jit(void* expr, eval_status_t* status)       { return jit_execute((const jit_code_t*) expr, NULL, status); }
+
+// Returns the average time of a single evaluation in nanoseconds.
+static double bench_measure(bench_eval_func_t eval, void* expr, size_t runs, double* result)
+{
+  eval_status_t status;
+  double sum = 0;
+  double start = bench_now();
+
+  for (size_t i = 0; i < runs; ++i)
+    sum += eval(expr, &status);
+
+  double elapsed = bench_now() - start;
+  benchSink = sum;
+  *result = eval(expr, &status);
+
+  return elapsed * 1e9 / (double) runs;
+}
+
+
+static void bench_dispatch(const char* name, size_t length, bool withFunctions)
+{
+  arena_t arena = {0};
+
+  node_t* root = bench_build_chain(&arena, length, withFunctions, 0);
+  bytecode_t bytecode = compiler_execute(&arena, root);
+
+  size_t count = bytecode.code.count;
+  size_t runs = BENCH_MIN_INSTRUCTIONS / count + 1;
+
+  printf("Benchmark '%s': %zu instructions, %zu runs\n", name, count, runs);
+
+  ast_pool_t pool = ast_pool_from_node(&arena, root);
+
+  double astResult, poolResult, switchResult;
+  double astTime = bench_measure(bench_eval_ast, root, runs, &astResult);
+  double poolTime = bench_measure(bench_eval_pool, &pool, runs, &poolResult);
+  double switchTime = bench_measure(bench_eval_switch, &bytecode, runs, &switchResult);
+
+  printf("  %-22s%8.3f ns/node (%zu bytes)\n", "ast_eval_value", astTime / (double) count, pool.count * sizeof(node_t));
+  printf("  %-22s%8.3f ns/node (%zu bytes, %.2fx faster than the AST)\n", "ast_pool_eval", poolTime / (double) count, ast_pool_bytes(&pool), astTime / poolTime);
+  printf("  %-22s%8.3f ns/instruction (%.2fx faster than the AST)\n", "vm switch dispatch", switchTime / (double) count, astTime / switchTime);
+
+#ifdef VM_THREADED_DISPATCH_SUPPORTED
+  double threadedResult;
+  double threadedTime = bench_measure(bench_eval_threaded, &bytecode, runs, &threadedResult);
+
+  printf("  %-22s%8.3f ns/instruction (%.2fx faster than switch)\n", "vm threaded dispatch", threadedTime / (double) count, switchTime / threadedTime);
+
+  if (!bench_same_result(threadedResult, astResult))
+    printf("  ERROR: Threaded result differs from the AST result!\n");
+#else
+  printf("  %-22sunsupported by this compiler\n", "vm threaded dispatch");
+#endif
+
+  if (!bench_same_result(poolResult, astResult))
+    printf("  ERROR: AST pool result differs from the AST result!\n");
+
+  if (!bench_same_result(switchResult, astResult))
+    printf("  ERROR: Switch result differs from the AST result!\n");
+
+  jit_code_t jit = jit_compile(&arena, &bytecode);
+
+  if (jit.func)
+  {
+    double jitResult;
+    double jitTime = bench_measure(bench_eval_jit, &jit, runs, &jitResult);
+
+    printf("  %-22s%8.3f ns/instruction (%.2fx faster than switch)\n", "jit", jitTime / (double) count, switchTime / jitTime);
+
+    if (!bench_same_result(jitResult, astResult))
+      printf("  ERROR: Jit result differs from the AST result!\n");
+  }
+  else
+    printf("  %-22sunsupported on this target\n", "jit");
+
+  jit_free(&jit);
+  arena_free(&arena);
+}
+
+
+
+// Evaluates 'rowCount' rows one by one like a caller without batch evaluation would do.
+// 'rows' holds the variables of every row one after the other.
+static void bench_eval_rows(const jit_code_t* jit, bool useJit, const double* rows, size_t rowCount, double* results)
+{
+  eval_status_t status;
+  size_t variableCount = jit->bc->variableCount;
+
+  for (size_t r = 0; r < rowCount; ++r)
+    results[r] = useJit
+        ? jit_execute(jit, rows + r * variableCount, &status)
+        : vm_execute(jit->bc, rows + r * variableCount, &status);
+}
+
+static void bench_batch(const char* name, size_t length, bool withFunctions, size_t variableCount, size_t rowCount)
+{
+  arena_t arena = {0};
+
+  node_t* root = bench_build_chain(&arena, length, withFunctions, variableCount);
+  bytecode_t bytecode = compiler_execute(&arena, root);
+  jit_code_t jit = jit_compile(&arena, &bytecode);
+  batch_t batch = batch_compile(&arena, &bytecode);
+
+  // The columns for the batch and the same values row by row for the per row evaluation.
+  uint32_t state = 7;
+  double** columns = arena_alloc(&arena, variableCount * sizeof(double*));
+  double* rows = arena_alloc(&arena, rowCount * variableCount * sizeof(double));
+
+  for (size_t v = 0; v < variableCount; ++v)
+  {
+    columns[v] = arena_alloc(&arena, rowCount * sizeof(double));
+
+    for (size_t r = 0; r < rowCount; ++r)
+      columns[v][r] = rows[r * variableCount + v] = bench_random_value(&state);
+  }
+
+  double* rowResults = arena_alloc(&arena, rowCount * sizeof(double));
+  double* batchResults = arena_alloc(&arena, rowCount * sizeof(double));
+
+  size_t count = bytecode.code.count;
+  size_t passes = BENCH_MIN_INSTRUCTIONS / (count * rowCount) + 1;
+
+  printf("Benchmark '%s': %zu instructions, %zu variables, %zu rows, %zu passes\n", name, count, variableCount, rowCount, passes);
+
+  const struct { const char* name; bool useJit; } perRow[] = {
+    { "vm per row", false },
+    { "jit per row", true },
+  };
+
+  double vmTime = 0;
+
+  for (size_t i = 0; i < ARRAY_LEN(perRow); ++i)
+  {
+    if (perRow[i].useJit && !jit.func)
+    {
+      printf("  %-22sunsupported on this target\n", perRow[i].name);
+      continue;
+    }
+
+    double start = bench_now();
+    for (size_t p = 0; p < passes; ++p)
+      bench_eval_rows(&jit, perRow[i].useJit, rows, rowCount, rowResults);
+    double elapsed = (bench_now() - start) * 1e9 / (double) (passes * rowCount);
+
+    if (!perRow[i].useJit)
+      vmTime = elapsed;
+
+    printf("  %-22s%8.3f ns/row\n", perRow[i].name, elapsed);
+  }
+
+  double start = bench_now();
+  for (size_t p = 0; p < passes; ++p)
+    batch_execute(&batch, (const double* const*) columns, rowCount, batchResults, NULL);
+  double batchTime = (bench_now() - start) * 1e9 / (double) (passes * rowCount);
+
+  printf("  %-22s%8.3f ns/row (%.2fx faster than the vm, %zu rows per tile)\n", "batch", batchTime, vmTime / batchTime, batch.tileSize);
+
+  for (size_t r = 0; r < rowCount; ++r)
+  {
+    if (!bench_close_result(batchResults[r], rowResults[r]))
+    {
+      printf("  ERROR: Batch result of row %zu differs from the per row result!\n", r);
+      break;
+    }
+  }
+
+  benchSink = batchResults[rowCount - 1];
+
+  jit_free(&jit);
+  arena_free(&arena);
+}
+
+
+
+// Builds a sum of 'terms' terms like 'sqrt(x2 + 0.75) * x1'. Every term is one of 'unique'
+// different terms, like in generated formulas which repeat the same sub terms many times.
+static node_t* bench_build_repeated(arena_t* arena, size_t terms, size_t unique, size_t variableCount)
+{
+  static const e_node_func_type funcs[] = { NF_SQRT, NF_LN, NF_ATAN };
+
+  node_t* node = NULL;
+  uint32_t state = 5;
+
+  for (size_t i = 0; i < terms; ++i)
+  {
+    // Every term is given by its own seed, so equal seeds build equal terms.
+    uint32_t termState = (uint32_t) (bench_random(&state) % unique) + 1;
+
+    node_t* term =
+      node_binop(arena, 0, NO_MUL,
+        node_func(arena, 0, funcs[bench_random(&termState) % ARRAY_LEN(funcs)],
+          node_binop(arena, 0, NO_ADD,
+            node_variable(arena, 0, bench_random(&termState) % variableCount, NULL),
+            node_constant(arena, 0, bench_random_value(&termState))
+          )
+        ),
+        node_variable(arena, 0, bench_random(&termState) % variableCount, NULL)
+      );
+
+    node = node ? node_binop(arena, 0, NO_ADD, node, term) : term;
+  }
+
+  return node;
+}
+
+// Compares the vm on the plain tree with the vm on the DAG after merging the common sub trees.
+static void bench_merge_common(const char* name, size_t terms, size_t unique)
+{
+  enum { variableCount = 4 };
+
+  arena_t arena = {0};
+  optimizer_stats_t stats = {0};
+
+  node_t* plain = bench_build_repeated(&arena, terms, unique, variableCount);
+  node_t* merged = bench_build_repeated(&arena, terms, unique, variableCount);
+  optimizer_merge_common(&arena, merged, &stats);
+
+  bytecode_t plainCode = compiler_execute(&arena, plain);
+  bytecode_t mergedCode = compiler_execute(&arena, merged);
+
+  uint32_t state = 9;
+  double variables[variableCount];
+  for (size_t v = 0; v < variableCount; ++v)
+    variables[v] = bench_random_value(&state);
+
+  size_t runs = BENCH_MIN_INSTRUCTIONS / plainCode.code.count + 1;
+
+  printf("Benchmark '%s': %zu instructions, %zu merged nodes, %zu runs\n", name, plainCode.code.count, stats.mergedNodes, runs);
+
+  bytecode_t* codes[] = { &plainCode, &mergedCode };
+  double times[ARRAY_LEN(codes)];
+  double results[ARRAY_LEN(codes)];
+
+  for (size_t c = 0; c < ARRAY_LEN(codes); ++c)
+  {
+    eval_status_t status;
+    double sum = 0;
+    double start = bench_now();
+
+    for (size_t i = 0; i < runs; ++i)
+      sum += vm_execute(codes[c], variables, &status);
+
+    times[c] = (bench_now() - start) * 1e9 / (double) runs;
+    benchSink = sum;
+    results[c] = vm_execute(codes[c], variables, &status);
+  }
+
+  printf("  %-22s%8.1f ns/eval\n", "vm tree", times[0]);
+  printf("  %-22s%8.1f ns/eval (%zu instructions, %zu temps, %.2fx faster than the tree)\n", "vm merged", times[1], mergedCode.code.count, mergedCode.tempCount, times[0] / times[1]);
+
+  if (!bench_same_result(results[0], results[1]))
+    printf("  ERROR: Merged result differs from the tree result!\n");
+
+  arena_free(&arena);
+}
+
+
+// Builds a left leaning sum 'x0 + c1 + x2 + ...' with 'length' additions like the parser gives for a
+// long chain. Every second operand is a variable.
+static node_t* bench_build_sum(arena_t* arena, size_t length, size_t variableCount)
+{
+  uint32_t state = 13;
+  node_t* node = node_variable(arena, 0, 0, NULL);
+
+  for (size_t i = 1; i <= length; ++i)
+  {
+    node_t* operand = i % 2 == 0
+        ? node_variable(arena, 0, bench_random(&state) % variableCount, NULL)
+        : node_constant(arena, 0, bench_random_value(&state));
+
+    node = node_binop(arena, 0, NO_ADD, node, operand);
+  }
+
+  return node;
+}
+
+typedef double (*bench_eval_variables_func_t)(void* expr, const double* variables, eval_status_t* status);
+
+static double bench_eval_pool_variables(void* expr, const double* variables, eval_status_t* status) { return ast_pool_eval((const ast_pool_t*) expr, variables, status); }
+static double bench_eval_vm_variables(void* expr, const double* variables, eval_status_t* status)   { return vm_execute((bytecode_t*) expr, variables, status); }
+static double bench_eval_jit_variables(void* expr, const double* variables, eval_status_t* status)  { return jit_execute((const jit_code_t*) expr, variables, status); }
+
+// Returns the average time of a single evaluation in nanoseconds.
+static double bench_measure_variables(bench_eval_variables_func_t eval, void* expr, const double* variables, size_t runs)
+{
+  eval_status_t status;
+  double sum = 0;
+  double start = bench_now();
+
+  for (size_t i = 0; i < runs; ++i)
+    sum += eval(expr, variables, &status);
+
+  double elapsed = bench_now() - start;
+  benchSink = sum;
+
+  return elapsed * 1e9 / (double) runs;
+}
+
+// Compares the left leaning sum with the balanced one after reassociating it.
+static void bench_reassociate(const char* name, size_t length)
+{
+  enum { variableCount = 4 };
+
+  arena_t arena = {0};
+  optimizer_stats_t stats = {0};
+
+  node_t* roots[] = { bench_build_sum(&arena, length, variableCount), bench_build_sum(&arena, length, variableCount) };
+  optimizer_reassociate(&arena, roots[1], &stats);
+
+  uint32_t state = 17;
+  double variables[variableCount];
+  for (size_t v = 0; v < variableCount; ++v)
+    variables[v] = bench_random_value(&state);
+
+  size_t runs = BENCH_MIN_INSTRUCTIONS / (2 * length) + 1;
+  printf("Benchmark '%s': %zu additions, %zu runs\n", name, length, runs);
+
+  const char* kinds[] = { "chain", "balanced" };
+  double times[ARRAY_LEN(roots)][3];
+  double results[ARRAY_LEN(roots)];
+
+  for (size_t t = 0; t < ARRAY_LEN(roots); ++t)
+  {
+    ast_pool_t pool = ast_pool_from_node(&arena, roots[t]);
+    bytecode_t bytecode = compiler_execute(&arena, roots[t]);
+    jit_code_t jit = jit_compile(&arena, &bytecode);
+
+    eval_status_t status;
+    results[t] = vm_execute(&bytecode, variables, &status);
+
+    times[t][0] = bench_measure_variables(bench_eval_pool_variables, &pool, variables, runs);
+    times[t][1] = bench_measure_variables(bench_eval_vm_variables, &bytecode, variables, runs);
+    times[t][2] = jit.func ? bench_measure_variables(bench_eval_jit_variables, &jit, variables, runs) : 0;
+
+    printf("  %-9s stack size %5zu, pool %8.1f ns, vm %8.1f ns, jit %8.1f ns\n", kinds[t], bytecode.stackSize, times[t][0], times[t][1], times[t][2]);
+    jit_free(&jit);
+  }
+
+  printf("  %-9s pool %.2fx, vm %.2fx, jit %.2fx faster, result differs by %llu ulp\n", "balanced", times[0][0] / times[1][0], times[0][1] / times[1][1],
+         times[1][2] > 0 ? times[0][2] / times[1][2] : 0.0, (unsigned long long) mathtest_ulp_distance(results[0], results[1]));
+
+  arena_free(&arena);
+}
+
+
+// Builds a sum 'x0^e + x1^e + ...' with 'terms' powers of the variables.
+static node_t* bench_build_powers(arena_t* arena, size_t terms, double exponent, size_t variableCount)
+{
+  node_t* node = NULL;
+
+  for (size_t i = 0; i < terms; ++i)
+  {
+    node_t* power = node_binop(arena, 0, NO_POW, node_variable(arena, 0, i % variableCount, NULL), node_constant(arena, 0, exponent));
+    node = node ? node_binop(arena, 0, NO_ADD, node, power) : power;
+  }
+
+  return node;
+}
+
+// Compares 'pow' with the multiplications, reciprocals or 'sqrt' after reducing the powers. The
+// ulp distance is only the one of the random variables, see 'test_strict_optimizer' for the strict
+// passes.
+static void bench_reduce_powers(const char* name, size_t terms, double exponent, e_optimizer_flags flags)
+{
+  enum { variableCount = 4 };
+
+  arena_t arena = {0};
+  optimizer_stats_t stats = {0};
+
+  node_t* roots[] = { bench_build_powers(&arena, terms, exponent, variableCount), bench_build_powers(&arena, terms, exponent, variableCount) };
+  optimizer_reduce_powers(&arena, roots[1], flags, &stats);
+
+  uint32_t state = 19;
+  double variables[variableCount];
+  for (size_t v = 0; v < variableCount; ++v)
+    variables[v] = 0.5 + bench_random_value(&state);
+
+  size_t runs = BENCH_MIN_INSTRUCTIONS / (4 * terms) + 1;
+  printf("Benchmark '%s': %zu powers, %zu reduced, %zu runs\n", name, terms, stats.reducedPowers, runs);
+
+  const char* kinds[] = { "pow", "reduced" };
+  double times[ARRAY_LEN(roots)][2];
+  double results[ARRAY_LEN(roots)];
+
+  for (size_t t = 0; t < ARRAY_LEN(roots); ++t)
+  {
+    bytecode_t bytecode = compiler_execute(&arena, roots[t]);
+    jit_code_t jit = jit_compile(&arena, &bytecode);
+
+    eval_status_t status;
+    results[t] = vm_execute(&bytecode, variables, &status);
+
+    times[t][0] = bench_measure_variables(bench_eval_vm_variables, &bytecode, variables, runs);
+    times[t][1] = jit.func ? bench_measure_variables(bench_eval_jit_variables, &jit, variables, runs) : 0;
+
+    printf("  %-8s %4zu instructions, vm %8.1f ns, jit %8.1f ns\n", kinds[t], bytecode.code.count, times[t][0], times[t][1]);
+    jit_free(&jit);
+  }
+
+  printf("  %-8s vm %.2fx, jit %.2fx faster, result differs by %llu ulp\n", "reduced", times[0][0] / times[1][0],
+         times[1][1] > 0 ? times[0][1] / times[1][1] : 0.0, (unsigned long long) mathtest_ulp_distance(results[0], results[1]));
+
+  arena_free(&arena);
+}
+
+// Builds a polynomial of the given degree in Horner form '((c0 * x + c1) * x + c2) * x + ...'.
+static node_t* bench_build_horner(arena_t* arena, size_t degree)
+{
+  uint32_t state = 23;
+  node_t* node = node_constant(arena, 0, bench_random_value(&state));
+
+  for (size_t i = 0; i < degree; ++i)
+  {
+    node_t* product = node_binop(arena, 0, NO_MUL, node, node_variable(arena, 0, 0, NULL));
+    node = node_binop(arena, 0, NO_ADD, product, node_constant(arena, 0, bench_random_value(&state)));
+  }
+
+  return node;
+}
+
+// Compares the separate multiplications and additions with the fused multiply-adds.
+static void bench_contract_fma(const char* name, size_t degree)
+{
+  arena_t arena = {0};
+  optimizer_stats_t stats = {0};
+
+  node_t* roots[] = { bench_build_horner(&arena, degree), bench_build_horner(&arena, degree) };
+  optimizer_contract_fma(&arena, roots[1], &stats);
+
+  double variables[] = { 0.75 };
+
+  size_t runs = BENCH_MIN_INSTRUCTIONS / (4 * degree) + 1;
+  printf("Benchmark '%s': degree %zu, %zu fused, %zu runs\n", name, degree, stats.contractedNodes, runs);
+
+  const char* kinds[] = { "separate", "fused" };
+  double times[ARRAY_LEN(roots)][2];
+  double results[ARRAY_LEN(roots)];
+
+  for (size_t t = 0; t < ARRAY_LEN(roots); ++t)
+  {
+    bytecode_t bytecode = compiler_execute(&arena, roots[t]);
+    jit_code_t jit = jit_compile(&arena, &bytecode);
+
+    eval_status_t status;
+    results[t] = vm_execute(&bytecode, variables, &status);
+
+    times[t][0] = bench_measure_variables(bench_eval_vm_variables, &bytecode, variables, runs);
+    times[t][1] = jit.func ? bench_measure_variables(bench_eval_jit_variables, &jit, variables, runs) : 0;
+
+    printf("  %-8s %4zu instructions, vm %8.1f ns, jit %8.1f ns\n", kinds[t], bytecode.code.count, times[t][0], times[t][1]);
+    jit_free(&jit);
+  }
+
+  printf("  %-8s vm %.2fx, jit %.2fx faster, result differs by %llu ulp\n", "fused", times[0][0] / times[1][0],
+         times[1][1] > 0 ? times[0][1] / times[1][1] : 0.0, (unsigned long long) mathtest_ulp_distance(results[0], results[1]));
+
+  arena_free(&arena);
+}
+
+// Builds a polynomial of the given degree like it gets written: 'c0 + c1 * x + c2 * x^2 + ...'.
+static node_t* bench_build_polynomial(arena_t* arena, size_t degree)
+{
+  uint32_t state = 29;
+  node_t* node = node_constant(arena, 0, bench_random_value(&state));
+
+  for (size_t k = 1; k <= degree; ++k)
+  {
+    node_t* power = node_binop(arena, 0, NO_POW, node_variable(arena, 0, 0, NULL), node_constant(arena, 0, (double) k));
+    node = node_binop(arena, 0, NO_ADD, node, node_binop(arena, 0, NO_MUL, node_constant(arena, 0, bench_random_value(&state)), power));
+  }
+
+  return node;
+}
+
+// Compares the polynomial as written with Horner form and Estrin's scheme. All of them use the
+// other fast math passes, so the powers become multiplications. The jit always fuses the additions,
+// the batch gets its passes from 'batch_optimizer_flags'.
+static void bench_polynomial(const char* name, size_t degree, size_t rowCount)
+{
+  arena_t arena = {0};
+
+  const struct { const char* name; e_optimizer_flags flags; e_batch_poly_form batchForm; } forms[] = {
+    { "written", OPT_FAST_MATH & ~OPT_POLYNOMIAL,  BATCH_POLY_WRITTEN },
+    { "horner",  OPT_FAST_MATH,                    BATCH_POLY_HORNER },
+    { "estrin",  OPT_FAST_MATH | OPT_POLY_ESTRIN,  BATCH_POLY_ESTRIN },
+  };
+
+  uint32_t state = 31;
+  double* column = arena_alloc(&arena, rowCount * sizeof(double));
+  for (size_t r = 0; r < rowCount; ++r)
+    column[r] = bench_random_value(&state);
+
+  const double* columns[] = { column };
+  double* results = arena_alloc(&arena, rowCount * sizeof(double));
+
+  size_t passes = BENCH_MIN_INSTRUCTIONS / (4 * degree * rowCount) + 1;
+  printf("Benchmark '%s': degree %zu, %zu rows, %zu passes\n", name, degree, rowCount, passes);
+
+  double times[ARRAY_LEN(forms)][2];
+
+  for (size_t f = 0; f < ARRAY_LEN(forms); ++f)
+  {
+    node_t* root = bench_build_polynomial(&arena, degree);
+    optimizer_execute(&arena, root, forms[f].flags);
+
+    node_t* batchRoot = bench_build_polynomial(&arena, degree);
+    optimizer_execute(&arena, batchRoot, batch_optimizer_flags(true, forms[f].batchForm));
+
+    bytecode_t bytecode = compiler_execute(&arena, root);
+    bytecode_t batchBytecode = compiler_execute(&arena, batchRoot);
+    jit_code_t jit = jit_compile(&arena, &bytecode);
+    batch_t batch = batch_compile(&arena, &batchBytecode);
+
+    double start = bench_now();
+    for (size_t p = 0; p < passes; ++p)
+      bench_eval_rows(&jit, jit.func != NULL, column, rowCount, results);
+    times[f][0] = (bench_now() - start) * 1e9 / (double) (passes * rowCount);
+
+    start = bench_now();
+    for (size_t p = 0; p < passes; ++p)
+      batch_execute(&batch, columns, rowCount, results, NULL);
+    times[f][1] = (bench_now() - start) * 1e9 / (double) (passes * rowCount);
+
+    printf("  %-8s %4zu instructions, jit per row %7.3f ns/row, batch %7.3f ns/row (%zu instructions)\n", forms[f].name, bytecode.code.count, times[f][0], times[f][1], batchBytecode.code.count);
+    jit_free(&jit);
+  }
+
+  for (size_t f = 1; f < ARRAY_LEN(forms); ++f)
+    printf("  %-8s jit %.2fx, batch %.2fx faster than written\n", forms[f].name, times[0][0] / times[f][0], times[0][1] / times[f][1]);
+
+  benchSink = results[rowCount - 1];
+  arena_free(&arena);
+}
+
+// Every parse benchmark parses at least this many tokens.
+#define BENCH_MIN_TOKENS 20000000
+
+// Builds a flat expression with 'terms' operands like '0.75 * sqrt(0.5) - PI / 0.625 + ...'.
+static char* bench_build_flat_input(arena_t* arena, size_t terms)
+{
+  static const char* ops[] = { " + ", " - ", " * ", " / ", " ^ " };
+  static const char* values[] = { "0.75", "PI", "sqrt(0.5)", "(0.625 - EN)", "-3" };
+
+  // Every operand and operator is shorter than 16 characters.
+  char* input = arena_alloc(arena, terms * 32 + 1);
+  char* end = input;
+  uint32_t state = 11;
+
+  for (size_t i = 0; i < terms; ++i)
+  {
+    if (i > 0)
+      end += sprintf(end, "%s", ops[bench_random(&state) % ARRAY_LEN(ops)]);
+    end += sprintf(end, "%s", values[bench_random(&state) % ARRAY_LEN(values)]);
+  }
+
+  return input;
+}
+
+// Builds 'depth' nested parens and functions like '(ln((cos(... 1 ...)))) + 1'.
+static char* bench_build_nested_input(arena_t* arena, size_t depth)
+{
+  char* input = arena_alloc(arena, depth * 16 + 2);
+  char* end = input;
+
+  for (size_t i = 0; i < depth; ++i)
+    end += sprintf(end, "%s", i % 2 ? "cos(" : "(");
+  *end++ = '1';
+  for (size_t i = 0; i < depth; ++i)
+    end += sprintf(end, "%s", i % 2 ? ") + 1" : ")");
+  *end = '\0';
+
+  return input;
+}
+
+static void bench_parse(const char* name, const char* input)
+{
+  arena_t arena = {0};
+  arena_t parseArena = {0};
+
+  lexer_t lexer = lexer_scan(&arena, input);
+
+  size_t count = lexer.count;
+  size_t runs = BENCH_MIN_TOKENS / count + 1;
+
+  printf("Benchmark '%s': %zu tokens, %zu runs\n", name, count, runs);
+
+  node_t* root = NULL;
+  double start = bench_now();
+
+  for (size_t i = 0; i < runs; ++i)
+  {
+    arena_reset(&parseArena);
+    root = parser_execute(&parseArena, &lexer);
+  }
+
+  double elapsed = bench_now() - start;
+
+  if (root)
+    printf("  %-22s%8.3f ns/token (%.1f M tokens/s)\n", "parser", elapsed * 1e9 / (double) (runs * count), (double) (runs * count) / elapsed * 1e-6);
+  else
+    printf("  ERROR: The input could not be parsed!\n");
+
+  arena_free(&parseArena);
+  arena_free(&arena);
+}
+
+
+
+// Builds an identifier heavy expression with 'terms' operands like 'sinh(TAU) * log10(GC) - ...',
+// which uses every function and math-constant.
+static char* bench_build_keyword_input(arena_t* arena, size_t terms)
+{
+  static const char* ops[] = { " + ", " - ", " * ", " / " };
+
+  // Every operand and operator is shorter than 16 characters.
+  char* input = arena_alloc(arena, terms * 16 + 1);
+  char* end = input;
+  uint32_t state = 5;
+
+  for (size_t i = 0; i < terms; ++i)
+  {
+    if (i > 0)
+      end += sprintf(end, "%s", ops[bench_random(&state) % ARRAY_LEN(ops)]);
+    end += sprintf(end, "%s(%s)", functionTypeIdentifiers[bench_random(&state) % FT_COUNT], mathConstantTypeIdentifiers[bench_random(&state) % MC_COUNT]);
+  }
+
+  return input;
+}
+
+// The lookup before the perfect hash, which compares against every identifier in order. The
+// length check makes it exact, so both lookups return the same types.
+static size_t bench_linear_keyword_lookup(const char* cstr, size_t len)
+{
+  for (size_t i = 0; i < MC_COUNT; ++i)
+    if (strncmp(cstr, mathConstantTypeIdentifiers[i], len) == 0 && mathConstantTypeIdentifiers[i][len] == '\0')
+      return i;
+
+  for (size_t i = 0; i < FT_COUNT; ++i)
+    if (strncmp(cstr, functionTypeIdentifiers[i], len) == 0 && functionTypeIdentifiers[i][len] == '\0')
+      return MC_COUNT + i;
+
+  return MC_COUNT + FT_COUNT;
+}
+
+static size_t bench_hash_keyword_lookup(const char* cstr, size_t len)
+{
+  e_math_constant_type mc = keyword_find_math_constant(cstr, len);
+  if (mc != MC_INVALID)
+    return mc;
+
+  e_function_type ft = keyword_find_function(cstr, len);
+  if (ft != FT_INVALID)
+    return MC_COUNT + ft;
+
+  return MC_COUNT + FT_COUNT;
+}
+
+static void bench_keywords(const char* name, size_t terms)
+{
+  arena_t arena = {0};
+  arena_t lexArena = {0};
+
+  const char* input = bench_build_keyword_input(&arena, terms);
+  tokenizer_t tokenizer = tokenizer_execute(&arena, input);
+
+  size_t count = tokenizer.count;
+  size_t runs = BENCH_MIN_TOKENS / count + 1;
+
+  printf("Benchmark '%s': %zu tokens, %zu runs\n", name, count, runs);
+
+  size_t (*lookups[])(const char*, size_t) = { bench_linear_keyword_lookup, bench_hash_keyword_lookup };
+  const char* lookupNames[] = { "linear lookup", "perfect hash lookup" };
+  size_t sums[ARRAY_LEN(lookups)] = {0};
+  double times[ARRAY_LEN(lookups)];
+
+  for (size_t l = 0; l < ARRAY_LEN(lookups); ++l)
+  {
+    double start = bench_now();
+    for (size_t r = 0; r < runs; ++r)
+      for (size_t i = 0; i < count; ++i)
+        sums[l] += lookups[l](tokenizer.items[i].value, tokenizer.items[i].length);
+    times[l] = (bench_now() - start) * 1e9 / (double) (runs * count);
+
+    printf("  %-22s%8.3f ns/token\n", lookupNames[l], times[l]);
+  }
+
+  if (sums[0] != sums[1])
+    printf("  ERROR: The lookups found different keywords!\n");
+  printf("  perfect hash %.2fx faster\n", times[0] / times[1]);
+
+  lexer_t lexer = {0};
+  double start = bench_now();
+
+  for (size_t r = 0; r < runs; ++r)
+  {
+    arena_reset(&lexArena);
+    lexer = lexer_execute(&lexArena, &tokenizer);
+  }
+
+  double elapsed = bench_now() - start;
+
+  if (!lexer.isError)
+    printf("  %-22s%8.3f ns/token (%.1f M tokens/s)\n", "lexer", elapsed * 1e9 / (double) (runs * count), (double) (runs * count) / elapsed * 1e-6);
+  else
+    printf("  ERROR: The input could not be lexed!\n");
+
+  benchSink = (double) sums[1];
+  arena_free(&lexArena);
+  arena_free(&arena);
+}
+
+
+
+// Compares the tokenizer and lexer with the single pass scanner on a large input. The memory is
+// measured with a fresh arena, so it contains the grown and copied token arrays.
+static void bench_lex(const char* name, const char* input)
+{
+  size_t length = strlen(input);
+  size_t runs = BENCH_MIN_TOKENS / length + 1;
+  double times[2];
+  size_t bytes[2];
+  size_t count[2];
+
+  printf("Benchmark '%s': %.1f MB, %zu runs\n", name, (double) length * 1e-6, runs);
+
+  for (size_t m = 0; m < 2; ++m)
+  {
+    arena_t arena = {0};
+    lexer_t lexer = {0};
+    double start = bench_now();
+
+    for (size_t r = 0; r < runs; ++r)
+    {
+      arena_free(&arena);
+
+      if (m == 0)
+      {
+        tokenizer_t tokenizer = tokenizer_execute(&arena, input);
+        lexer = lexer_execute(&arena, &tokenizer);
+      }
+      else
+        lexer = lexer_scan(&arena, input);
+    }
+
+    times[m] = (bench_now() - start) * 1e9 / (double) (runs * length);
+    bytes[m] = arena_stats(&arena).bytesHeld;
+    count[m] = lexer.isError ? 0 : lexer.count;
+    arena_free(&arena);
+  }
+
+  if (count[0] == 0 || count[0] != count[1])
+    printf("  ERROR: The input could not be lexed the same way!\n");
+
+  printf("  %-22s%8.3f ns/char, %6.1f MB\n", "tokenizer + lexer", times[0], (double) bytes[0] * 1e-6);
+  printf("  %-22s%8.3f ns/char, %6.1f MB\n", "scanner", times[1], (double) bytes[1] * 1e-6);
+  printf("  scanner %.2fx faster, %.2fx less memory\n", times[0] / times[1], (double) bytes[0] / (double) bytes[1]);
+}
+
+
+
+// Builds a number heavy expression like an exported data table: 'terms' numbers with 1 to 17
+// significant digits and up to 6 decimal places, like '1234.5678 + 0.25 + 99881.000312 + ...'.
+// The start of every number gets stored in 'numbers'.
+static char* bench_build_number_input(arena_t* arena, size_t terms, const char** numbers)
+{
+  // Every number and operator is shorter than 32 characters.
+  char* input = arena_alloc(arena, terms * 32 + 1);
+  char* end = input;
+  uint32_t state = 13;
+
+  for (size_t i = 0; i < terms; ++i)
+  {
+    if (i > 0)
+      end += sprintf(end, " + ");
+
+    numbers[i] = end;
+
+    uint64_t significand = 1 + bench_random(&state);
+    for (size_t d = bench_random(&state) % 4; d > 0; --d)
+      significand = significand * 65536 + bench_random(&state);
+
+    int decimals = (int) (bench_random(&state) % 7);
+    end += sprintf(end, "%.*f", decimals, (double) (significand % 100000000000000000ull) / pow(10, decimals));
+  }
+
+  return input;
+}
+
+static void bench_numbers(const char* name, size_t terms)
+{
+  arena_t arena = {0};
+  arena_t lexArena = {0};
+
+  const char** numbers = arena_alloc(&arena, terms * sizeof(const char*));
+  const char* input = bench_build_number_input(&arena, terms, numbers);
+  size_t length = strlen(input);
+  size_t runs = BENCH_MIN_TOKENS / terms + 1;
+
+  printf("Benchmark '%s': %zu numbers, %.1f MB, %zu runs\n", name, terms, (double) length * 1e-6, runs);
+
+  double sums[2] = {0};
+  double times[2];
+
+  double start = bench_now();
+  for (size_t r = 0; r < runs; ++r)
+    for (size_t i = 0; i < terms; ++i)
+      sums[0] += strtod(numbers[i], NULL);
+  times[0] = (bench_now() - start) * 1e9 / (double) (runs * terms);
+
+  start = bench_now();
+  for (size_t r = 0; r < runs; ++r)
+    for (size_t i = 0; i < terms; ++i)
+    {
+      // The numbers end at the space of the following operator.
+      const char* end = strchr(numbers[i], ' ');
+      double number;
+      number_parse(numbers[i], end ? (size_t) (end - numbers[i]) : strlen(numbers[i]), &number);
+      sums[1] += number;
+    }
+  times[1] = (bench_now() - start) * 1e9 / (double) (runs * terms);
+
+  if (!bench_same_result(sums[0], sums[1]))
+    printf("  ERROR: The parsed numbers differ from strtod!\n");
+
+  printf("  %-22s%8.3f ns/number\n", "strtod", times[0]);
+  printf("  %-22s%8.3f ns/number\n", "number_parse", times[1]);
+  printf("  number_parse %.2fx faster\n", times[0] / times[1]);
+
+  lexer_t lexer = {0};
+  runs = BENCH_MIN_TOKENS / length + 1;
+  start = bench_now();
+
+  for (size_t r = 0; r < runs; ++r)
+  {
+    arena_reset(&lexArena);
+    lexer = lexer_scan(&lexArena, input);
+  }
+
+  double elapsed = bench_now() - start;
+  size_t bytes = arena_stats(&lexArena).bytesInUse;
+
+  if (!lexer.isError)
+    printf("  %-22s%8.3f ns/char (%.1f MB/s), %.1f MB\n", "scanner", elapsed * 1e9 / (double) (runs * length),
+           (double) (runs * length) / elapsed * 1e-6, (double) bytes * 1e-6);
+  else
+    printf("  ERROR: The input could not be lexed!\n");
+
+  // The numbers share the allocation of the tokens, so they must not need any memory of their own.
+  if (bytes != lexer.capacity * sizeof(token_t))
+    printf("  ERROR: The scanner needs %zu bytes instead of the %zu bytes of its tokens!\n", bytes, lexer.capacity * sizeof(token_t));
+
+  benchSink = sums[1];
+  arena_free(&lexArena);
+  arena_free(&arena);
+}
+
+
+
+// Compares 'snprintf' with the formatter on results like the ones of an expression file: Half of
+// them are short decimals, the other half full precision values.
+static void bench_format(const char* name, size_t count)
+{
+  double* values = malloc(count * sizeof(double));
+  uint32_t state = 19;
+
+  for (size_t i = 0; i < count; ++i)
+    values[i] = i % 2
+        ? (double) (bench_random(&state) % 100000) / 100.0
+        : bench_random_value(&state) * (double) (1 + bench_random(&state)) / (double) (1 + bench_random(&state));
+
+  size_t passes = BENCH_MIN_TOKENS / 4 / count + 1;
+  char buffer[NUMBER_FORMAT_BUFFER_SIZE];
+
+  printf("Benchmark '%s': %zu values, %zu passes\n", name, count, passes);
+
+  static const char* methods[] = { "snprintf %.5f", "number_format_fixed 5", "snprintf %.17g", "number_format" };
+  double times[ARRAY_LEN(methods)];
+
+  for (size_t m = 0; m < ARRAY_LEN(methods); ++m)
+  {
+    size_t length = 0;
+    double start = bench_now();
+
+    for (size_t p = 0; p < passes; ++p)
+      for (size_t i = 0; i < count; ++i)
+      {
+        switch (m)
+        {
+          case 0: length += (size_t) snprintf(buffer, sizeof(buffer), "%.5f", values[i]); break;
+          case 1: length += number_format_fixed(values[i], 5, buffer); break;
+          case 2: length += (size_t) snprintf(buffer, sizeof(buffer), "%.17g", values[i]); break;
+          default: length += number_format(values[i], buffer); break;
+        }
+      }
+
+    times[m] = (bench_now() - start) * 1e9 / (double) (passes * count);
+    benchSink = (double) length;
+
+    printf("  %-22s%8.3f ns/value\n", methods[m], times[m]);
+  }
+
+  printf("  number_format_fixed %.2fx faster, number_format %.2fx faster\n", times[0] / times[1], times[2] / times[3]);
+  free(values);
+}
+
+
+
+// Evaluates the same line 'lines' times like a single worker of an expression file. The arena
+// either gets freed after every line, reset, or rewound to a mark behind memory which stays for
+// all lines.
+static void bench_arena_lines(const char* name, const char* input, size_t lines)
+{
+  static const char* methods[] = { "arena_free", "arena_reset", "arena_rewind" };
+
+  printf("Benchmark '%s': %zu lines\n", name, lines);
+
+  for (size_t m = 0; m < ARRAY_LEN(methods); ++m)
+  {
+    arena_t arena = {0};
+    double sum = 0;
+
+    // Stands for the memory which has to survive every line, like the known variables.
+    if (m == 2)
+      arena_alloc(&arena, 4096);
+
+    arena_mark_t mark = arena_mark(&arena);
+    double start = bench_now();
+
+    for (size_t i = 0; i < lines; ++i)
+    {
+      double result = 0;
+      expression_evaluate(&arena, input, OPT_DEFAULT, false, &result);
+      sum += result;
+
+      // The stats of the last line are measured before the arena gets cleaned up.
+      if (i + 1 == lines)
+        break;
+
+      switch (m)
+      {
+        case 0:  arena_free(&arena); break;
+        case 1:  arena_reset(&arena); break;
+        default: arena_rewind(&arena, mark); break;
+      }
+    }
+
+    double elapsed = bench_now() - start;
+    arena_stats_t stats = arena_stats(&arena);
+    benchSink = sum;
+
+    printf("  %-14s%8.3f us/line, %zu regions, %zu bytes in use, %zu bytes held, %zu bytes wasted\n",
+           methods[m], elapsed * 1e6 / (double) lines, stats.regionsHeld, stats.bytesInUse, stats.bytesHeld, stats.bytesWasted);
+    arena_free(&arena);
+  }
+}
+
+
+typedef struct {
+  const char* input;
+  bool usePool;
+  double sums[WORK_POOL_MAX_WORKERS];
+} bench_arena_pool_t;
+
+static void bench_arena_pool_task(void* context, size_t worker, size_t task)
+{
+  bench_arena_pool_t* bench = (bench_arena_pool_t*) context;
+
+  for (size_t i = 0; i < EXPRFILE_LINES_PER_TASK; ++i)
+  {
+    arena_t arena = bench->usePool ? arena_pool_acquire() : (arena_t) {0};
+    double result = 0;
+
+    expression_evaluate(&arena, bench->input, OPT_DEFAULT, false, &result);
+    bench->sums[worker] += result;
+
+    if (bench->usePool)
+      arena_pool_release(&arena);
+    else
+      arena_free(&arena);
+  }
+
+  (void) task;
+}
+
+// Evaluates the same line 'lines' times on all workers like an expression file. Every line either
+// gets a fresh arena, which mallocs its regions and frees them again, or one from the arena pool.
+static void bench_arena_pool(const char* name, const char* input, size_t lines)
+{
+  static const char* methods[] = { "fresh arena", "arena pool" };
+
+  size_t workerCount = work_pool_default_workers();
+  size_t taskCount = lines / EXPRFILE_LINES_PER_TASK;
+
+  printf("Benchmark '%s': %zu lines, %zu workers\n", name, taskCount * EXPRFILE_LINES_PER_TASK, workerCount);
+
+  for (size_t m = 0; m < ARRAY_LEN(methods); ++m)
+  {
+    bench_arena_pool_t bench = { .input = input, .usePool = m == 1 };
+    double start = bench_now();
+
+    work_pool_run(workerCount, taskCount, bench_arena_pool_task, &bench);
+
+    double elapsed = bench_now() - start;
+    size_t retained = arena_pool_retained();
+
+    for (size_t w = 0; w < workerCount; ++w)
+      benchSink = bench.sums[w];
+
+    printf("  %-14s%8.3f us/line (%.2f M lines/s), %zu bytes retained\n",
+           methods[m], elapsed * 1e6 / (double) (taskCount * EXPRFILE_LINES_PER_TASK), (double) (taskCount * EXPRFILE_LINES_PER_TASK) / elapsed * 1e-6, retained);
+  }
+
+  arena_pool_thread_free();
+}
+
+
+// Counters of the current thread. Opening fails without perf support in the kernel, with a too
+// strict 'perf_event_paranoid' or in virtual machines without the hardware counter.
+typedef enum {
+  BENCH_COUNTER_PAGE_FAULTS = 0,
+  BENCH_COUNTER_DTLB_MISSES,
+  BENCH_COUNTER_COUNT
+} e_bench_counter;
+
+#ifdef BENCH_PERF_SUPPORTED
+static int bench_counter_open(e_bench_counter counter)
+{
+  struct perf_event_attr attr = {0};
+  attr.size = sizeof(attr);
+
+  switch (counter)
+  {
+    case BENCH_COUNTER_PAGE_FAULTS:
+      attr.type = PERF_TYPE_SOFTWARE;
+      attr.config = PERF_COUNT_SW_PAGE_FAULTS;
+      break;
+    case BENCH_COUNTER_DTLB_MISSES:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case BENCH_COUNTER_COUNT:
+    default:
+      UNREACHABLE("Invalid counter!");
+  }
+
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void bench_counter_start(int fd)
+{
+  if (fd < 0)
+    return;
+
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+// Returns -1 if the counter is not available.
+static double bench_counter_stop(int fd)
+{
+  uint64_t value = 0;
+
+  if (fd < 0)
+    return -1;
+
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+  if (read(fd, &value, sizeof(value)) != sizeof(value))
+    return -1;
+
+  return (double) value;
+}
+#else
+static int bench_counter_open(e_bench_counter counter) { (void) counter; return -1; }
+static void bench_counter_start(int fd) { (void) fd; }
+static double bench_counter_stop(int fd) { (void) fd; return -1; }
+#endif
+
+static void bench_print_counter(const char* name, double value, size_t runs)
+{
+  if (value < 0)
+    printf(", %s n/a", name);
+  else
+    printf(", %10.0f %s", value / (double) runs, name);
+}
+
+// Scans and parses a large input with a fresh arena for every run, like a single big expression,
+// with every backend and growth policy. The peak is the memory the arena held before it got freed.
+static void bench_arena_backends(const char* name, const char* input)
+{
+  static const char* backends[] = { "malloc", "mmap", "hugepage" };
+  static const char* growths[] = { "geometric", "fixed" };
+  static_assert(ARRAY_LEN(growths) == ARENA_GROWTH_COUNT, "Every growth policy needs a name");
+
+  size_t length = strlen(input);
+  size_t runs = BENCH_MIN_TOKENS / length + 1;
+
+  int pageFaults = bench_counter_open(BENCH_COUNTER_PAGE_FAULTS);
+  int tlbMisses = bench_counter_open(BENCH_COUNTER_DTLB_MISSES);
+
+  printf("Benchmark '%s': %.1f MB, %zu runs\n", name, (double) length * 1e-6, runs);
+
+  for (size_t b = 0; b < ARRAY_LEN(backends); ++b)
+  {
+    for (size_t g = 0; g < ARENA_GROWTH_COUNT; ++g)
+    {
+      size_t peak = 0;
+      size_t regions = 0;
+      bool success = true;
+
+      bench_counter_start(pageFaults);
+      bench_counter_start(tlbMisses);
+      double start = bench_now();
+
+      for (size_t r = 0; r < runs; ++r)
+      {
+        arena_t arena = { .backend = (e_arena_backend) (ARENA_BACKEND_MALLOC + b), .growth = (e_arena_growth) g };
+        lexer_t lexer = lexer_scan(&arena, input);
+        success = success && !lexer.isError && parser_execute(&arena, &lexer);
+
+        arena_stats_t stats = arena_stats(&arena);
+        if (stats.bytesHeld > peak)
+          peak = stats.bytesHeld;
+        regions = stats.regionsHeld;
+
+        arena_free(&arena);
+      }
+
+      double elapsed = bench_now() - start;
+      double faults = bench_counter_stop(pageFaults);
+      double misses = bench_counter_stop(tlbMisses);
+
+      if (!success)
+        printf("  ERROR: The input could not be parsed!\n");
+
+      printf("  %-8s %-10s%8.3f ns/char, %6.1f MB peak, %3zu regions", backends[b], growths[g], elapsed * 1e9 / (double) (runs * length), (double) peak * 1e-6, regions);
+      bench_print_counter("page faults", faults, runs);
+      bench_print_counter("dTLB misses", misses, runs);
+      printf("\n");
+    }
+  }
+
+#ifdef BENCH_PERF_SUPPORTED
+  if (pageFaults >= 0) close(pageFaults);
+  if (tlbMisses >= 0) close(tlbMisses);
+#endif
+}
+
+
+
+// Returns the time of libm and of the vectorized function for one value in nanoseconds.
+static void bench_math_function(e_node_func_type func, const double* inputs, double* values, size_t count, size_t passes, double* scalarTime, double* vectorTime)
+{
+  double start = bench_now();
+  for (size_t p = 0; p < passes; ++p)
+    for (size_t i = 0; i < count; ++i)
+      values[i] = nodeFunctionImpls[func](inputs[i]);
+  *scalarTime = (bench_now() - start) * 1e9 / (double) (passes * count);
+  benchSink = values[count - 1];
+
+  start = bench_now();
+  for (size_t p = 0; p < passes; ++p)
+  {
+    memcpy(values, inputs, count * sizeof(double));
+    simdKernelImpls[func](values, count);
+  }
+  *vectorTime = (bench_now() - start) * 1e9 / (double) (passes * count);
+  benchSink = values[count - 1];
+}
+
+// Compares libm with the vectorized math functions on small values between -0.5 and 0.5 (between
+// 0.5 and 1.5 for sqrt and the logarithms), where libm mostly takes its fast paths, and on wide
+// values between -200 and 200 (between 1 and 1001). asin and acos only get the small values. The
+// geometric mean of both speedups decides in 'simdmath.h' if the batch uses a kernel or libm.
+static void bench_math_functions()
+{
+  enum { count = 4096 };
+  static simd_vector_t vectors[count / SIMD_VECTOR_SIZE];
+  static double smallInputs[count];
+  static double wideInputs[count];
+
+  double* values = (double*) vectors;
+  uint32_t state = 3;
+  size_t passes = BENCH_MIN_INSTRUCTIONS / count / 8 + 1;
+
+  printf("Benchmark 'math functions': %zu values, %zu passes, %u lanes per vector\n", (size_t) count, passes, SIMD_VECTOR_SIZE);
+
+  for (size_t f = 0; f < NF_COUNT; ++f)
+  {
+    bool positive = f == NF_SQRT || f == NF_LN || f == NF_LOG10;
+    bool bounded = f == NF_ASIN || f == NF_ACOS;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      double random = bench_random_value(&state);
+      smallInputs[i] = random * 2.0 - (positive ? 0.5 : 1.5);
+      wideInputs[i] = positive ? 1.0 + (random - 0.5) * 2000.0 : (random - 0.75) * 800.0;
+    }
+
+    double scalarTime, vectorTime;
+    bench_math_function((e_node_func_type) f, smallInputs, values, count, passes, &scalarTime, &vectorTime);
+    printf("  %-8s small: libm %7.3f ns/value, vectorized %7.3f ns/value (%.2fx faster)\n", nodeFunctionTypeNames[f], scalarTime, vectorTime, scalarTime / vectorTime);
+
+    // asin and acos count their small speedup twice, like in the table of 'simdmath.h'.
+    double product = scalarTime / vectorTime;
+
+    if (bounded)
+      product *= product;
+    else
+    {
+      double smallSpeedup = product;
+      bench_math_function((e_node_func_type) f, wideInputs, values, count, passes, &scalarTime, &vectorTime);
+      printf("  %-8s wide:  libm %7.3f ns/value, vectorized %7.3f ns/value (%.2fx faster)\n", "", scalarTime, vectorTime, scalarTime / vectorTime);
+      product = smallSpeedup * (scalarTime / vectorTime);
+    }
+
+    bool usesKernel = simdFunctionImpls[f] == simdKernelImpls[f];
+    printf("  %-8s mean:  %.2fx faster, measured for the table %.2fx, batch uses %s%s\n", "", sqrt(product), sqrt(simdKernelSpeedupProducts[f]),
+      usesKernel ? "the kernel" : "libm", (product > 1.0) != usesKernel ? " (this measurement disagrees)" : "");
+  }
+}
+
+
+
+void run_benchmarks()
+{
+  printf("Benchmarks:\n\n");
+
+  printf("Dispatch:\n");
+  bench_dispatch("chain-64 (arithmetic)", 64, false);
+  bench_dispatch("chain-4096 (arithmetic)", 4096, false);
+  bench_dispatch("chain-4096 (functions)", 4096, true);
+
+  printf("\nCommon sub expressions:\n");
+  bench_merge_common("terms-1000 (8 unique)", 1000, 8);
+  bench_merge_common("terms-1000 (250 unique)", 1000, 250);
+
+  printf("\nReassociation:\n");
+  bench_reassociate("sum-64", 64);
+  bench_reassociate("sum-4096", 4096);
+
+  printf("\nPowers:\n");
+  bench_reduce_powers("square-256 (fast math)", 256, 2, OPT_FAST_MATH);
+  bench_reduce_powers("inverse-256 (fast math)", 256, -1, OPT_FAST_MATH);
+  bench_reduce_powers("cube-256 (fast math)", 256, 3, OPT_FAST_MATH);
+  bench_reduce_powers("power-7-256 (fast math)", 256, 7, OPT_FAST_MATH);
+  bench_reduce_powers("sqrt-256 (fast math)", 256, 0.5, OPT_FAST_MATH);
+
+  printf("\nFused multiply-add:\n");
+  bench_contract_fma("horner-16", 16);
+  bench_contract_fma("horner-256", 256);
+
+  printf("\nPolynomials:\n");
+  bench_polynomial("degree-8", 8, 1 << 14);
+  bench_polynomial("degree-24", 24, 1 << 14);
+
+  printf("\nParser:\n");
+  {
+    arena_t arena = {0};
+    bench_parse("flat-10000", bench_build_flat_input(&arena, 10000));
+    bench_parse("nested-100000", bench_build_nested_input(&arena, 100000));
+    arena_free(&arena);
+  }
+
+  printf("\nLexer:\n");
+  {
+    arena_t arena = {0};
+    bench_lex("flat-200000", bench_build_flat_input(&arena, 200000));
+    bench_lex("keywords-200000", bench_build_keyword_input(&arena, 200000));
+    arena_free(&arena);
+  }
+
+  printf("\nNumbers:\n");
+  bench_numbers("numbers-100000", 100000);
+
+  printf("\nArena:\n");
+  bench_arena_lines("lines-1000000", "0.75 * sqrt(0.5) - PI / 0.625 + (0.625 - EN) ^ -3", 1000000);
+  bench_arena_pool("lines-1000000", "0.75 * sqrt(0.5) - PI / 0.625 + (0.625 - EN) ^ -3", 1000000);
+
+  printf("\nArena backends:\n");
+  {
+    arena_t arena = {0};
+    bench_arena_backends("flat-200000", bench_build_flat_input(&arena, 200000));
+    arena_free(&arena);
+  }
+
+  printf("\nFormatting:\n");
+  bench_format("results-100000", 100000);
+
+  printf("\nKeywords:\n");
+  bench_keywords("keywords-10000", 10000);
+
+  printf("\nMath functions:\n");
+  bench_math_functions();
+
+  printf("\nBatch:\n");
+  bench_batch("chain-16 (arithmetic)", 16, false, 2, 1 << 16);
+  bench_batch("chain-256 (arithmetic)", 256, false, 4, 1 << 16);
+  bench_batch("chain-256 (functions)", 256, true, 4, 1 << 14);
+}
+
+#endif // _BENCHMARK_H_
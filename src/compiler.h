@@ -0,0 +1,655 @@
+#ifndef _COMPILER_H_
+#define _COMPILER_H_
+
+#include <stdint.h>
+
+#include "nodemap.h"
+
+
+// Threaded dispatch uses computed gotos (labels as values) which are a GCC extension that
+// is also supported by clang. The switch dispatch is always available as the portable fallback.
+#if defined(__GNUC__)
+  #define VM_THREADED_DISPATCH_SUPPORTED
+#endif
+
+
+// Error handling
+#define C_ERROR_NAME "COMPILATION-ERROR"
+#define C_ERROR_GIVEN_BYTECODE_INVALID() fprintf(ERROR_STREAM, C_ERROR_NAME ": Can't print the bytecode because an error happend!\n")
+
+
+// All enums
+typedef enum {
+  BC_PUSH_CONST,
+  BC_LOAD_VAR,
+  BC_ADD,
+  BC_SUB,
+  BC_MUL,
+  BC_DIV,
+  BC_POW,
+  BC_CALL,
+  BC_STORE_TEMP,
+  BC_LOAD_TEMP,
+  BC_FMA,
+
+  BC_COUNT
+} e_bytecode_op;
+
+static_assert(BC_COUNT == 11, "Amount of bytecode-ops have changed");
+
+const char* bytecodeOpNames[BC_COUNT] = {
+  [BC_PUSH_CONST] = "push",
+  [BC_LOAD_VAR]   = "load",
+  [BC_ADD]        = "add",
+  [BC_SUB]        = "sub",
+  [BC_MUL]        = "mul",
+  [BC_DIV]        = "div",
+  [BC_POW]        = "pow",
+  [BC_CALL]       = "call",
+  [BC_STORE_TEMP] = "store",
+  [BC_LOAD_TEMP]  = "reuse",
+  [BC_FMA]        = "fma",
+};
+
+static inline e_bytecode_op binop_to_bytecode_op(e_node_binop_type type)
+{
+  switch (type)
+  {
+    case NO_ADD: return BC_ADD;
+    case NO_SUB: return BC_SUB;
+    case NO_MUL: return BC_MUL;
+    case NO_DIV: return BC_DIV;
+    case NO_POW: return BC_POW;
+    case NO_COUNT:
+    default: UNREACHABLE("Binop-Node-Type not implemented!");
+  }
+}
+
+
+// Type-Definitions
+// The operand is the index into the constant-pool for 'BC_PUSH_CONST', the variable slot for
+// 'BC_LOAD_VAR', the 'e_node_func_type' for 'BC_CALL', the temp slot for 'BC_STORE_TEMP' and
+// 'BC_LOAD_TEMP' and the 'e_fma_flags' for 'BC_FMA'. All other ops only work on the stack.
+typedef struct {
+  e_bytecode_op op;
+  uint32_t operand;
+} instruction_t;
+
+typedef struct {
+  instruction_t* items;
+  size_t capacity;
+  size_t count;
+} instruction_list_t;
+
+typedef struct {
+  double* items;
+  size_t capacity;
+  size_t count;
+} constant_pool_t;
+
+typedef struct {
+  size_t* items;
+  size_t capacity;
+  size_t count;
+} cursor_list_t;
+
+typedef struct {
+  instruction_list_t code;
+  constant_pool_t constants;
+  // The cursor of every instruction. Only needed for error reporting, so it is kept
+  // out of the instruction stream.
+  cursor_list_t cursors;
+  // The amount of variable slots the expression reads, so every slot index is below it.
+  size_t variableCount;
+  // The handler address of every instruction for the threaded dispatch. This is NULL if
+  // threaded dispatch is not supported by the compiler.
+  const void** handlers;
+  // Pre allocated value stack, so executing does not allocate. Executing writes into the stack and
+  // the temps, so a bytecode must only be executed by one thread at a time.
+  double* stack;
+  size_t stackSize;
+  // Pre allocated values of the nodes which are shared in the AST. 'BC_STORE_TEMP' copies the top
+  // of the stack into a slot and every further use loads it with 'BC_LOAD_TEMP'.
+  double* temps;
+  size_t tempCount;
+  bool isError;
+} bytecode_t;
+
+
+#define bytecode_emit(a, bc, opcode, oper, curr)                                                      \
+    do {                                                                                              \
+      arena_da_append((a), &(bc)->code, ((instruction_t) { .op = (opcode), .operand = (oper) }));     \
+      arena_da_append((a), &(bc)->cursors, (curr));                                                   \
+    } while (0)
+
+
+
+// Frames for the explicit compile stack, so deeply nested trees can't overflow the C stack.
+typedef struct {
+  const node_t* node;
+  bool expanded;
+} compile_frame_t;
+
+typedef struct {
+  compile_frame_t* items;
+  size_t capacity;
+  size_t count;
+} compile_stack_t;
+
+#define compile_stack_push(a, stack, n) arena_da_append((a), (stack), ((compile_frame_t) { .node = (n), .expanded = false }))
+
+
+static const void** vm_thread_code(arena_t* arena, const bytecode_t* bc);
+
+
+// Counts how often every operation node is used. Nodes only get shared after the optimizer merged
+// common sub trees. A shared node is only walked once. Returns true if any node is shared.
+static bool compiler_count_uses(arena_t* arena, const node_t* root, node_map_t* uses)
+{
+  compile_stack_t stack = {0};
+  bool isShared = false;
+
+  compile_stack_push(arena, &stack, root);
+
+  while (stack.count > 0)
+  {
+    const node_t* node = stack.items[--stack.count].node;
+
+    // Parens are skipped like when compiling.
+    while (node->type == NT_PAREN)
+      node = node->as.paren.arg;
+
+    if (node_is_leaf(node))
+      continue;
+
+    uint32_t* count = node_map_get(uses, node);
+
+    if (count)
+    {
+      (*count)++;
+      isShared = true;
+      continue;
+    }
+
+    node_map_put(arena, uses, node, 1);
+
+    if (node->type == NT_BINOP)
+    {
+      compile_stack_push(arena, &stack, node->as.binop.rhs);
+      compile_stack_push(arena, &stack, node->as.binop.lhs);
+    }
+    else if (node->type == NT_FMA)
+    {
+      // The product itself does not get compiled, only its operands.
+      compile_stack_push(arena, &stack, node->as.fma.addend);
+      compile_stack_push(arena, &stack, node->as.fma.product->as.binop.rhs);
+      compile_stack_push(arena, &stack, node->as.fma.product->as.binop.lhs);
+    }
+    else
+      compile_stack_push(arena, &stack, node->as.func.arg);
+  }
+
+  return isShared;
+}
+
+// Emits the instruction that keeps the value of a shared node for its other uses.
+static void compiler_store_shared(arena_t* arena, bytecode_t* bc, const node_t* node, const node_map_t* uses, node_map_t* temps)
+{
+  if (*node_map_get(uses, node) < 2)
+    return;
+
+  node_map_put(arena, temps, node, (uint32_t) bc->tempCount);
+  bytecode_emit(arena, bc, BC_STORE_TEMP, (uint32_t) bc->tempCount, node->cursor);
+  bc->tempCount++;
+}
+
+
+// Lowers the AST into a flat post-order instruction stream for the stack based vm. If the AST is
+// a DAG every shared node only gets computed at its first use and stored in a temp slot.
+bytecode_t compiler_execute(arena_t* arena, const node_t* root)
+{
+  ASSERT_NULL(arena);
+
+  bytecode_t bc = {0};
+
+  if (!root)
+  {
+    bc.isError = true;
+    return bc;
+  }
+
+  compile_stack_t stack = {0};
+  size_t depth = 0;
+
+  node_map_t uses = {0};
+  node_map_t temps = {0};
+  bool isShared = compiler_count_uses(arena, root, &uses);
+
+  compile_stack_push(arena, &stack, root);
+
+  while (stack.count > 0)
+  {
+    compile_frame_t* frame = &stack.items[stack.count - 1];
+    const node_t* node = frame->node;
+
+    // Every further use of a shared node loads the stored value.
+    const uint32_t* temp = isShared && !frame->expanded && !node_is_leaf(node) ? node_map_get(&temps, node) : NULL;
+
+    if (temp)
+    {
+      bytecode_emit(arena, &bc, BC_LOAD_TEMP, *temp, node->cursor);
+      stack.count--;
+
+      if (++depth > bc.stackSize)
+        bc.stackSize = depth;
+      continue;
+    }
+
+    switch (node->type)
+    {
+      case NT_CONSTANT:
+      {
+        bytecode_emit(arena, &bc, BC_PUSH_CONST, (uint32_t) bc.constants.count, node->cursor);
+        arena_da_append(arena, &bc.constants, node->as.constant);
+        stack.count--;
+
+        if (++depth > bc.stackSize)
+          bc.stackSize = depth;
+        break;
+      }
+      case NT_BINOP:
+      {
+        if (!frame->expanded)
+        {
+          // The rhs gets pushed first so the lhs gets emitted first.
+          frame->expanded = true;
+          compile_stack_push(arena, &stack, node->as.binop.rhs);
+          compile_stack_push(arena, &stack, node->as.binop.lhs);
+          break;
+        }
+
+        // Division reports the divisor like 'ast_eval_value' does.
+        size_t cursor = node->as.binop.type == NO_DIV ? node->as.binop.rhs->cursor : node->cursor;
+        bytecode_emit(arena, &bc, binop_to_bytecode_op(node->as.binop.type), 0, cursor);
+        stack.count--;
+        depth--;
+
+        if (isShared)
+          compiler_store_shared(arena, &bc, node, &uses, &temps);
+        break;
+      }
+      case NT_FUNCTION:
+      {
+        if (node->as.func.type >= NF_COUNT)
+          UNREACHABLE("Invalid function-node-type!");
+
+        if (!frame->expanded)
+        {
+          frame->expanded = true;
+          compile_stack_push(arena, &stack, node->as.func.arg);
+          break;
+        }
+
+        bytecode_emit(arena, &bc, BC_CALL, (uint32_t) node->as.func.type, node->cursor);
+        stack.count--;
+
+        if (isShared)
+          compiler_store_shared(arena, &bc, node, &uses, &temps);
+        break;
+      }
+      case NT_PAREN:
+        // Parens only define the order of operations which is already given by the tree.
+        frame->node = node->as.paren.arg;
+        break;
+      case NT_FMA:
+      {
+        const node_fma_t* fma = &node->as.fma;
+
+        if (!frame->expanded)
+        {
+          // The operands get pushed in reverse, so they get emitted in the order of evaluation.
+          bool addendFirst = is_bit_set(fma->flags, FMA_ADDEND_FIRST);
+          frame->expanded = true;
+
+          if (!addendFirst)
+            compile_stack_push(arena, &stack, fma->addend);
+
+          compile_stack_push(arena, &stack, fma->product->as.binop.rhs);
+          compile_stack_push(arena, &stack, fma->product->as.binop.lhs);
+
+          if (addendFirst)
+            compile_stack_push(arena, &stack, fma->addend);
+          break;
+        }
+
+        bytecode_emit(arena, &bc, BC_FMA, (uint32_t) fma->flags, node->cursor);
+        stack.count--;
+        depth -= 2;
+
+        if (isShared)
+          compiler_store_shared(arena, &bc, node, &uses, &temps);
+        break;
+      }
+      case NT_VARIABLE:
+      {
+        size_t index = node->as.variable.index;
+        bytecode_emit(arena, &bc, BC_LOAD_VAR, (uint32_t) index, node->cursor);
+        stack.count--;
+
+        if (index >= bc.variableCount)
+          bc.variableCount = index + 1;
+        if (++depth > bc.stackSize)
+          bc.stackSize = depth;
+        break;
+      }
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+
+  assert(depth == 1 && "Unbalanced bytecode!");
+
+  bc.stack = (double*) arena_alloc(arena, bc.stackSize * sizeof(double));
+  bc.temps = bc.tempCount > 0 ? (double*) arena_alloc(arena, bc.tempCount * sizeof(double)) : NULL;
+  bc.handlers = vm_thread_code(arena, &bc);
+  return bc;
+}
+
+
+
+#define _VM_ASSERT_VARIABLES(bc, variables) \
+    assert(((bc)->variableCount == 0 || (variables)) && "The expression uses variables but no values were given!")
+
+// The three operands of 'BC_FMA' are on the stack in the order they were evaluated.
+static inline double vm_fma(uint32_t flags, const double* operands)
+{
+  if (is_bit_set(flags, FMA_ADDEND_FIRST))
+    return fma_apply((e_fma_flags) flags, operands[1], operands[2], operands[0]);
+
+  return fma_apply((e_fma_flags) flags, operands[0], operands[1], operands[2]);
+}
+
+// Executes the bytecode with a single switch per instruction. The variables hold the value of every
+// variable slot and can be NULL if the expression has no variables. On an error 'NAN' gets returned
+// and the status contains the error type and the cursor of the failing instruction.
+// The value stack and the temps of the bytecode get used as scratch memory, so threads which
+// evaluate the same expression need their own compiled bytecode.
+double vm_execute_switch(bytecode_t* bc, const double* variables, eval_status_t* status)
+{
+  ASSERT_NULL(bc);
+  ASSERT_NULL(status);
+  assert(!bc->isError && bc->code.count > 0 && "Invalid bytecode!");
+  _VM_ASSERT_VARIABLES(bc, variables);
+
+  const instruction_t* code = bc->code.items;
+  const double* constants = bc->constants.items;
+  double* temps = bc->temps;
+  double* sp = bc->stack;
+
+  *status = EVAL_STATUS_SUCCESS();
+
+  for (const instruction_t* ip = code; ip < code + bc->code.count; ++ip)
+  {
+    switch (ip->op)
+    {
+      case BC_PUSH_CONST:
+        *sp++ = constants[ip->operand];
+        break;
+      case BC_LOAD_VAR:
+        *sp++ = variables[ip->operand];
+        break;
+      case BC_ADD:
+        --sp;
+        sp[-1] += sp[0];
+        break;
+      case BC_SUB:
+        --sp;
+        sp[-1] -= sp[0];
+        break;
+      case BC_MUL:
+        --sp;
+        sp[-1] *= sp[0];
+        break;
+      case BC_DIV:
+        --sp;
+        if (sp[0] == 0)
+        {
+          *status = EVAL_STATUS_ERROR(ES_DIVISION_BY_ZERO, bc->cursors.items[ip - code]);
+          return NAN;
+        }
+        sp[-1] /= sp[0];
+        break;
+      case BC_POW:
+        --sp;
+        sp[-1] = pow(sp[-1], sp[0]);
+        break;
+      case BC_CALL:
+        sp[-1] = nodeFunctionImpls[ip->operand](sp[-1]);
+        break;
+      case BC_STORE_TEMP:
+        temps[ip->operand] = sp[-1];
+        break;
+      case BC_LOAD_TEMP:
+        *sp++ = temps[ip->operand];
+        break;
+      case BC_FMA:
+        sp -= 2;
+        sp[-1] = vm_fma(ip->operand, sp - 1);
+        break;
+      case BC_COUNT:
+      default:
+        UNREACHABLE("Invalid bytecode-op!");
+    }
+  }
+
+  return bc->stack[0];
+}
+
+
+#ifdef VM_THREADED_DISPATCH_SUPPORTED
+
+// The handler labels are only valid inside the function that defines them, so the same function
+// also hands them out for threading the code: When 'labels' is not NULL, nothing gets executed and
+// only the label table gets returned.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+static double vm_execute_threaded_ex(bytecode_t* bc, const double* variables, eval_status_t* status, const void* const** labels)
+{
+  static const void* const handlerLabels[BC_COUNT + 1] = {
+    [BC_PUSH_CONST] = &&do_push_const,
+    [BC_LOAD_VAR]   = &&do_load_var,
+    [BC_ADD]        = &&do_add,
+    [BC_SUB]        = &&do_sub,
+    [BC_MUL]        = &&do_mul,
+    [BC_DIV]        = &&do_div,
+    [BC_POW]        = &&do_pow,
+    [BC_CALL]       = &&do_call,
+    [BC_STORE_TEMP] = &&do_store_temp,
+    [BC_LOAD_TEMP]  = &&do_load_temp,
+    [BC_FMA]        = &&do_fma,
+    // Gets appended after the last instruction.
+    [BC_COUNT]      = &&do_end,
+  };
+
+  static_assert(BC_COUNT == 11, "Amount of bytecode-ops have changed");
+
+  if (labels)
+  {
+    *labels = handlerLabels;
+    return 0;
+  }
+
+  const instruction_t* code = bc->code.items;
+  const void** handlers = bc->handlers;
+  const double* constants = bc->constants.items;
+  double* temps = bc->temps;
+  double* sp = bc->stack;
+  size_t pc = 0;
+
+  *status = EVAL_STATUS_SUCCESS();
+
+  #define DISPATCH() goto *handlers[pc]
+  #define NEXT()     do { ++pc; DISPATCH(); } while (0)
+
+  DISPATCH();
+
+  do_push_const:
+    *sp++ = constants[code[pc].operand];
+    NEXT();
+  do_load_var:
+    *sp++ = variables[code[pc].operand];
+    NEXT();
+  do_add:
+    --sp;
+    sp[-1] += sp[0];
+    NEXT();
+  do_sub:
+    --sp;
+    sp[-1] -= sp[0];
+    NEXT();
+  do_mul:
+    --sp;
+    sp[-1] *= sp[0];
+    NEXT();
+  do_div:
+    --sp;
+    if (sp[0] == 0)
+    {
+      *status = EVAL_STATUS_ERROR(ES_DIVISION_BY_ZERO, bc->cursors.items[pc]);
+      return NAN;
+    }
+    sp[-1] /= sp[0];
+    NEXT();
+  do_pow:
+    --sp;
+    sp[-1] = pow(sp[-1], sp[0]);
+    NEXT();
+  do_call:
+    sp[-1] = nodeFunctionImpls[code[pc].operand](sp[-1]);
+    NEXT();
+  do_store_temp:
+    temps[code[pc].operand] = sp[-1];
+    NEXT();
+  do_load_temp:
+    *sp++ = temps[code[pc].operand];
+    NEXT();
+  do_fma:
+    sp -= 2;
+    sp[-1] = vm_fma(code[pc].operand, sp - 1);
+    NEXT();
+  do_end:
+    return bc->stack[0];
+
+  #undef NEXT
+  #undef DISPATCH
+}
+
+#pragma GCC diagnostic pop
+
+
+// Executes the bytecode with direct threaded dispatch, so every instruction jumps straight to the
+// handler of the next one. Behaves exactly like 'vm_execute_switch'.
+double vm_execute_threaded(bytecode_t* bc, const double* variables, eval_status_t* status)
+{
+  ASSERT_NULL(bc);
+  ASSERT_NULL(status);
+  assert(!bc->isError && bc->code.count > 0 && bc->handlers && "Invalid bytecode!");
+  _VM_ASSERT_VARIABLES(bc, variables);
+
+  return vm_execute_threaded_ex(bc, variables, status, NULL);
+}
+
+// Translates every op into the address of its handler.
+static const void** vm_thread_code(arena_t* arena, const bytecode_t* bc)
+{
+  const void* const* labels = NULL;
+  vm_execute_threaded_ex(NULL, NULL, NULL, &labels);
+
+  const void** handlers = (const void**) arena_alloc(arena, (bc->code.count + 1) * sizeof(void*));
+
+  for (size_t i = 0; i < bc->code.count; ++i)
+    handlers[i] = labels[bc->code.items[i].op];
+
+  handlers[bc->code.count] = labels[BC_COUNT];
+  return handlers;
+}
+
+#else
+
+static const void** vm_thread_code(arena_t* arena, const bytecode_t* bc)
+{
+  (void) arena;
+  (void) bc;
+  return NULL;
+}
+
+#endif // VM_THREADED_DISPATCH_SUPPORTED
+
+
+// Executes the bytecode with the dispatch selected at build time ('DISPATCH' in the Makefile).
+double vm_execute(bytecode_t* bc, const double* variables, eval_status_t* status)
+{
+#if defined(VM_THREADED_DISPATCH) && defined(VM_THREADED_DISPATCH_SUPPORTED)
+  return vm_execute_threaded(bc, variables, status);
+#else
+  return vm_execute_switch(bc, variables, status);
+#endif
+}
+
+
+
+void bytecode_print(const bytecode_t* bc)
+{
+  ASSERT_NULL(bc);
+
+  if (bc->isError || bc->code.count == 0)
+  {
+    C_ERROR_GIVEN_BYTECODE_INVALID();
+    return;
+  }
+
+  printf("Printing bytecode (%zu instructions, stack size %zu):\n", bc->code.count, bc->stackSize);
+
+  for (size_t i = 0; i < bc->code.count; ++i)
+  {
+    const instruction_t* inst = &bc->code.items[i];
+
+    const char* opName = bytecodeOpNames[inst->op];
+
+    switch (inst->op)
+    {
+      case BC_PUSH_CONST:
+        printf("%04zu  %-6s" DOUBLE_PRINT_FORMAT, i, opName, bc->constants.items[inst->operand]);
+        break;
+      case BC_LOAD_VAR:
+        printf("%04zu  %-6svar[%u]", i, opName, inst->operand);
+        break;
+      case BC_CALL:
+        printf("%04zu  %-6s%s", i, opName, nodeFunctionTypeNames[inst->operand]);
+        break;
+      case BC_STORE_TEMP:
+      case BC_LOAD_TEMP:
+        printf("%04zu  %-6stemp[%u]", i, opName, inst->operand);
+        break;
+      case BC_FMA:
+        printf("%04zu  %-6s%s", i, opName, fma_type_name(inst->operand));
+        break;
+      case BC_ADD:
+      case BC_SUB:
+      case BC_MUL:
+      case BC_DIV:
+      case BC_POW:
+        printf("%04zu  %s", i, opName);
+        break;
+      case BC_COUNT:
+      default:
+        UNREACHABLE("Invalid bytecode-op!");
+    }
+
+    printf("\n");
+  }
+}
+
+#endif // _COMPILER_H_
@@ -0,0 +1,309 @@
+#ifndef _EXPRFILE_H_
+#define _EXPRFILE_H_
+
+#include "compiler.h"
+#include "optimizer.h"
+#include "workpool.h"
+#include "arenapool.h"
+#include "numformat.h"
+
+
+// Formats a result with 'precision' decimal places or the shortest exact form for
+// 'NUMBER_FORMAT_SHORTEST'. Returns the length.
+size_t expression_format_result(double result, int precision, char* buffer)
+{
+  return precision < 0 ? number_format(result, buffer) : number_format_fixed(result, precision, buffer);
+}
+
+
+// Runs the full pipeline for a single expression with the given optimizer passes and stores the
+// result. The errors of every stage get written to 'ERROR_STREAM'. All memory gets allocated from
+// the arena.
+bool expression_evaluate(arena_t* arena, const char* input, e_optimizer_flags optimizerFlags, bool verbose, double* result)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(result);
+
+  lexer_t lexer;
+
+  // The verbose output prints the tokens of the tokenizer, so it still needs the two stages.
+  if (verbose)
+  {
+    tokenizer_t tokenizer = tokenizer_execute(arena, input);
+
+    if (tokenizer.isError)
+      return false;
+
+    tokenizer_print(&tokenizer);
+    lexer = lexer_execute(arena, &tokenizer);
+  }
+  else
+    lexer = lexer_scan(arena, input);
+
+  if (lexer.isError)
+    return false;
+
+  if (verbose)
+    lexer_print(&lexer);
+
+  node_t* rootNode = parser_execute(arena, &lexer);
+
+  if (!rootNode)
+    return false;
+
+  if (verbose)
+    print_node(rootNode, true);
+
+  optimizer_stats_t stats = optimizer_execute(arena, rootNode, optimizerFlags);
+
+  if (verbose)
+    optimizer_print_stats(&stats);
+
+  bytecode_t bytecode = compiler_execute(arena, rootNode);
+
+  if (bytecode.isError)
+    return false;
+
+  if (verbose)
+    bytecode_print(&bytecode);
+
+  eval_status_t status;
+  *result = vm_execute(&bytecode, NULL, &status);
+
+  if (eval_status_is_error(&status)) {
+    E_ERROR_STATUS(&status);
+    return false;
+  }
+
+  return true;
+}
+
+
+
+// The expression file mode evaluates a file with one expression per line. The lines get grouped
+// into tasks which run in parallel on the work pool. The output gets written after all lines are
+// done, so it is in input order no matter which worker evaluated a line.
+//
+// Every line gets an arena from the pool of its worker thread and gives it back when it is done,
+// so the workers never share an allocator and the memory of a line gets reused by the next one.
+#define EXPRFILE_LINES_PER_TASK 64
+
+
+typedef struct {
+  // Points into the file buffer. The line end got replaced with '\0'.
+  const char* input;
+  double result;
+  bool success;
+  // The error messages of the line in the error buffer of 'worker'.
+  size_t worker;
+  size_t errorBegin;
+  size_t errorEnd;
+} exprfile_line_t;
+
+typedef struct {
+  // Collects the error messages of all lines this worker evaluated.
+  FILE* errors;
+  char* errorBuffer;
+  size_t errorSize;
+} exprfile_worker_t;
+
+typedef struct {
+  exprfile_line_t* items;
+  size_t capacity;
+  size_t count;
+} exprfile_lines_t;
+
+typedef struct {
+  exprfile_lines_t lines;
+  exprfile_worker_t* workers;
+  e_optimizer_flags optimizerFlags;
+} exprfile_t;
+
+
+// Lines without anything except whitespace are skipped and give an empty output line.
+static bool exprfile_line_is_empty(const char* line)
+{
+  for (; *line; ++line)
+    if (!isspace((unsigned char) *line))
+      return false;
+
+  return true;
+}
+
+static void exprfile_evaluate_task(void* context, size_t worker, size_t task)
+{
+  exprfile_t* file = (exprfile_t*) context;
+  exprfile_worker_t* w = &file->workers[worker];
+
+  size_t begin = task * EXPRFILE_LINES_PER_TASK;
+  size_t end = begin + EXPRFILE_LINES_PER_TASK < file->lines.count ? begin + EXPRFILE_LINES_PER_TASK : file->lines.count;
+
+  errorStream = w->errors;
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    exprfile_line_t* line = &file->lines.items[i];
+
+    if (exprfile_line_is_empty(line->input))
+      continue;
+
+    arena_t arena = arena_pool_acquire();
+
+    line->worker = worker;
+    line->errorBegin = (size_t) ftell(w->errors);
+    line->success = expression_evaluate(&arena, line->input, file->optimizerFlags, false, &line->result);
+    line->errorEnd = (size_t) ftell(w->errors);
+
+    arena_pool_release(&arena);
+  }
+
+  errorStream = NULL;
+}
+
+
+// Reads the whole file into the arena and returns NULL on error.
+static char* exprfile_read(arena_t* arena, const char* path, size_t* size)
+{
+  FILE* f = fopen(path, "rb");
+  char* content = NULL;
+
+  if (!f)
+    return NULL;
+
+  if (fseek(f, 0, SEEK_END) != 0)
+    return_defer();
+
+  long length = ftell(f);
+  if (length < 0 || fseek(f, 0, SEEK_SET) != 0)
+    return_defer();
+
+  content = arena_alloc(arena, (size_t) length + 1);
+
+  if (fread(content, 1, (size_t) length, f) != (size_t) length)
+  {
+    content = NULL;
+    return_defer();
+  }
+
+  content[length] = '\0';
+  *size = (size_t) length;
+
+defer:
+  fclose(f);
+  return content;
+}
+
+// Splits the content into null-terminated lines in place. A '\r' before the line end gets removed.
+static void exprfile_split_lines(arena_t* arena, char* content, size_t size, exprfile_lines_t* lines)
+{
+  char* lineStart = content;
+
+  for (size_t i = 0; i <= size; ++i)
+  {
+    if (i < size && content[i] != '\n')
+      continue;
+
+    // The last line only counts if it is not empty, because files normally end with a new line.
+    if (i == size && content + i == lineStart)
+      break;
+
+    if (content + i > lineStart && content[i - 1] == '\r')
+      content[i - 1] = '\0';
+    content[i] = '\0';
+
+    arena_da_append(arena, lines, ((exprfile_line_t) { .input = lineStart }));
+    lineStart = content + i + 1;
+  }
+}
+
+
+// Evaluates every line of the file in parallel. Writes one output line per input line to stdout:
+// The result, 'ERROR' if the line failed or nothing for empty lines. The error messages get
+// written to stderr with the file and the line number in front.
+// Returns false if the file could not be read or a line failed.
+bool handle_expression_file(const char* path, e_optimizer_flags optimizerFlags, int precision)
+{
+  ASSERT_NULL(path);
+
+  arena_t arena = {0};
+  exprfile_t file = { .optimizerFlags = optimizerFlags };
+  size_t size = 0;
+  size_t workerCount = work_pool_default_workers();
+  bool success = true;
+
+  char* content = exprfile_read(&arena, path, &size);
+
+  if (!content)
+  {
+    fprintf(stderr, "ERROR: Could not read the file '%s'!\n", path);
+    arena_free(&arena);
+    return false;
+  }
+
+  exprfile_split_lines(&arena, content, size, &file.lines);
+
+  file.workers = arena_alloc(&arena, workerCount * sizeof(exprfile_worker_t));
+
+  for (size_t w = 0; w < workerCount; ++w)
+  {
+    exprfile_worker_t* worker = &file.workers[w];
+    *worker = (exprfile_worker_t) {0};
+    worker->errors = open_memstream(&worker->errorBuffer, &worker->errorSize);
+
+    if (!worker->errors)
+      UNREACHABLE("handle_expression_file: Could not create the error stream!");
+  }
+
+  size_t taskCount = (file.lines.count + EXPRFILE_LINES_PER_TASK - 1) / EXPRFILE_LINES_PER_TASK;
+  work_pool_run(workerCount, taskCount, exprfile_evaluate_task, &file);
+
+  // Closing the streams makes the buffers final.
+  for (size_t w = 0; w < workerCount; ++w)
+    fclose(file.workers[w].errors);
+
+  for (size_t i = 0; i < file.lines.count; ++i)
+  {
+    const exprfile_line_t* line = &file.lines.items[i];
+
+    if (exprfile_line_is_empty(line->input))
+    {
+      printf("\n");
+      continue;
+    }
+
+    if (line->success)
+    {
+      char formatted[NUMBER_FORMAT_BUFFER_SIZE];
+      size_t length = expression_format_result(line->result, precision, formatted);
+      formatted[length++] = '\n';
+      fwrite(formatted, 1, length, stdout);
+      continue;
+    }
+
+    printf("ERROR\n");
+    success = false;
+
+    // Every error message gets the location of the line in the file.
+    const char* errors = file.workers[line->worker].errorBuffer;
+    const char* message = errors + line->errorBegin;
+
+    while (message < errors + line->errorEnd)
+    {
+      const char* messageEnd = memchr(message, '\n', (size_t) (errors + line->errorEnd - message));
+      if (!messageEnd) messageEnd = errors + line->errorEnd;
+
+      fprintf(stderr, "%s:%zu: %.*s\n", path, i + 1, (int) (messageEnd - message), message);
+      message = messageEnd + 1;
+    }
+  }
+
+  for (size_t w = 0; w < workerCount; ++w)
+    free(file.workers[w].errorBuffer);
+
+  // The pools of the other workers got freed when their threads exited.
+  arena_pool_thread_free();
+  arena_free(&arena);
+  return success;
+}
+
+#endif // _EXPRFILE_H_
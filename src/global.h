@@ -6,9 +6,12 @@
 #include <ctype.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
 
+#include "helpers.h"
 
-// TODO: Does currently not print correctly after around 5 decimal digits!
+
+// Only used for the verbose output and the tests. Results get printed with 'number_format'.
 #define DOUBLE_PRINT_FORMAT "%.05lf"
 
 
@@ -76,6 +79,60 @@ num_check_t cstr_is_number(const char* cstr)
 }
 
 
+// Keywords (math-constants and functions) are looked up with a perfect hash: Every identifier
+// lands in its own slot of a 'KEYWORD_HASH_SIZE' table, so a lookup is one hash, one table load
+// and one exact compare instead of a scan over all identifiers.
+// The identifiers are spelled out character by character in the '*_KEYWORDS' lists, so their slots
+// are constant expressions and the compiler fills the tables. Two identifiers in the same slot are
+// duplicate case labels in 'keyword_slots_are_unique', which fails the build, so adding or renaming
+// an identifier only needs a change of 'KEYWORD_HASH' if it collides.
+#define KEYWORD_HASH_SIZE  32
+#define KEYWORD_MIN_LENGTH 2
+#define KEYWORD_MAX_LENGTH 5
+
+#define KEYWORD_HASH(first, second, last, len) (((first) + 2u * (second) + 29u * (last) + (len)) & (KEYWORD_HASH_SIZE - 1))
+
+// Only valid for 'KEYWORD_MIN_LENGTH <= len'.
+static inline size_t keyword_hash(const char* cstr, size_t len)
+{
+  const unsigned char* s = (const unsigned char*) cstr;
+  return KEYWORD_HASH(s[0], s[1], s[len - 1], len);
+}
+
+#define keyword_length_is_valid(len) ((len) >= KEYWORD_MIN_LENGTH && (len) <= KEYWORD_MAX_LENGTH)
+
+static inline bool keyword_equals(const char* cstr, size_t len, const char* identifier)
+{
+  // 'strncmp' stops at the end of a shorter identifier, so the terminator check stays in bounds.
+  return strncmp(cstr, identifier, len) == 0 && identifier[len] == '\0';
+}
+
+// The characters of an identifier are the variadic arguments. There is no '_KEYWORD_LAST' for
+// identifiers which are too short or too long, so they don't compile.
+#define _KEYWORD_ARG_1(a, ...)                a
+#define _KEYWORD_ARG_2(a, b, ...)             b
+#define _KEYWORD_ARG_6(a, b, c, d, e, f, ...) f
+#define _KEYWORD_LAST_2(a, b)                 b
+#define _KEYWORD_LAST_3(a, b, c)              c
+#define _KEYWORD_LAST_4(a, b, c, d)           d
+#define _KEYWORD_LAST_5(a, b, c, d, e)        e
+#define _KEYWORD_LAST(...)                                                                    \
+    _KEYWORD_ARG_6(__VA_ARGS__, _KEYWORD_LAST_5, _KEYWORD_LAST_4, _KEYWORD_LAST_3,            \
+                   _KEYWORD_LAST_2, _KEYWORD_TOO_SHORT, _KEYWORD_TOO_SHORT)(__VA_ARGS__)
+
+#define KEYWORD_LENGTH(...) sizeof((const char[]) { __VA_ARGS__ })
+#define KEYWORD_STRING(...) ((const char[]) { __VA_ARGS__, '\0' })
+#define KEYWORD_SLOT(...)                                                                     \
+    KEYWORD_HASH(_KEYWORD_ARG_1(__VA_ARGS__, 0), _KEYWORD_ARG_2(__VA_ARGS__, 0),              \
+                 _KEYWORD_LAST(__VA_ARGS__), KEYWORD_LENGTH(__VA_ARGS__))
+
+// Expansions of the '*_KEYWORDS' lists. The tables hold the type plus one, so zero is an empty slot.
+#define _KEYWORD_COUNT(type, ...)       + 1
+#define _KEYWORD_IDENTIFIER(type, ...)  [type] = KEYWORD_STRING(__VA_ARGS__),
+#define _KEYWORD_TABLE_ENTRY(type, ...) [KEYWORD_SLOT(__VA_ARGS__)] = (uint8_t) ((type) + 1),
+#define _KEYWORD_CASE(type, ...)        case KEYWORD_SLOT(__VA_ARGS__):
+
+
 
 // Reference: https://en.wikipedia.org/wiki/List_of_mathematical_constants
 typedef enum {
@@ -93,14 +150,19 @@ typedef enum {
 
 static_assert(MC_COUNT == 7, "Amount of math-constant-types have changed");
 
+#define MATH_CONSTANT_KEYWORDS(X)                                                             \
+  X(MC_PI,              'P', 'I')      /* Pi */                                               \
+  X(MC_TAU,             'T', 'A', 'U') /* Tau */                                              \
+  X(MC_PHI,             'P', 'H', 'I') /* Phi */                                              \
+  X(MC_EULERS_NUMBER,   'E', 'N')      /* Euler's number */                                   \
+  X(MC_EULERS_CONSTANT, 'E', 'C')      /* Euler's constant */                                 \
+  X(MC_OMEGA_CONSTANT,  'O', 'C')      /* Omega constant */                                   \
+  X(MC_GAUSS_CONSTANT,  'G', 'C')      /* Gauss's constant */
+
+static_assert(0 MATH_CONSTANT_KEYWORDS(_KEYWORD_COUNT) == MC_COUNT, "Every math-constant-type needs exactly one keyword");
+
 const char* mathConstantTypeIdentifiers[MC_COUNT] = {
-  [MC_PI]              = "PI",  // Pi
-  [MC_TAU]             = "TAU", // Tau
-  [MC_PHI]             = "PHI", // Phi
-  [MC_EULERS_NUMBER]   = "EN",  // Euler's number
-  [MC_EULERS_CONSTANT] = "EC",  // Euler's constant
-  [MC_OMEGA_CONSTANT]  = "OC",  // Omega constant
-  [MC_GAUSS_CONSTANT]  = "GC",  // Gauss's constant
+  MATH_CONSTANT_KEYWORDS(_KEYWORD_IDENTIFIER)
 };
 
 // A double can store 15 decimal digits.
@@ -124,28 +186,39 @@ const char* mathConstantTypeNames[MC_COUNT] = {
   [MC_GAUSS_CONSTANT]  = "Gauss's constant",
 };
 
-e_math_constant_type cstr_to_math_constant_type(const char* cstr)
+static_assert(MC_COUNT < UINT8_MAX, "The math-constant-types don't fit into the keyword table");
+
+static const uint8_t mathConstantTypeHashTable[KEYWORD_HASH_SIZE] = {
+  MATH_CONSTANT_KEYWORDS(_KEYWORD_TABLE_ENTRY)
+};
+
+static inline e_math_constant_type keyword_find_math_constant(const char* cstr, size_t len)
 {
-  if (!cstr)
+  if (!keyword_length_is_valid(len))
     return MC_INVALID;
 
-  for (size_t i = 0; i < MC_COUNT; ++i)
-    if (strcmp(cstr, mathConstantTypeIdentifiers[i]) == 0)
-      return (e_math_constant_type) i;
+  const uint8_t entry = mathConstantTypeHashTable[keyword_hash(cstr, len)];
 
-  return MC_INVALID;
+  if (entry == 0 || !keyword_equals(cstr, len, mathConstantTypeIdentifiers[entry - 1]))
+    return MC_INVALID;
+
+  return (e_math_constant_type) (entry - 1);
 }
 
 e_math_constant_type cstr_to_math_constant_type_ex(const char* cstr, size_t len)
 {
-  if (!cstr || len == 0)
+  if (!cstr)
     return MC_INVALID;
 
-  for (size_t i = 0; i < MC_COUNT; ++i)
-    if (strncmp(cstr, mathConstantTypeIdentifiers[i], len) == 0)
-      return (e_math_constant_type) i;
+  return keyword_find_math_constant(cstr, len);
+}
+
+e_math_constant_type cstr_to_math_constant_type(const char* cstr)
+{
+  if (!cstr)
+    return MC_INVALID;
 
-  return MC_INVALID;
+  return cstr_to_math_constant_type_ex(cstr, strlen(cstr));
 }
 
 #define cstr_is_math_constant(cstr)         (cstr_to_math_constant_type(cstr) != MC_INVALID)
@@ -241,25 +314,30 @@ typedef enum {
 
 static_assert(FT_COUNT == 13, "Amount of function-types have changed");
 
+#define FUNCTION_KEYWORDS(X)                                                                  \
+  /* Other */                                                                                 \
+  X(FT_SQRT,  's', 'q', 'r', 't')                                                             \
+  X(FT_EXP,   'e', 'x', 'p')                                                                  \
+  /* Sin */                                                                                   \
+  X(FT_SIN,   's', 'i', 'n')                                                                  \
+  X(FT_ASIN,  'a', 's', 'i', 'n')                                                             \
+  X(FT_SINH,  's', 'i', 'n', 'h')                                                             \
+  /* Cos */                                                                                   \
+  X(FT_COS,   'c', 'o', 's')                                                                  \
+  X(FT_ACOS,  'a', 'c', 'o', 's')                                                             \
+  X(FT_COSH,  'c', 'o', 's', 'h')                                                             \
+  /* Tan */                                                                                   \
+  X(FT_TAN,   't', 'a', 'n')                                                                  \
+  X(FT_ATAN,  'a', 't', 'a', 'n')                                                             \
+  X(FT_TANH,  't', 'a', 'n', 'h')                                                             \
+  /* Log */                                                                                   \
+  X(FT_LN,    'l', 'n')                                                                       \
+  X(FT_LOG10, 'l', 'o', 'g', '1', '0')
+
+static_assert(0 FUNCTION_KEYWORDS(_KEYWORD_COUNT) == FT_COUNT, "Every function-type needs exactly one keyword");
+
 const char* functionTypeIdentifiers[FT_COUNT] = {
-  // Other
-  [FT_SQRT]   = "sqrt",
-  [FT_EXP]    = "exp",
-  // Sin
-  [FT_SIN]    = "sin",
-  [FT_ASIN]   = "asin",
-  [FT_SINH]   = "sinh",
-  // Cos
-  [FT_COS]    = "cos",
-  [FT_ACOS]   = "acos",
-  [FT_COSH]   = "cosh",
-  // Tan
-  [FT_TAN]    = "tan",
-  [FT_ATAN]   = "atan",
-  [FT_TANH]   = "tanh",
-  // Log
-  [FT_LN]     = "ln",
-  [FT_LOG10]  = "log10"
+  FUNCTION_KEYWORDS(_KEYWORD_IDENTIFIER)
 };
 
 const char* functionTypeNames[FT_COUNT] = {
@@ -304,28 +382,56 @@ const char* functionTypeDescriptions[FT_COUNT] = {
   [FT_LOG10]  = "Returns the common logarithm (base-10 logarithm) of x."
 };
 
-e_function_type cstr_to_function_type_ex(const char* cstr, size_t len)
+static_assert(FT_COUNT < UINT8_MAX, "The function-types don't fit into the keyword table");
+
+static const uint8_t functionTypeHashTable[KEYWORD_HASH_SIZE] = {
+  FUNCTION_KEYWORDS(_KEYWORD_TABLE_ENTRY)
+};
+
+// Never called. Two keywords of a table in the same slot are duplicate case labels, so the build
+// fails instead of a lookup finding the wrong keyword.
+static inline void keyword_slots_are_unique(size_t slot)
 {
-  if (!cstr || len == 0)
+  switch (slot)
+  {
+    MATH_CONSTANT_KEYWORDS(_KEYWORD_CASE)
+      break;
+  }
+
+  switch (slot)
+  {
+    FUNCTION_KEYWORDS(_KEYWORD_CASE)
+      break;
+  }
+}
+
+static inline e_function_type keyword_find_function(const char* cstr, size_t len)
+{
+  if (!keyword_length_is_valid(len))
     return FT_INVALID;
 
-  for (size_t i = 0; i < FT_COUNT; ++i)
-    if (strncmp(cstr, functionTypeIdentifiers[i], len) == 0)
-      return (e_function_type) i;
+  const uint8_t entry = functionTypeHashTable[keyword_hash(cstr, len)];
 
-  return FT_INVALID;
+  if (entry == 0 || !keyword_equals(cstr, len, functionTypeIdentifiers[entry - 1]))
+    return FT_INVALID;
+
+  return (e_function_type) (entry - 1);
 }
 
-e_function_type cstr_to_function_type(const char* cstr)
+e_function_type cstr_to_function_type_ex(const char* cstr, size_t len)
 {
   if (!cstr)
     return FT_INVALID;
 
-  for (size_t i = 0; i < FT_COUNT; ++i)
-    if (strcmp(cstr, functionTypeIdentifiers[i]) == 0)
-      return (e_function_type) i;
+  return keyword_find_function(cstr, len);
+}
+
+e_function_type cstr_to_function_type(const char* cstr)
+{
+  if (!cstr)
+    return FT_INVALID;
 
-  return FT_INVALID;
+  return cstr_to_function_type_ex(cstr, strlen(cstr));
 }
 
 #define cstr_is_function(cstr)         (cstr_to_function_type(cstr) != FT_INVALID)
@@ -10,6 +10,12 @@
 
 
 // Errors
+// The stream for the error messages of the expression stages. NULL means 'stderr'. The workers of
+// the expression file mode point it to their own buffer, so the messages of every line can be
+// written in input order.
+static _Thread_local FILE* errorStream = NULL;
+#define ERROR_STREAM (errorStream ? errorStream : stderr)
+
 #define UNREACHABLE_MSG(message)    fprintf(stderr, "%s:%d: UNREACHABLE: %s\n", __FILE__, __LINE__, message)
 #define UNREACHABLE(message)        do { UNREACHABLE_MSG(message); abort(); } while(0)
 #define UNREACHABLE_DEFER(message)  do { UNREACHABLE_MSG(message); goto defer; } while(0)
@@ -51,7 +57,7 @@ bool is_not_only_bit_set(int flags, int bit)
   if (!is_bit_set(flags, bit))
     return false;
 
-  while (index < (int)sizeof(int))
+  while (index < (int)(sizeof(int) * 8))
   {
     int mask = (1u << (index++));
 
@@ -0,0 +1,369 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+#include <stdint.h>
+
+#include "compiler.h"
+
+
+// The jit emits x86-64 SSE2 code for the System V calling convention. Fused multiply-adds use the
+// FMA instructions if the cpu supports them. On every other target (or
+// when building with 'JIT=disabled') compiling does nothing and executing falls back to the vm.
+#if defined(__x86_64__) && !defined(_WIN32) && !defined(JIT_DISABLED)
+  #define JIT_SUPPORTED
+#endif
+
+// The value stack and the temp slots live in the stack frame of the generated function, so very
+// deep expressions are left to the vm.
+#define JIT_MAX_STACK_SLOTS (1u << 16)
+
+
+// Returns -1 on success or the index of the failing instruction.
+typedef int (*jit_func_t)(double* result, const double* variables);
+
+typedef struct {
+  // Gets executed by the vm if the expression could not be compiled, so like the bytecode a jit code
+  // must only be executed by one thread at a time.
+  bytecode_t* bc;
+  // NULL if the bytecode could not be compiled to native code.
+  jit_func_t func;
+  void* memory;
+  size_t size;
+} jit_code_t;
+
+
+#ifdef JIT_SUPPORTED
+
+#include <sys/mman.h>
+
+typedef struct {
+  uint8_t* items;
+  size_t capacity;
+  size_t count;
+} jit_buffer_t;
+
+typedef struct {
+  size_t* items;
+  size_t capacity;
+  size_t count;
+} jit_patch_list_t;
+
+
+static void jit_emit_bytes(arena_t* arena, jit_buffer_t* buf, const uint8_t* bytes, size_t count)
+{
+  for (size_t i = 0; i < count; ++i)
+    arena_da_append(arena, buf, bytes[i]);
+}
+
+#define jit_emit(a, buf, ...) \
+    jit_emit_bytes((a), (buf), (const uint8_t[]) { __VA_ARGS__ }, sizeof((const uint8_t[]) { __VA_ARGS__ }))
+
+static void jit_emit_u32(arena_t* arena, jit_buffer_t* buf, uint32_t value)
+{
+  for (size_t i = 0; i < sizeof(value); ++i)
+    arena_da_append(arena, buf, (uint8_t) (value >> (i * 8)));
+}
+
+static void jit_emit_u64(arena_t* arena, jit_buffer_t* buf, uint64_t value)
+{
+  for (size_t i = 0; i < sizeof(value); ++i)
+    arena_da_append(arena, buf, (uint8_t) (value >> (i * 8)));
+}
+
+static void jit_patch_u32(jit_buffer_t* buf, size_t offset, uint32_t value)
+{
+  for (size_t i = 0; i < sizeof(value); ++i)
+    buf->items[offset + i] = (uint8_t) (value >> (i * 8));
+}
+
+
+// movsd [rsp + slot * 8], xmm0
+static void jit_emit_store_slot(arena_t* arena, jit_buffer_t* buf, size_t slot)
+{
+  jit_emit(arena, buf, 0xF2, 0x0F, 0x11, 0x84, 0x24);
+  jit_emit_u32(arena, buf, (uint32_t) (slot * sizeof(double)));
+}
+
+// movsd xmmN, [rsp + slot * 8]
+static void jit_emit_load_slot_reg(arena_t* arena, jit_buffer_t* buf, uint8_t reg, size_t slot)
+{
+  jit_emit(arena, buf, 0xF2, 0x0F, 0x10, (uint8_t) (0x84 | reg << 3), 0x24);
+  jit_emit_u32(arena, buf, (uint32_t) (slot * sizeof(double)));
+}
+
+// movsd xmm0, [rsp + slot * 8]
+static void jit_emit_load_slot(arena_t* arena, jit_buffer_t* buf, size_t slot)
+{
+  jit_emit_load_slot_reg(arena, buf, 0, slot);
+}
+
+// movapd xmm1, xmm0
+// movsd xmm0, [rsp + slot * 8]
+// Moves the top of the stack (rhs) into xmm1 and loads the lhs into xmm0.
+static void jit_emit_load_operands(arena_t* arena, jit_buffer_t* buf, size_t slot)
+{
+  jit_emit(arena, buf, 0x66, 0x0F, 0x28, 0xC8);
+  jit_emit_load_slot(arena, buf, slot);
+}
+
+// mov rax, imm64
+// call rax
+static void jit_emit_call(arena_t* arena, jit_buffer_t* buf, uint64_t address)
+{
+  jit_emit(arena, buf, 0x48, 0xB8);
+  jit_emit_u64(arena, buf, address);
+  jit_emit(arena, buf, 0xFF, 0xD0);
+}
+
+// Used when the cpu has no FMA instructions. The flags get passed in edi.
+static double jit_fma_fallback(double a, double b, double c, int flags)
+{
+  return fma_apply((e_fma_flags) flags, a, b, c);
+}
+
+// Loads the operands of 'BC_FMA' into xmm0 (a), xmm1 (b) and xmm2 (c) and computes
+// 'xmm0 = xmm0 * xmm1 + xmm2' with the negations of the flags.
+static void jit_emit_fma(arena_t* arena, jit_buffer_t* buf, uint32_t flags, size_t slot, bool hasFma)
+{
+  if (is_bit_set(flags, FMA_ADDEND_FIRST))
+  {
+    // movapd xmm1, xmm0; movsd xmm2, [c]; movsd xmm0, [a]
+    jit_emit(arena, buf, 0x66, 0x0F, 0x28, 0xC8);
+    jit_emit_load_slot_reg(arena, buf, 2, slot);
+    jit_emit_load_slot_reg(arena, buf, 0, slot + 1);
+  }
+  else
+  {
+    // movapd xmm2, xmm0; movsd xmm1, [b]; movsd xmm0, [a]
+    jit_emit(arena, buf, 0x66, 0x0F, 0x28, 0xD0);
+    jit_emit_load_slot_reg(arena, buf, 1, slot + 1);
+    jit_emit_load_slot_reg(arena, buf, 0, slot);
+  }
+
+  if (!hasFma)
+  {
+    // mov edi, flags
+    jit_emit(arena, buf, 0xBF);
+    jit_emit_u32(arena, buf, flags);
+    jit_emit_call(arena, buf, (uint64_t) (uintptr_t) jit_fma_fallback);
+    return;
+  }
+
+  // vfmadd213sd / vfnmadd213sd / vfmsub213sd / vfnmsub213sd xmm0, xmm1, xmm2
+  static const uint8_t opcodes[4] = { 0xA9, 0xAD, 0xAB, 0xAF };
+  jit_emit(arena, buf, 0xC4, 0xE2, 0xF1, opcodes[(flags >> 1) & 3], 0xC2);
+}
+
+
+// Compiles the bytecode to native code. The top of the value stack is always kept in xmm0 and
+// all values below it are spilled into the stack frame, so every op works like in the vm. The
+// temp slots follow the stack slots in the frame.
+static bool jit_compile_ex(arena_t* arena, const bytecode_t* bc, jit_code_t* jit)
+{
+  if (bc->stackSize + bc->tempCount > JIT_MAX_STACK_SLOTS)
+    return false;
+
+  jit_buffer_t buf = {0};
+  jit_patch_list_t errorJumps = {0};
+
+  // The return address and the three pushed registers keep the stack 16 byte aligned for the
+  // calls into libm, so the frame only needs to be a multiple of 16.
+  size_t tempBase = bc->stackSize - 1;
+  uint32_t frameSize = (uint32_t) ((tempBase + bc->tempCount) * sizeof(double));
+  frameSize = (frameSize + 15) & ~15u;
+
+  // push rbp; mov rbp, rsp; push rbx; push r12; mov rbx, rdi; mov r12, rsi; sub rsp, frameSize
+  jit_emit(arena, &buf, 0x55, 0x48, 0x89, 0xE5, 0x53, 0x41, 0x54);
+  jit_emit(arena, &buf, 0x48, 0x89, 0xFB, 0x49, 0x89, 0xF4, 0x48, 0x81, 0xEC);
+  jit_emit_u32(arena, &buf, frameSize);
+
+  size_t depth = 0;
+  bool hasFma = __builtin_cpu_supports("fma");
+
+  for (size_t i = 0; i < bc->code.count; ++i)
+  {
+    const instruction_t* inst = &bc->code.items[i];
+
+    switch (inst->op)
+    {
+      case BC_PUSH_CONST:
+      {
+        if (depth > 0)
+          jit_emit_store_slot(arena, &buf, depth - 1);
+
+        uint64_t bits;
+        memcpy(&bits, &bc->constants.items[inst->operand], sizeof(bits));
+
+        // mov rax, imm64; movq xmm0, rax
+        jit_emit(arena, &buf, 0x48, 0xB8);
+        jit_emit_u64(arena, &buf, bits);
+        jit_emit(arena, &buf, 0x66, 0x48, 0x0F, 0x6E, 0xC0);
+        depth++;
+        break;
+      }
+      case BC_LOAD_VAR:
+      {
+        if (depth > 0)
+          jit_emit_store_slot(arena, &buf, depth - 1);
+
+        // movsd xmm0, [r12 + slot * 8]
+        jit_emit(arena, &buf, 0xF2, 0x41, 0x0F, 0x10, 0x84, 0x24);
+        jit_emit_u32(arena, &buf, (uint32_t) (inst->operand * sizeof(double)));
+        depth++;
+        break;
+      }
+      case BC_ADD:
+      case BC_SUB:
+      case BC_MUL:
+        jit_emit_load_operands(arena, &buf, depth - 2);
+        // addsd / subsd / mulsd xmm0, xmm1
+        jit_emit(arena, &buf, 0xF2, 0x0F, inst->op == BC_ADD ? 0x58 : inst->op == BC_SUB ? 0x5C : 0x59, 0xC1);
+        depth--;
+        break;
+      case BC_DIV:
+      {
+        jit_emit_load_operands(arena, &buf, depth - 2);
+
+        // xorpd xmm2, xmm2; ucomisd xmm1, xmm2
+        // jp ok; jne ok (NAN is not zero, like in the vm)
+        // mov eax, INDEX; jmp epilogue
+        // ok: divsd xmm0, xmm1
+        jit_emit(arena, &buf, 0x66, 0x0F, 0x57, 0xD2, 0x66, 0x0F, 0x2E, 0xCA);
+        jit_emit(arena, &buf, 0x7A, 0x0C, 0x75, 0x0A, 0xB8);
+        jit_emit_u32(arena, &buf, (uint32_t) i);
+        jit_emit(arena, &buf, 0xE9);
+        arena_da_append(arena, &errorJumps, buf.count);
+        jit_emit_u32(arena, &buf, 0);
+        jit_emit(arena, &buf, 0xF2, 0x0F, 0x5E, 0xC1);
+        depth--;
+        break;
+      }
+      case BC_POW:
+        jit_emit_load_operands(arena, &buf, depth - 2);
+        jit_emit_call(arena, &buf, (uint64_t) (uintptr_t) pow);
+        depth--;
+        break;
+      case BC_CALL:
+        jit_emit_call(arena, &buf, (uint64_t) (uintptr_t) nodeFunctionImpls[inst->operand]);
+        break;
+      case BC_STORE_TEMP:
+        jit_emit_store_slot(arena, &buf, tempBase + inst->operand);
+        break;
+      case BC_LOAD_TEMP:
+        if (depth > 0)
+          jit_emit_store_slot(arena, &buf, depth - 1);
+
+        jit_emit_load_slot(arena, &buf, tempBase + inst->operand);
+        depth++;
+        break;
+      case BC_FMA:
+        jit_emit_fma(arena, &buf, inst->operand, depth - 3, hasFma);
+        depth -= 2;
+        break;
+      case BC_COUNT:
+      default:
+        UNREACHABLE("Invalid bytecode-op!");
+    }
+  }
+
+  assert(depth == 1 && "Unbalanced bytecode!");
+
+  // movsd [rbx], xmm0; mov eax, -1
+  jit_emit(arena, &buf, 0xF2, 0x0F, 0x11, 0x03, 0xB8, 0xFF, 0xFF, 0xFF, 0xFF);
+
+  size_t epilogue = buf.count;
+
+  // add rsp, frameSize; pop r12; pop rbx; pop rbp; ret
+  jit_emit(arena, &buf, 0x48, 0x81, 0xC4);
+  jit_emit_u32(arena, &buf, frameSize);
+  jit_emit(arena, &buf, 0x41, 0x5C, 0x5B, 0x5D, 0xC3);
+
+  for (size_t i = 0; i < errorJumps.count; ++i)
+  {
+    size_t offset = errorJumps.items[i];
+    jit_patch_u32(&buf, offset, (uint32_t) (epilogue - (offset + sizeof(uint32_t))));
+  }
+
+  void* memory = mmap(NULL, buf.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (memory == MAP_FAILED)
+    return false;
+
+  memcpy(memory, buf.items, buf.count);
+
+  if (mprotect(memory, buf.count, PROT_READ | PROT_EXEC) != 0)
+  {
+    munmap(memory, buf.count);
+    return false;
+  }
+
+  jit->memory = memory;
+  jit->size = buf.count;
+  // ISO C has no conversion from an object pointer to a function pointer.
+  memcpy(&jit->func, &memory, sizeof(memory));
+  return true;
+}
+
+#endif // JIT_SUPPORTED
+
+
+// Compiles the bytecode to native code if the jit is supported. The temporary code buffer gets
+// allocated from the arena. The bytecode must outlive the result.
+jit_code_t jit_compile(arena_t* arena, bytecode_t* bc)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(bc);
+  assert(!bc->isError && bc->code.count > 0 && "Invalid bytecode!");
+
+  jit_code_t jit = { .bc = bc };
+
+#ifdef JIT_SUPPORTED
+  if (!jit_compile_ex(arena, bc, &jit))
+    jit = (jit_code_t) { .bc = bc };
+#else
+  (void) arena;
+#endif
+
+  return jit;
+}
+
+// Executes the native code, or the vm if the expression could not be compiled. Behaves exactly
+// like 'vm_execute'.
+double jit_execute(const jit_code_t* jit, const double* variables, eval_status_t* status)
+{
+  ASSERT_NULL(jit);
+  ASSERT_NULL(status);
+
+  if (!jit->func)
+    return vm_execute(jit->bc, variables, status);
+
+  _VM_ASSERT_VARIABLES(jit->bc, variables);
+
+  double result;
+  int failedInstruction = jit->func(&result, variables);
+
+  if (failedInstruction >= 0)
+  {
+    *status = EVAL_STATUS_ERROR(ES_DIVISION_BY_ZERO, jit->bc->cursors.items[failedInstruction]);
+    return NAN;
+  }
+
+  *status = EVAL_STATUS_SUCCESS();
+  return result;
+}
+
+void jit_free(jit_code_t* jit)
+{
+  ASSERT_NULL(jit);
+
+#ifdef JIT_SUPPORTED
+  if (jit->memory)
+    munmap(jit->memory, jit->size);
+#endif
+
+  jit->func = NULL;
+  jit->memory = NULL;
+  jit->size = 0;
+}
+
+#endif // _JIT_H_
@@ -2,18 +2,21 @@
 #define _LEXER_H_
 
 #include "tokenizer.h"
+#include "numparse.h"
 
 // Error handling
 #define L_ERROR_NAME "LEXING-ERROR"
-#define L_ERROR_INVALID_NUMBER(cursor, tok) fprintf(stderr, L_ERROR_NAME ":%zu: A number can only contain 1 comma ('" IN_TOK_FMT "')!\n", (cursor), IN_TOK_ARG(tok))
-#define L_ERROR_INVALID_TOKEN(cursor, tok)  fprintf(stderr, L_ERROR_NAME ":%zu: '" IN_TOK_FMT "' is an invalid token!\n", (cursor), IN_TOK_ARG(tok))
-#define L_ERROR_GIVEN_LEXER_INVALID()       fprintf(stderr, L_ERROR_NAME ": Can't print the lexer because an error happend!\n")
+#define L_ERROR_INVALID_NUMBER(cursor, tok) fprintf(ERROR_STREAM, L_ERROR_NAME ":%zu: A number can only contain 1 comma ('" IN_TOK_FMT "')!\n", (cursor), IN_TOK_ARG(tok))
+#define L_ERROR_INVALID_TOKEN(cursor, tok)  fprintf(ERROR_STREAM, L_ERROR_NAME ":%zu: '" IN_TOK_FMT "' is an invalid token!\n", (cursor), IN_TOK_ARG(tok))
+#define L_ERROR_GIVEN_LEXER_INVALID()       fprintf(ERROR_STREAM, L_ERROR_NAME ": Can't print the lexer because an error happend!\n")
+#define L_ERROR_INPUT_TOO_LONG(cursor)      fprintf(ERROR_STREAM, L_ERROR_NAME ":%zu: The input is too long!\n", (cursor))
 
 
-// TODO: Implement variables and variable assigning
+// TODO: Implement variable assigning
 // Variables could look like e.g.: 'a', 'b', 'out1'
 // Variable assigning could look like: ':=' or '='
 // Also 'solve' could be a function which allows for using the '=' literal inside and variables for more complex expressions and equations.
+// Currently variables are only input slots which names are given by the caller, like the columns of a batch evaluation.
 
 
 // All enums
@@ -25,11 +28,12 @@ typedef enum {
   TT_FUNCTION,
   // Here are all not connected literals like ',' or '='.
   TT_LITERAL,
+  TT_VARIABLE,
 
   TT_COUNT
 } e_token_type;
 
-static_assert(TT_COUNT == 6, "Amount of token-types have changed");
+static_assert(TT_COUNT == 7, "Amount of token-types have changed");
 
 static const char* tokenTypeNames[TT_COUNT] = {
 	[TT_NUMBER] = "Number",
@@ -38,60 +42,251 @@ static const char* tokenTypeNames[TT_COUNT] = {
   [TT_PAREN] = "Parenthesis",
   [TT_FUNCTION] = "Function",
   [TT_LITERAL] = "Literal",
+  [TT_VARIABLE] = "Variable",
 };
 
 
 // Type-Definitions
-typedef union {
-  double number;
-  e_math_constant_type constant;
-  e_operator_type operator;
-  e_paren_type paren;
-  e_function_type function;
-  e_common_literal_type literal;
-} u_token_as;
-
+// Tokens are packed into 8 bytes, so lexing and parsing large inputs moves a third of the memory.
+// The lowest bits of 'data' hold the token-type and the rest its payload: The operator-, paren-,
+// function-, math-constant- or common-literal-type, the index of a number in the number pool of
+// the lexer or the slot of a variable.
 typedef struct {
-  e_token_type type;
-  size_t cursor;
-  u_token_as as;
+  uint32_t cursor;
+  uint32_t data;
 } token_t;
 
+#define TOKEN_TYPE_BITS   3
+#define TOKEN_MAX_PAYLOAD (UINT32_MAX >> TOKEN_TYPE_BITS)
+#define TOKEN_MAX_CURSOR  UINT32_MAX
+
+static_assert(sizeof(token_t) == 8, "The token must stay packed");
+static_assert(sizeof(token_t) == sizeof(double), "The number pool shares its slots with the tokens");
+static_assert(TT_COUNT <= (1 << TOKEN_TYPE_BITS), "The token-types don't fit into the packed token");
+
+// The names of all known variables. The index of a name is the slot of the variable. Names get
+// added with 'variable_list_add', which also puts them into an open addressing hash table, so a
+// lookup only compares the name with the variables of its bucket.
+typedef struct {
+  const char** items;
+  size_t capacity;
+  size_t count;
+  // The index plus one of a variable in every hash slot, zero for empty slots. It is never more
+  // than half full.
+  uint32_t* slots;
+  size_t slotCapacity;
+} variable_list_t;
+
+// The numbers of the tokens live in the same allocation as the tokens. The tokens fill it from the
+// front and the number pool from the back, so there is only one array which grows and it can grow
+// in place at the top of the arena.
 typedef struct {
   token_t* items;
+  // The slots of the allocation, which are shared by the tokens and the numbers.
   size_t capacity;
   size_t count;
+  size_t numberCount;
+  const variable_list_t* variables;
   bool isError;
 } lexer_t;
 
 
-#define add_number_token(a, lexer, num, curr)        arena_da_append((a), (lexer), ((token_t) { .type = TT_NUMBER,        .as.number   = (num), .cursor = (curr) }))
-#define add_math_constant_token(a, lexer, mc, curr)  arena_da_append((a), (lexer), ((token_t) { .type = TT_MATH_CONSTANT, .as.constant = (mc),  .cursor = (curr) }))
-#define add_operator_token(a, lexer, op, curr)       arena_da_append((a), (lexer), ((token_t) { .type = TT_OPERATOR,      .as.operator = (op),  .cursor = (curr) }))
-#define add_paren_token(a, lexer, pt, curr)          arena_da_append((a), (lexer), ((token_t) { .type = TT_PAREN,         .as.paren    = (pt),  .cursor = (curr) }))
-#define add_function_token(a, lexer, ft, curr)       arena_da_append((a), (lexer), ((token_t) { .type = TT_FUNCTION,      .as.function = (ft),  .cursor = (curr) }))
-#define add_literal_token(a, lexer, clt, curr)       arena_da_append((a), (lexer), ((token_t) { .type = TT_LITERAL,       .as.literal =  (clt), .cursor = (curr) }))
+// The number pool is stored backwards from the end of the allocation.
+#define lexer_number_pool(lexer)      ((double*) ((lexer)->items + (lexer)->capacity))
+#define lex_number(lexer, idx)        (((const double*) ((lexer)->items + (lexer)->capacity))[-1 - (ptrdiff_t) (idx)])
+
+// Makes room for one more token or number.
+static inline void lexer_reserve(arena_t* arena, lexer_t* lexer)
+{
+  if (lexer->count + lexer->numberCount < lexer->capacity)
+    return;
+
+  size_t newCapacity = lexer->capacity == 0 ? ARENA_DA_INIT_CAP : lexer->capacity * 2;
+  token_t* items = arena_realloc(arena, lexer->items, lexer->capacity * sizeof(token_t), newCapacity * sizeof(token_t));
+
+  // The numbers move to the new end.
+  memmove(items + newCapacity - lexer->numberCount, items + lexer->capacity - lexer->numberCount, lexer->numberCount * sizeof(double));
+
+  lexer->items = items;
+  lexer->capacity = newCapacity;
+}
+
+// Appends a packed token. Inputs with cursors or numbers which don't fit into it are an error,
+// which only gets reported once.
+static inline bool lexer_add_token(arena_t* arena, lexer_t* lexer, e_token_type type, size_t payload, size_t cursor)
+{
+  if (cursor > TOKEN_MAX_CURSOR || payload > TOKEN_MAX_PAYLOAD)
+  {
+    if (!lexer->isError)
+      L_ERROR_INPUT_TOO_LONG(cursor);
+
+    lexer->isError = true;
+    return false;
+  }
+
+  lexer_reserve(arena, lexer);
+  lexer->items[lexer->count++] = (token_t) { .cursor = (uint32_t) cursor, .data = (uint32_t) type | (uint32_t) payload << TOKEN_TYPE_BITS };
+  return true;
+}
+
+static inline void lexer_add_number(arena_t* arena, lexer_t* lexer, double number, size_t cursor)
+{
+  if (!lexer_add_token(arena, lexer, TT_NUMBER, lexer->numberCount, cursor))
+    return;
+
+  lexer_reserve(arena, lexer);
+  lexer_number_pool(lexer)[-1 - (ptrdiff_t) lexer->numberCount++] = number;
+}
+
+#define add_number_token(a, lexer, num, curr)        lexer_add_number((a), (lexer), (num), (curr))
+#define add_math_constant_token(a, lexer, mc, curr)  lexer_add_token((a), (lexer), TT_MATH_CONSTANT, (mc),  (curr))
+#define add_operator_token(a, lexer, op, curr)       lexer_add_token((a), (lexer), TT_OPERATOR,      (op),  (curr))
+#define add_paren_token(a, lexer, pt, curr)          lexer_add_token((a), (lexer), TT_PAREN,         (pt),  (curr))
+#define add_function_token(a, lexer, ft, curr)       lexer_add_token((a), (lexer), TT_FUNCTION,      (ft),  (curr))
+#define add_literal_token(a, lexer, clt, curr)       lexer_add_token((a), (lexer), TT_LITERAL,       (clt), (curr))
+#define add_variable_token(a, lexer, var, curr)      lexer_add_token((a), (lexer), TT_VARIABLE,      (var), (curr))
 
 
 // Helpers
 #define lex_at(lexer, idx)            (&(lexer)->items[(idx)])
 #define lex_next_in_range(lexer, idx) ((idx) < (lexer)->count - 1)
 
-#define tok_is(tok, t)                ((tok)->type == (t))
-#define tok_not(tok, t)               ((tok)->type != (t))
+#define tok_type(tok)                 ((e_token_type) ((tok)->data & ((1u << TOKEN_TYPE_BITS) - 1)))
+#define tok_payload(tok)              ((tok)->data >> TOKEN_TYPE_BITS)
+#define tok_cursor(tok)               ((size_t) (tok)->cursor)
 
-#define tok_is_paren(tok, pt)           (tok_is(tok, TT_PAREN) && (tok)->as.paren == (pt))
-#define tok_not_specific_paren(tok, pt) (tok_not((tok), TT_PAREN) || (tok)->as.paren != (pt))
-#define tok_is_number_operator(tok)     (tok_is(tok, TT_OPERATOR) && ((tok)->as.operator == OP_ADD || (tok)->as.operator == OP_SUB))
+#define tok_number(lexer, tok)        lex_number(lexer, tok_payload(tok))
+#define tok_constant(tok)             ((e_math_constant_type) tok_payload(tok))
+#define tok_operator(tok)             ((e_operator_type) tok_payload(tok))
+#define tok_paren(tok)                ((e_paren_type) tok_payload(tok))
+#define tok_function(tok)             ((e_function_type) tok_payload(tok))
+#define tok_literal(tok)              ((e_common_literal_type) tok_payload(tok))
+#define tok_variable(tok)             ((size_t) tok_payload(tok))
 
+#define tok_is(tok, t)                (tok_type(tok) == (t))
+#define tok_not(tok, t)               (tok_type(tok) != (t))
 
+#define tok_is_paren(tok, pt)           (tok_is(tok, TT_PAREN) && tok_paren(tok) == (pt))
+#define tok_not_specific_paren(tok, pt) (tok_not((tok), TT_PAREN) || tok_paren(tok) != (pt))
+#define tok_is_number_operator(tok)     (tok_is(tok, TT_OPERATOR) && (tok_operator(tok) == OP_ADD || tok_operator(tok) == OP_SUB))
+#define tok_is_value(tok)               (tok_is(tok, TT_NUMBER) || tok_is(tok, TT_MATH_CONSTANT) || tok_is(tok, TT_VARIABLE))
 
-lexer_t lexer_execute(arena_t* arena, tokenizer_t* tokenizer)
+
+#define VARIABLE_INVALID ((size_t) -1)
+
+#define VARIABLE_LIST_INIT_SLOTS 16
+
+// FNV-1a over the characters of the name.
+static inline size_t variable_hash(const char* cstr, size_t len)
+{
+  uint32_t hash = 2166136261u;
+
+  for (size_t i = 0; i < len; ++i)
+    hash = (hash ^ (unsigned char) cstr[i]) * 16777619u;
+
+  return hash;
+}
+
+// The hash slot of the name, which is either empty or holds the variable with that name.
+static size_t variable_list_probe(const variable_list_t* variables, const char* cstr, size_t len)
+{
+  const size_t mask = variables->slotCapacity - 1;
+  size_t slot = variable_hash(cstr, len) & mask;
+
+  while (variables->slots[slot] != 0 && !keyword_equals(cstr, len, variables->items[variables->slots[slot] - 1]))
+    slot = (slot + 1) & mask;
+
+  return slot;
+}
+
+// Returns the slot of the variable or 'VARIABLE_INVALID' if the name is not known.
+size_t variable_list_find(const variable_list_t* variables, const char* cstr, size_t len)
+{
+  if (!variables || !cstr || len == 0 || variables->slotCapacity == 0)
+    return VARIABLE_INVALID;
+
+  const uint32_t entry = variables->slots[variable_list_probe(variables, cstr, len)];
+  return entry != 0 ? entry - 1 : VARIABLE_INVALID;
+}
+
+// Adds the name, which has to outlive the list, and returns the slot of its variable. A name
+// which is already known keeps its slot.
+size_t variable_list_add(arena_t* arena, variable_list_t* variables, const char* name)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(variables);
+  ASSERT_NULL(name);
+
+  const size_t len = strlen(name);
+  const size_t known = variable_list_find(variables, name, len);
+
+  if (known != VARIABLE_INVALID)
+    return known;
+
+  assert(variables->count < UINT32_MAX && "Too many variables!");
+
+  // The table gets rebuilt with twice the slots before it would be more than half full.
+  if ((variables->count + 1) * 2 > variables->slotCapacity)
+  {
+    variables->slotCapacity = variables->slotCapacity == 0 ? VARIABLE_LIST_INIT_SLOTS : variables->slotCapacity * 2;
+    variables->slots = arena_alloc(arena, variables->slotCapacity * sizeof(uint32_t));
+    memset(variables->slots, 0, variables->slotCapacity * sizeof(uint32_t));
+
+    for (size_t i = 0; i < variables->count; ++i)
+      variables->slots[variable_list_probe(variables, variables->items[i], strlen(variables->items[i]))] = (uint32_t) (i + 1);
+  }
+
+  arena_da_append(arena, variables, name);
+  variables->slots[variable_list_probe(variables, name, len)] = (uint32_t) variables->count;
+  return variables->count - 1;
+}
+
+
+
+// Adds the token of a math-constant, a function or a variable. Returns false if the token is
+// none of them.
+static bool lexer_add_name(arena_t* arena, lexer_t* lexer, const input_token_t* token)
+{
+  // Keywords are looked up once each with the perfect hash from 'global.h'.
+  e_math_constant_type mc = keyword_find_math_constant(token->value, token->length);
+
+  if (mc != MC_INVALID)
+  {
+    add_math_constant_token(arena, lexer, mc, token->cursor);
+    return true;
+  }
+
+
+  e_function_type ft = keyword_find_function(token->value, token->length);
+
+  if (ft != FT_INVALID)
+  {
+    add_function_token(arena, lexer, ft, token->cursor);
+    return true;
+  }
+
+
+  size_t variable = variable_list_find(lexer->variables, token->value, token->length);
+
+  if (variable != VARIABLE_INVALID)
+  {
+    add_variable_token(arena, lexer, variable, token->cursor);
+    return true;
+  }
+
+  return false;
+}
+
+
+
+// Lexes the tokens. Symbols that are neither pre defined functions nor math-constants are looked up
+// in the given variables, which can be NULL if no variables are known.
+lexer_t lexer_execute_ex(arena_t* arena, tokenizer_t* tokenizer, const variable_list_t* variables)
 {
   ASSERT_NULL(arena);
   ASSERT_NULL(tokenizer);
 
-  lexer_t lexer = {0};
+  lexer_t lexer = { .variables = variables };
 
   for (size_t i = 0; i < tokenizer->count; ++i)
   {
@@ -116,10 +311,9 @@ lexer_t lexer_execute(arena_t* arena, tokenizer_t* tokenizer)
     if (numCheck.ret == 1) UNREACHABLE("Number-Token was NULL!");
     else if (numCheck.ret == 0)
     {
-      char* endptr;
-      double number = strtof(currentToken->value, &endptr);
-      
-      if (!endptr || endptr == currentToken->value || (size_t)(endptr - currentToken->value) != currentToken->length)
+      double number;
+
+      if (!number_parse(currentToken->value, currentToken->length, &number))
         UNREACHABLE("Error while converting a number!");
 
       add_number_token(arena, &lexer, number, currentToken->cursor);
@@ -147,28 +341,8 @@ lexer_t lexer_execute(arena_t* arena, tokenizer_t* tokenizer)
     }
 
 
-    if (cstr_is_math_constant_ex(currentToken->value, currentToken->length))
-    {
-      e_math_constant_type mc = cstr_to_math_constant_type_ex(currentToken->value, currentToken->length);
-
-      if (mc == MC_INVALID)
-        UNREACHABLE("Invalid math-constant-type!");
-
-      add_math_constant_token(arena, &lexer, mc, currentToken->cursor);
-      continue;
-    }
-
-
-    if (cstr_is_function_ex(currentToken->value, currentToken->length))
-    {
-      e_function_type ft = cstr_to_function_type_ex(currentToken->value, currentToken->length);
-
-      if (ft == FT_INVALID)
-        UNREACHABLE("Invalid function-type!");
-
-      add_function_token(arena, &lexer, ft, currentToken->cursor);
+    if (lexer_add_name(arena, &lexer, currentToken))
       continue;
-    }
 
 
     if (cstr_is_common_literal_ex(currentToken->value, currentToken->length))
@@ -191,6 +365,192 @@ lexer_t lexer_execute(arena_t* arena, tokenizer_t* tokenizer)
   return lexer;
 }
 
+lexer_t lexer_execute(arena_t* arena, tokenizer_t* tokenizer)
+{
+  return lexer_execute_ex(arena, tokenizer, NULL);
+}
+
+
+
+// The scanner below tokenizes and lexes the input in a single pass without the 'input_token_t'
+// array of the tokenizer. Every character gets classified with one load from 'charClassTable'.
+// Symbols are runs of 'CC_SYMBOL', 'CC_DIGIT' and 'CC_DECIMAL_SEPERATOR' characters which end at
+// spaces and literals, so it splits the input exactly like 'tokenizer_execute' and lexes the
+// symbols like 'lexer_execute_ex'. The two stage path is still used for the verbose printing.
+typedef enum {
+  CC_SYMBOL,
+  CC_SPACE,
+  CC_DIGIT,
+  CC_DECIMAL_SEPERATOR,
+  CC_OPERATOR,
+  CC_PAREN,
+  CC_COMMON_LITERAL,
+  CC_END,
+
+  CC_COUNT
+} e_char_class;
+
+static_assert(CC_COUNT == 8, "Amount of char-classes have changed");
+
+typedef struct {
+  uint8_t charClass;
+  // The operator-, paren- or common-literal-type of literal characters.
+  uint8_t type;
+} char_class_t;
+
+// Every character which is not listed is part of a symbol. Has to match 'isspace', 'isdigit' and
+// 'c_is_literal', which the ast tests ('-ta') verify.
+static const char_class_t charClassTable[256] = {
+  ['\0']                          = { CC_END,               0          },
+  [' ']                           = { CC_SPACE,             0          },
+  ['\t']                          = { CC_SPACE,             0          },
+  ['\n']                          = { CC_SPACE,             0          },
+  ['\v']                          = { CC_SPACE,             0          },
+  ['\f']                          = { CC_SPACE,             0          },
+  ['\r']                          = { CC_SPACE,             0          },
+  ['0']                           = { CC_DIGIT,             0          },
+  ['1']                           = { CC_DIGIT,             0          },
+  ['2']                           = { CC_DIGIT,             0          },
+  ['3']                           = { CC_DIGIT,             0          },
+  ['4']                           = { CC_DIGIT,             0          },
+  ['5']                           = { CC_DIGIT,             0          },
+  ['6']                           = { CC_DIGIT,             0          },
+  ['7']                           = { CC_DIGIT,             0          },
+  ['8']                           = { CC_DIGIT,             0          },
+  ['9']                           = { CC_DIGIT,             0          },
+  [_DECIMAL_SEPERATOR_CHARACTER]  = { CC_DECIMAL_SEPERATOR, 0          },
+  ['+']                           = { CC_OPERATOR,          OP_ADD     },
+  ['-']                           = { CC_OPERATOR,          OP_SUB     },
+  ['*']                           = { CC_OPERATOR,          OP_MUL     },
+  ['/']                           = { CC_OPERATOR,          OP_DIV     },
+  ['^']                           = { CC_OPERATOR,          OP_POW     },
+  ['(']                           = { CC_PAREN,             PT_OPAREN  },
+  [')']                           = { CC_PAREN,             PT_CPAREN  },
+  [',']                           = { CC_COMMON_LITERAL,    CLT_COMMA  },
+  ['=']                           = { CC_COMMON_LITERAL,    CLT_EQUALS },
+};
+
+#define char_class(c) ((e_char_class) charClassTable[(unsigned char) (c)].charClass)
+
+
+// Scans the symbol at 'start' and adds its token. Returns the first character after the symbol.
+static const char* lexer_scan_symbol(arena_t* arena, lexer_t* lexer, const char* input, const char* start)
+{
+  const char* current = start;
+  const char* secondSeperator = NULL;
+  size_t seperators = 0;
+  e_char_class cc;
+
+  // Numbers are digits with at most one decimal seperator, like in 'cstr_is_number_ex'.
+  while ((cc = char_class(*current)) == CC_DIGIT || cc == CC_DECIMAL_SEPERATOR)
+  {
+    if (cc == CC_DECIMAL_SEPERATOR && ++seperators == 2)
+      secondSeperator = current;
+
+    ++current;
+  }
+
+  const bool isNumber = cc != CC_SYMBOL;
+
+  while (cc == CC_SYMBOL || cc == CC_DIGIT || cc == CC_DECIMAL_SEPERATOR)
+    cc = char_class(*++current);
+
+  const input_token_t token = { .value = start, .length = (size_t) (current - start), .cursor = (size_t) (start - input) };
+
+  if (secondSeperator)
+  {
+    // Too many commas
+    L_ERROR_INVALID_NUMBER(token.cursor + (size_t) (secondSeperator - start), &token);
+    lexer->isError = true;
+    return current;
+  }
+
+  if (isNumber)
+  {
+    double number;
+
+    if (!number_parse(token.value, token.length, &number))
+      UNREACHABLE("Error while converting a number!");
+
+    add_number_token(arena, lexer, number, token.cursor);
+    return current;
+  }
+
+  if (!lexer_add_name(arena, lexer, &token))
+  {
+    // ERROR: Invalid token.
+    L_ERROR_INVALID_TOKEN(token.cursor, &token);
+    lexer->isError = true;
+  }
+
+  return current;
+}
+
+// Tokenizes and lexes the input in a single pass. Symbols that are neither pre defined functions
+// nor math-constants are looked up in the given variables, which can be NULL if no variables are
+// known.
+lexer_t lexer_scan_ex(arena_t* arena, const char* input, const variable_list_t* variables)
+{
+  ASSERT_NULL(arena);
+
+  lexer_t lexer = { .variables = variables };
+
+  if (!input || !*input)
+  {
+    T_ERROR_NO_INPUT_GIVEN();
+    lexer.isError = true;
+    return lexer;
+  }
+
+  const char* current = input;
+
+  while (true)
+  {
+    const char_class_t cc = charClassTable[(unsigned char) *current];
+    const size_t cursor = (size_t) (current - input);
+
+    switch ((e_char_class) cc.charClass)
+    {
+      case CC_END:
+        return lexer;
+
+      case CC_SPACE:
+        ++current;
+        break;
+
+      case CC_OPERATOR:
+        add_operator_token(arena, &lexer, (e_operator_type) cc.type, cursor);
+        ++current;
+        break;
+
+      case CC_PAREN:
+        add_paren_token(arena, &lexer, (e_paren_type) cc.type, cursor);
+        ++current;
+        break;
+
+      case CC_COMMON_LITERAL:
+        add_literal_token(arena, &lexer, (e_common_literal_type) cc.type, cursor);
+        ++current;
+        break;
+
+      case CC_SYMBOL:
+      case CC_DIGIT:
+      case CC_DECIMAL_SEPERATOR:
+        current = lexer_scan_symbol(arena, &lexer, input, current);
+        break;
+
+      case CC_COUNT:
+      default:
+        UNREACHABLE("Invalid char-class!");
+    }
+  }
+}
+
+lexer_t lexer_scan(arena_t* arena, const char* input)
+{
+  return lexer_scan_ex(arena, input, NULL);
+}
+
 
 void lexer_print(const lexer_t* lexer)
 {
@@ -205,28 +565,31 @@ void lexer_print(const lexer_t* lexer)
   printf("Printing lexed tokens (%zu tokens):\n", lexer->count);
   
   for (size_t i = 0; i < lexer->count; ++i) {
-    token_t* token = &lexer->items[i];
+    const token_t* token = &lexer->items[i];
 
-    printf("%s", tokenTypeNames[token->type]);
+    printf("%s", tokenTypeNames[tok_type(token)]);
 
-    switch (token->type) {
+    switch (tok_type(token)) {
       case TT_NUMBER:
-        printf("(" DOUBLE_PRINT_FORMAT ")", token->as.number);
+        printf("(" DOUBLE_PRINT_FORMAT ")", tok_number(lexer, token));
         break;
       case TT_MATH_CONSTANT:
-        printf("(" DOUBLE_PRINT_FORMAT ", %s)", mathConstantTypeValues[token->as.constant], mathConstantTypeNames[token->as.constant]);
+        printf("(" DOUBLE_PRINT_FORMAT ", %s)", mathConstantTypeValues[tok_constant(token)], mathConstantTypeNames[tok_constant(token)]);
         break;
       case TT_OPERATOR:
-        printf("(%s)", operatorTypeNames[token->as.operator]);
+        printf("(%s)", operatorTypeNames[tok_operator(token)]);
         break;
       case TT_PAREN:
-        printf("(%s)", parenTypeNames[token->as.paren]);
+        printf("(%s)", parenTypeNames[tok_paren(token)]);
         break;
       case TT_FUNCTION:
-        printf("(%s, %s)", functionTypeIdentifiers[token->as.function], functionTypeNames[token->as.function]);
+        printf("(%s, %s)", functionTypeIdentifiers[tok_function(token)], functionTypeNames[tok_function(token)]);
         break;
       case TT_LITERAL:
-        printf("(%s)", commonLiteralTypeNames[token->as.literal]);
+        printf("(%s)", commonLiteralTypeNames[tok_literal(token)]);
+        break;
+      case TT_VARIABLE:
+        printf("(%s)", lexer->variables->items[tok_variable(token)]);
         break;
       case TT_COUNT:
       default:
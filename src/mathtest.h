@@ -0,0 +1,158 @@
+#ifndef _MATHTEST_H_
+#define _MATHTEST_H_
+
+#include "simdmath.h"
+
+
+// Every range gets sampled on an evenly spaced grid of this many points.
+#define MATHTEST_SAMPLES (1u << 20)
+// Values per call of the vectorized functions.
+#define MATHTEST_CHUNK 1024
+
+static_assert(MATHTEST_SAMPLES % MATHTEST_CHUNK == 0, "The samples must be a multiple of the chunk size");
+static_assert(MATHTEST_CHUNK % SIMD_VECTOR_SIZE == 0, "The chunk size must be a multiple of the vector size");
+
+
+typedef struct {
+  e_node_func_type func;
+  // Maximum allowed error in ULP compared to libm.
+  uint64_t maxUlp;
+  // The ranges which get sampled.
+  double ranges[4][2];
+  size_t rangeCount;
+} mathtest_case_t;
+
+static const mathtest_case_t mathtestCases[] = {
+  { NF_SQRT,  0, { {0, 4}, {0, 1e300}, {-1, 1} }, 3 },
+  { NF_EXP,   1, { {-1, 1}, {-708, 708}, {-750, 750} }, 3 },
+  { NF_SIN,   1, { {-7, 7}, {-1e-6, 1e-6}, {-1e5, 1e5}, {-2e6, 2e6} }, 4 },
+  { NF_ASIN,  2, { {-1, 1}, {-0.01, 0.01}, {-1.5, 1.5} }, 3 },
+  { NF_SINH,  2, { {-1, 1}, {-30, 30}, {-720, 720} }, 3 },
+  { NF_COS,   1, { {-7, 7}, {-1e-6, 1e-6}, {-1e5, 1e5}, {-2e6, 2e6} }, 4 },
+  { NF_ACOS,  2, { {-1, 1}, {0.99, 1}, {-1.5, 1.5} }, 3 },
+  { NF_COSH,  2, { {-1, 1}, {-30, 30}, {-720, 720} }, 3 },
+  { NF_TAN,   3, { {-7, 7}, {-1e-6, 1e-6}, {-1e5, 1e5}, {-2e6, 2e6} }, 4 },
+  { NF_ATAN,  1, { {-3, 3}, {-1e6, 1e6}, {-1e300, 1e300} }, 3 },
+  { NF_TANH,  2, { {-1, 1}, {-0.01, 0.01}, {-25, 25} }, 3 },
+  { NF_LN,    1, { {0, 2}, {0.5, 1.5}, {0, 1e300}, {0, 1e-300} }, 4 },
+  { NF_LOG10, 2, { {0, 2}, {0.5, 1.5}, {0, 1e300}, {0, 1e-300} }, 4 },
+  { NF_RECIP, 0, { {-2, 2}, {-1e300, 1e300}, {-1e-300, 1e-300} }, 3 },
+};
+
+static_assert(ARRAY_LEN(mathtestCases) == NF_COUNT, "Every function must have a test case");
+
+// Every function also gets checked with these values.
+static const double mathtestSpecialValues[] = {
+  0.0, -0.0, 1.0, -1.0, 0.5, -0.5, 2.0, 10.0, 100.0, 1000.0, 1e-10,
+  M_PI, -M_PI, M_PI_2, -M_PI_2, M_PI_4, M_E,
+  DBL_MIN, -DBL_MIN, DBL_TRUE_MIN, DBL_MAX, -DBL_MAX,
+  INFINITY, -INFINITY, NAN,
+  708.0, -708.0, 709.7, 710.0, 0x1p20, -0x1p20, 0x1p21,
+};
+
+
+// Maps the bits of a double to an integer which is ordered like the doubles, so the distance of
+// two of them is the amount of representable doubles between them.
+static int64_t mathtest_ordered_bits(double value)
+{
+  int64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits < 0 ? INT64_MIN - bits : bits;
+}
+
+// Returns the distance in ULP, 0 if both are NAN and UINT64_MAX if only one of them is NAN.
+static uint64_t mathtest_ulp_distance(double a, double b)
+{
+  if (isnan(a) || isnan(b))
+    return isnan(a) && isnan(b) ? 0 : UINT64_MAX;
+
+  int64_t ia = mathtest_ordered_bits(a);
+  int64_t ib = mathtest_ordered_bits(b);
+  return ia > ib ? (uint64_t) ia - (uint64_t) ib : (uint64_t) ib - (uint64_t) ia;
+}
+
+
+typedef struct {
+  uint64_t maxUlp;
+  double worstInput;
+  double worstResult;
+  double worstExpected;
+} mathtest_result_t;
+
+// Runs the vectorized function on 'count' values and compares every result with libm.
+static void mathtest_check(e_node_func_type func, simd_vector_t* chunk, size_t count, mathtest_result_t* result)
+{
+  double* values = (double*) chunk;
+  double inputs[MATHTEST_CHUNK];
+  memcpy(inputs, values, count * sizeof(double));
+
+  simdKernelImpls[func](values, count);
+
+  for (size_t i = 0; i < count; ++i)
+  {
+    double expected = nodeFunctionImpls[func](inputs[i]);
+    uint64_t ulp = mathtest_ulp_distance(values[i], expected);
+
+    if (ulp > result->maxUlp)
+    {
+      result->maxUlp = ulp;
+      result->worstInput = inputs[i];
+      result->worstResult = values[i];
+      result->worstExpected = expected;
+    }
+  }
+}
+
+
+// Compares every vectorized function with libm and returns false if one of them exceeds its
+// error bound.
+bool run_math_tests()
+{
+  static simd_vector_t chunk[MATHTEST_CHUNK / SIMD_VECTOR_SIZE];
+  double* values = (double*) chunk;
+  bool success = true;
+
+  printf("Math testing (%u lanes per vector, %u samples per range):\n\n", SIMD_VECTOR_SIZE, MATHTEST_SAMPLES);
+
+  for (size_t c = 0; c < ARRAY_LEN(mathtestCases); ++c)
+  {
+    const mathtest_case_t* test = &mathtestCases[c];
+    const char* name = nodeFunctionTypeNames[test->func];
+
+    mathtest_result_t result = {0};
+
+    // The special values, padded to whole vectors with zeros.
+    size_t specialCount = ARRAY_LEN(mathtestSpecialValues);
+    size_t paddedCount = (specialCount + SIMD_VECTOR_SIZE - 1) / SIMD_VECTOR_SIZE * SIMD_VECTOR_SIZE;
+    memset(values, 0, paddedCount * sizeof(double));
+    memcpy(values, mathtestSpecialValues, specialCount * sizeof(double));
+    mathtest_check(test->func, chunk, paddedCount, &result);
+
+    for (size_t r = 0; r < test->rangeCount; ++r)
+    {
+      double lo = test->ranges[r][0];
+      double hi = test->ranges[r][1];
+
+      for (size_t base = 0; base < MATHTEST_SAMPLES; base += MATHTEST_CHUNK)
+      {
+        for (size_t i = 0; i < MATHTEST_CHUNK; ++i)
+          values[i] = lo + (hi - lo) * ((double) (base + i) / (double) (MATHTEST_SAMPLES - 1));
+
+        mathtest_check(test->func, chunk, MATHTEST_CHUNK, &result);
+      }
+    }
+
+    bool passed = result.maxUlp <= test->maxUlp;
+    success &= passed;
+
+    printf("  %-6s max %llu ulp (bound %llu) %s\n", name, (unsigned long long) result.maxUlp, (unsigned long long) test->maxUlp, passed ? "OK" : "FAILED");
+
+    if (!passed)
+      printf("    worst input %.17g: %.17g instead of %.17g\n", result.worstInput, result.worstResult, result.worstExpected);
+  }
+
+  printf("\n%s\n", success ? "All math tests passed." : "ERROR: Some math tests failed!");
+  return success;
+}
+
+#endif // _MATHTEST_H_
@@ -0,0 +1,96 @@
+#ifndef _NODEMAP_H_
+#define _NODEMAP_H_
+
+#include <stdint.h>
+
+#include "parser.h"
+
+
+// Maps nodes by their address to a value. After the optimizer merged equal sub trees the AST is a
+// DAG, so the same node can be reached from multiple parents. The compiler and the node pool use
+// this map to handle every node only once.
+//
+// The map uses open addressing with linear probing and grows when it is half full. All memory
+// gets allocated from the arena.
+typedef struct {
+  const node_t* node;
+  uint32_t value;
+} node_map_entry_t;
+
+typedef struct {
+  // Entries with a NULL node are empty.
+  node_map_entry_t* items;
+  size_t capacity;
+  size_t count;
+} node_map_t;
+
+
+static inline size_t node_map_hash(const node_t* node)
+{
+  // The low bits are always zero because of the alignment.
+  uint64_t h = (uint64_t) (uintptr_t) node >> 3;
+  return (size_t) (h * 0x9E3779B97F4A7C15ull >> 17);
+}
+
+// Returns the entry of the node or the empty entry where it would be inserted.
+static node_map_entry_t* node_map_slot(const node_map_t* map, const node_t* node)
+{
+  size_t mask = map->capacity - 1;
+  size_t i = node_map_hash(node) & mask;
+
+  while (map->items[i].node && map->items[i].node != node)
+    i = (i + 1) & mask;
+
+  return &map->items[i];
+}
+
+static void node_map_grow(arena_t* arena, node_map_t* map)
+{
+  node_map_t grown = { .capacity = map->capacity == 0 ? ARENA_DA_INIT_CAP : map->capacity * 2, .count = map->count };
+  grown.items = arena_alloc(arena, grown.capacity * sizeof(node_map_entry_t));
+  memset(grown.items, 0, grown.capacity * sizeof(node_map_entry_t));
+
+  for (size_t i = 0; i < map->capacity; ++i)
+    if (map->items[i].node)
+      *node_map_slot(&grown, map->items[i].node) = map->items[i];
+
+  *map = grown;
+}
+
+
+// Returns the value of the node or NULL if the node is not in the map.
+uint32_t* node_map_get(const node_map_t* map, const node_t* node)
+{
+  ASSERT_NULL(map);
+  ASSERT_NULL(node);
+
+  if (map->count == 0)
+    return NULL;
+
+  node_map_entry_t* entry = node_map_slot(map, node);
+  return entry->node ? &entry->value : NULL;
+}
+
+// Sets the value of the node and returns it, so it can be changed later.
+uint32_t* node_map_put(arena_t* arena, node_map_t* map, const node_t* node, uint32_t value)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(map);
+  ASSERT_NULL(node);
+
+  if ((map->count + 1) * 2 > map->capacity)
+    node_map_grow(arena, map);
+
+  node_map_entry_t* entry = node_map_slot(map, node);
+
+  if (!entry->node)
+  {
+    entry->node = node;
+    map->count++;
+  }
+
+  entry->value = value;
+  return &entry->value;
+}
+
+#endif // _NODEMAP_H_
@@ -0,0 +1,1184 @@
+#ifndef _OPTIMIZER_H_
+#define _OPTIMIZER_H_
+
+#include "nodemap.h"
+
+
+// The optimizer rewrites the parsed AST before it gets compiled. Every pass works with an explicit
+// stack, so deep trees can't overflow the C stack, and keeps the cursors, so errors still point
+// to the same place in the input.
+typedef enum {
+  OPT_FOLD_CONSTANTS = (1u << 0),
+  // Merges equal sub trees, so the AST becomes a DAG.
+  OPT_MERGE_COMMON   = (1u << 1),
+  // Rebalances long chains of additions or multiplications.
+  OPT_REASSOCIATE    = (1u << 2),
+  // Replaces 'x^1', whose result stays the same apart from the sign of a NAN.
+  OPT_REDUCE_POW     = (1u << 3),
+  // Replaces every other small integer exponent and 'x^0.5'.
+  OPT_FAST_POW       = (1u << 4),
+  // Fuses a multiplication and the following addition or subtraction into a single 'fma'.
+  OPT_CONTRACT_FMA   = (1u << 5),
+  // Rewrites polynomials in a single variable in Horner form.
+  OPT_POLYNOMIAL     = (1u << 6),
+  // Uses Estrin's scheme instead of Horner form for 'OPT_POLYNOMIAL'. It needs more operations, but
+  // they are independent, which pays off for long polynomials in the jit. The batch evaluation
+  // selects the form with 'batch_optimizer_flags'.
+  OPT_POLY_ESTRIN    = (1u << 7),
+} e_optimizer_flags;
+
+// The default passes keep every result bit identical to the unoptimized AST (strict IEEE). Only the
+// sign and payload of a NAN are out of scope, because 'pow' of libm doesn't keep them either.
+#define OPT_DEFAULT (OPT_FOLD_CONSTANTS | OPT_MERGE_COMMON | OPT_REDUCE_POW)
+
+// These passes may change the last bits of a result, so they are only used when selected.
+#define OPT_VALUE_CHANGING (OPT_REASSOCIATE | OPT_FAST_POW | OPT_CONTRACT_FMA | OPT_POLYNOMIAL)
+#define OPT_FAST_MATH      (OPT_DEFAULT | OPT_VALUE_CHANGING)
+
+// Chains with fewer operands are left alone, because balancing them gains nothing.
+#define OPTIMIZER_MIN_CHAIN_OPERANDS 4
+
+// Larger integer exponents still use 'pow'. 'x^32' needs 5 multiplications.
+#define OPTIMIZER_MAX_POW_EXPONENT 32
+
+// Sub trees with a higher degree are not treated as polynomials.
+#define OPTIMIZER_MAX_POLYNOMIAL_DEGREE 32
+
+
+typedef struct {
+  size_t foldedNodes;
+  size_t mergedNodes;
+  size_t rebalancedChains;
+  size_t reducedPowers;
+  size_t contractedNodes;
+  size_t rewrittenPolynomials;
+} optimizer_stats_t;
+
+
+// Frames for the explicit post-order walk.
+typedef struct {
+  node_t* node;
+  bool expanded;
+} optimizer_frame_t;
+
+typedef struct {
+  optimizer_frame_t* items;
+  size_t capacity;
+  size_t count;
+} optimizer_stack_t;
+
+#define optimizer_stack_push(a, stack, n) arena_da_append((a), (stack), ((optimizer_frame_t) { .node = (n), .expanded = false }))
+
+
+// Turns the node into a constant. The cursor stays, so a folded divisor still reports a division
+// by zero at the same cursor.
+static void fold_to_constant(node_t* node, double value, optimizer_stats_t* stats)
+{
+  node->type = NT_CONSTANT;
+  node->as.constant = value;
+  stats->foldedNodes++;
+}
+
+// Folds the node if all of its children are constants. Divisions by zero stay, so they still
+// fail when evaluating like before.
+static void fold_node(node_t* node, optimizer_stats_t* stats)
+{
+  switch (node->type)
+  {
+    case NT_BINOP:
+    {
+      const node_t* lhs = node->as.binop.lhs;
+      const node_t* rhs = node->as.binop.rhs;
+
+      if (lhs->type != NT_CONSTANT || rhs->type != NT_CONSTANT)
+        return;
+
+      double a = lhs->as.constant;
+      double b = rhs->as.constant;
+
+      switch (node->as.binop.type)
+      {
+        case NO_ADD: fold_to_constant(node, a + b, stats); return;
+        case NO_SUB: fold_to_constant(node, a - b, stats); return;
+        case NO_MUL: fold_to_constant(node, a * b, stats); return;
+        case NO_DIV:
+          if (b != 0)
+            fold_to_constant(node, a / b, stats);
+          return;
+        case NO_POW: fold_to_constant(node, pow(a, b), stats); return;
+        case NO_COUNT:
+        default:
+          UNREACHABLE("Invalid binop-node-type!");
+      }
+    }
+    case NT_FUNCTION:
+    {
+      if (node->as.func.type >= NF_COUNT)
+        UNREACHABLE("Invalid function-node-type!");
+
+      if (node->as.func.arg->type == NT_CONSTANT)
+        fold_to_constant(node, nodeFunctionImpls[node->as.func.type](node->as.func.arg->as.constant), stats);
+      return;
+    }
+    case NT_PAREN:
+    {
+      if (node->as.paren.arg->type == NT_CONSTANT)
+        fold_to_constant(node, node->as.paren.arg->as.constant, stats);
+      return;
+    }
+    case NT_FMA:
+    {
+      const node_t* a = node->as.fma.product->as.binop.lhs;
+      const node_t* b = node->as.fma.product->as.binop.rhs;
+      const node_t* c = node->as.fma.addend;
+
+      if (a->type == NT_CONSTANT && b->type == NT_CONSTANT && c->type == NT_CONSTANT)
+        fold_to_constant(node, fma_apply(node->as.fma.flags, a->as.constant, b->as.constant, c->as.constant), stats);
+      return;
+    }
+    case NT_CONSTANT:
+    case NT_VARIABLE:
+      return;
+    case NT_COUNT:
+    default:
+      UNREACHABLE("Invalid node-type!");
+  }
+}
+
+// Replaces every sub tree which only has constant leaves with a single constant. The tree gets
+// changed in place.
+void optimizer_fold_constants(arena_t* arena, node_t* root, optimizer_stats_t* stats)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(root);
+  ASSERT_NULL(stats);
+
+  optimizer_stack_t stack = {0};
+  optimizer_stack_push(arena, &stack, root);
+
+  while (stack.count > 0)
+  {
+    optimizer_frame_t* frame = &stack.items[stack.count - 1];
+    node_t* node = frame->node;
+
+    if (frame->expanded || node_is_leaf(node))
+    {
+      fold_node(node, stats);
+      stack.count--;
+      continue;
+    }
+
+    frame->expanded = true;
+
+    switch (node->type)
+    {
+      case NT_BINOP:
+        optimizer_stack_push(arena, &stack, node->as.binop.rhs);
+        optimizer_stack_push(arena, &stack, node->as.binop.lhs);
+        break;
+      case NT_FUNCTION:
+        optimizer_stack_push(arena, &stack, node->as.func.arg);
+        break;
+      case NT_PAREN:
+        optimizer_stack_push(arena, &stack, node->as.paren.arg);
+        break;
+      case NT_FMA:
+        optimizer_stack_push(arena, &stack, node->as.fma.addend);
+        optimizer_stack_push(arena, &stack, node->as.fma.product->as.binop.rhs);
+        optimizer_stack_push(arena, &stack, node->as.fma.product->as.binop.lhs);
+        break;
+      case NT_CONSTANT:
+      case NT_VARIABLE:
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+}
+
+
+typedef struct {
+  node_t** items;
+  size_t capacity;
+  size_t count;
+} optimizer_node_list_t;
+
+#define optimizer_is_chain_node(node, op) ((node)->type == NT_BINOP && (node)->as.binop.type == (op))
+
+// Collects the operands of the chain from left to right and all binops of the chain, starting with
+// the root. Parens end a chain, so an explicit grouping of the input stays.
+static void optimizer_collect_chain(arena_t* arena, node_t* root, optimizer_node_list_t* operands, optimizer_node_list_t* binops, optimizer_node_list_t* pending)
+{
+  e_node_binop_type op = root->as.binop.type;
+
+  operands->count = 0;
+  binops->count = 0;
+  pending->count = 0;
+  arena_da_append(arena, pending, root);
+
+  while (pending->count > 0)
+  {
+    node_t* node = pending->items[--pending->count];
+
+    if (!optimizer_is_chain_node(node, op))
+    {
+      arena_da_append(arena, operands, node);
+      continue;
+    }
+
+    arena_da_append(arena, binops, node);
+    arena_da_append(arena, pending, node->as.binop.rhs);
+    arena_da_append(arena, pending, node->as.binop.lhs);
+  }
+}
+
+// Rebuilds the chain as a balanced tree by combining neighbouring operands level by level. The
+// operands keep their order, so they still get evaluated from left to right. The binops of the
+// chain get reused and the root stays the root.
+static void optimizer_balance_chain(optimizer_node_list_t* operands, const optimizer_node_list_t* binops)
+{
+  size_t count = operands->count;
+  size_t nextBinop = 1;
+
+  while (count > 2)
+  {
+    size_t combined = 0;
+
+    for (size_t i = 0; i + 1 < count; i += 2)
+    {
+      node_t* binop = binops->items[nextBinop++];
+      binop->as.binop.lhs = operands->items[i];
+      binop->as.binop.rhs = operands->items[i + 1];
+      operands->items[combined++] = binop;
+    }
+
+    if (count % 2 == 1)
+      operands->items[combined++] = operands->items[count - 1];
+
+    count = combined;
+  }
+
+  assert(nextBinop == binops->count && "Every binop of the chain must be used!");
+
+  binops->items[0]->as.binop.lhs = operands->items[0];
+  binops->items[0]->as.binop.rhs = operands->items[1];
+}
+
+// Turns long chains like 'a + b + c + d' into balanced trees like '(a + b) + (c + d)'. The
+// independent operations can overlap in the cpu and the depth of the tree drops from O(n) to
+// O(log n). Floating point addition and multiplication are not associative, so the result may
+// change in the last bits.
+void optimizer_reassociate(arena_t* arena, node_t* root, optimizer_stats_t* stats)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(root);
+  ASSERT_NULL(stats);
+
+  optimizer_node_list_t stack = {0};
+  optimizer_node_list_t operands = {0};
+  optimizer_node_list_t binops = {0};
+  optimizer_node_list_t pending = {0};
+
+  arena_da_append(arena, &stack, root);
+
+  // Pre-order, so every chain gets found from its root.
+  while (stack.count > 0)
+  {
+    node_t* node = stack.items[--stack.count];
+
+    switch (node->type)
+    {
+      case NT_BINOP:
+      {
+        e_node_binop_type op = node->as.binop.type;
+
+        if (op != NO_ADD && op != NO_MUL)
+        {
+          arena_da_append(arena, &stack, node->as.binop.rhs);
+          arena_da_append(arena, &stack, node->as.binop.lhs);
+          break;
+        }
+
+        optimizer_collect_chain(arena, node, &operands, &binops, &pending);
+
+        // Only the operands can contain further chains. They get pushed before balancing, because
+        // balancing overwrites the list.
+        for (size_t i = 0; i < operands.count; ++i)
+          if (!node_is_leaf(operands.items[i]))
+            arena_da_append(arena, &stack, operands.items[i]);
+
+        if (operands.count >= OPTIMIZER_MIN_CHAIN_OPERANDS)
+        {
+          optimizer_balance_chain(&operands, &binops);
+          stats->rebalancedChains++;
+        }
+        break;
+      }
+      case NT_FUNCTION:
+        arena_da_append(arena, &stack, node->as.func.arg);
+        break;
+      case NT_PAREN:
+        arena_da_append(arena, &stack, node->as.paren.arg);
+        break;
+      case NT_FMA:
+        arena_da_append(arena, &stack, node->as.fma.addend);
+        arena_da_append(arena, &stack, node->as.fma.product->as.binop.rhs);
+        arena_da_append(arena, &stack, node->as.fma.product->as.binop.lhs);
+        break;
+      case NT_CONSTANT:
+      case NT_VARIABLE:
+        break;
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+}
+
+
+// A polynomial in a single variable. 'coefficients[k]' belongs to 'x^k' and the coefficient of the
+// degree is never zero, except for the constant zero.
+typedef struct {
+  double* coefficients;
+  size_t degree;
+  // Any variable node of the polynomial, NULL if it is a constant.
+  const node_t* variable;
+  // The operations needed to evaluate the sub tree as written, with the powers turned into
+  // multiplications by squaring.
+  size_t cost;
+} optimizer_polynomial_t;
+
+typedef struct {
+  optimizer_polynomial_t* items;
+  size_t capacity;
+  size_t count;
+} optimizer_polynomial_list_t;
+
+// The value of the node map for sub trees which are no polynomials.
+#define OPTIMIZER_NO_POLYNOMIAL UINT32_MAX
+
+// The multiplications 'x^exponent' needs with exponentiation by squaring.
+static size_t optimizer_power_cost(uint32_t exponent)
+{
+  size_t cost = 0;
+
+  for (uint32_t e = exponent; e > 1; e >>= 1)
+    cost += (e & 1) ? 2 : 1;
+
+  return cost > 0 ? cost : 1;
+}
+
+static optimizer_polynomial_t optimizer_polynomial_new(arena_t* arena, size_t degree, const node_t* variable, size_t cost)
+{
+  optimizer_polynomial_t poly = { .degree = degree, .variable = variable, .cost = cost };
+  poly.coefficients = (double*) arena_alloc(arena, (degree + 1) * sizeof(double));
+  memset(poly.coefficients, 0, (degree + 1) * sizeof(double));
+  return poly;
+}
+
+// Drops the leading zero coefficients after they cancelled out.
+static void optimizer_polynomial_trim(optimizer_polynomial_t* poly)
+{
+  while (poly->degree > 0 && poly->coefficients[poly->degree] == 0)
+    poly->degree--;
+}
+
+static bool optimizer_polynomial_add(arena_t* arena, const optimizer_polynomial_t* a, const optimizer_polynomial_t* b, bool isSub, optimizer_polynomial_t* result)
+{
+  size_t degree = a->degree > b->degree ? a->degree : b->degree;
+  *result = optimizer_polynomial_new(arena, degree, a->variable ? a->variable : b->variable, a->cost + b->cost + 1);
+
+  for (size_t k = 0; k <= a->degree; ++k)
+    result->coefficients[k] = a->coefficients[k];
+
+  for (size_t k = 0; k <= b->degree; ++k)
+    result->coefficients[k] += isSub ? -b->coefficients[k] : b->coefficients[k];
+
+  optimizer_polynomial_trim(result);
+  return true;
+}
+
+static bool optimizer_polynomial_mul(arena_t* arena, const optimizer_polynomial_t* a, const optimizer_polynomial_t* b, size_t cost, optimizer_polynomial_t* result)
+{
+  if (a->degree + b->degree > OPTIMIZER_MAX_POLYNOMIAL_DEGREE)
+    return false;
+
+  *result = optimizer_polynomial_new(arena, a->degree + b->degree, a->variable ? a->variable : b->variable, cost);
+
+  for (size_t i = 0; i <= a->degree; ++i)
+    for (size_t j = 0; j <= b->degree; ++j)
+      result->coefficients[i + j] += a->coefficients[i] * b->coefficients[j];
+
+  optimizer_polynomial_trim(result);
+  return true;
+}
+
+static bool optimizer_polynomial_pow(arena_t* arena, const optimizer_polynomial_t* base, double exponent, optimizer_polynomial_t* result)
+{
+  if (exponent < 0 || exponent > OPTIMIZER_MAX_POLYNOMIAL_DEGREE || exponent != (double) (int) exponent)
+    return false;
+
+  uint32_t e = (uint32_t) exponent;
+  size_t cost = base->cost + optimizer_power_cost(e);
+
+  *result = optimizer_polynomial_new(arena, 0, base->variable, cost);
+  result->coefficients[0] = 1;
+
+  for (uint32_t i = 0; i < e; ++i)
+  {
+    optimizer_polynomial_t power = *result;
+
+    if (!optimizer_polynomial_mul(arena, &power, base, cost, result))
+      return false;
+  }
+
+  return true;
+}
+
+// Computes the polynomial of the node from the polynomials of its children. Returns false if the
+// node is no polynomial in a single variable. Divisions are never part of a polynomial, so a
+// rewritten polynomial can't fail.
+static bool optimizer_polynomial_of(arena_t* arena, const node_t* node, const optimizer_polynomial_list_t* polys, const node_map_t* indices, optimizer_polynomial_t* result)
+{
+  switch (node->type)
+  {
+    case NT_CONSTANT:
+      // Infinities and NAN would not stay the same after rewriting.
+      if (!isfinite(node->as.constant))
+        return false;
+
+      *result = optimizer_polynomial_new(arena, 0, NULL, 0);
+      result->coefficients[0] = node->as.constant;
+      return true;
+    case NT_VARIABLE:
+      *result = optimizer_polynomial_new(arena, 1, node, 0);
+      result->coefficients[1] = 1;
+      return true;
+    case NT_PAREN:
+    {
+      uint32_t arg = *node_map_get(indices, node->as.paren.arg);
+
+      if (arg == OPTIMIZER_NO_POLYNOMIAL)
+        return false;
+
+      *result = polys->items[arg];
+      return true;
+    }
+    case NT_BINOP:
+    {
+      uint32_t lhs = *node_map_get(indices, node->as.binop.lhs);
+      uint32_t rhs = *node_map_get(indices, node->as.binop.rhs);
+
+      if (lhs == OPTIMIZER_NO_POLYNOMIAL || rhs == OPTIMIZER_NO_POLYNOMIAL)
+        return false;
+
+      const optimizer_polynomial_t* a = &polys->items[lhs];
+      const optimizer_polynomial_t* b = &polys->items[rhs];
+
+      if (a->variable && b->variable && a->variable->as.variable.index != b->variable->as.variable.index)
+        return false;
+
+      switch (node->as.binop.type)
+      {
+        case NO_ADD:
+        case NO_SUB:
+          return optimizer_polynomial_add(arena, a, b, node->as.binop.type == NO_SUB, result);
+        case NO_MUL:
+          return optimizer_polynomial_mul(arena, a, b, a->cost + b->cost + 1, result);
+        case NO_POW:
+          if (node->as.binop.rhs->type != NT_CONSTANT)
+            return false;
+          return optimizer_polynomial_pow(arena, a, node->as.binop.rhs->as.constant, result);
+        case NO_DIV:
+          return false;
+        case NO_COUNT:
+        default:
+          UNREACHABLE("Invalid binop-node-type!");
+      }
+    }
+    case NT_FUNCTION:
+    case NT_FMA:
+      return false;
+    case NT_COUNT:
+    default:
+      UNREACHABLE("Invalid node-type!");
+  }
+}
+
+// Returns 'hi * power + lo' where NULL stands for zero. Multiplying by one gets skipped.
+static node_t* optimizer_polynomial_combine(arena_t* arena, node_t* lo, node_t* hi, node_t* power, size_t cursor, size_t* cost)
+{
+  if (!hi)
+    return lo;
+
+  if (hi->type != NT_CONSTANT || hi->as.constant != 1)
+  {
+    hi = node_binop(arena, cursor, NO_MUL, hi, power);
+    (*cost)++;
+  }
+  else
+    hi = power;
+
+  if (!lo)
+    return hi;
+
+  (*cost)++;
+  return node_binop(arena, cursor, NO_ADD, hi, lo);
+}
+
+// '((c[n] * x + c[n-1]) * x + ...) * x + c[0]', one multiplication and addition per degree.
+static node_t* optimizer_build_horner(arena_t* arena, const optimizer_polynomial_t* poly, node_t* x, size_t cursor, size_t* cost)
+{
+  node_t* acc = node_constant(arena, cursor, poly->coefficients[poly->degree]);
+
+  for (size_t k = poly->degree; k-- > 0;)
+  {
+    double c = poly->coefficients[k];
+    acc = optimizer_polynomial_combine(arena, c != 0 ? node_constant(arena, cursor, c) : NULL, acc, x, cursor, cost);
+  }
+
+  return acc;
+}
+
+// Estrin's scheme: Neighbouring coefficients get combined to 'c[k] + c[k+1] * x', then neighbouring
+// pairs with 'x^2', then with 'x^4' and so on. Every level only depends on the one before, so the
+// depth is O(log n). The powers get shared, so the result is a DAG.
+static node_t* optimizer_build_estrin(arena_t* arena, const optimizer_polynomial_t* poly, node_t* x, size_t cursor, size_t* cost)
+{
+  size_t count = poly->degree + 1;
+  node_t** terms = (node_t**) arena_alloc(arena, count * sizeof(node_t*));
+
+  for (size_t k = 0; k < count; ++k)
+    terms[k] = poly->coefficients[k] != 0 ? node_constant(arena, cursor, poly->coefficients[k]) : NULL;
+
+  node_t* power = x;
+
+  while (count > 1)
+  {
+    size_t combined = 0;
+
+    for (size_t k = 0; k + 1 < count; k += 2)
+      terms[combined++] = optimizer_polynomial_combine(arena, terms[k], terms[k + 1], power, cursor, cost);
+
+    if (count % 2 == 1)
+      terms[combined++] = terms[count - 1];
+
+    count = combined;
+
+    if (count > 1)
+    {
+      power = node_binop(arena, cursor, NO_MUL, power, power);
+      (*cost)++;
+    }
+  }
+
+  // The zero polynomial has no term.
+  return terms[0] ? terms[0] : node_constant(arena, cursor, 0);
+}
+
+// Rewrites every largest sub tree which is a polynomial in a single variable, like
+// '3 * x^3 + x * x - 2 * x + 1', into Horner form '((3 * x + 1) * x - 2) * x + 1' or with
+// 'OPT_POLY_ESTRIN' into Estrin's scheme. Written out, every term recomputes its power. A sub
+// tree only gets replaced if the new form needs fewer operations. Constants are folded before, so
+// the polynomials have no constant sub trees.
+//
+// Products get expanded and the terms merged into new coefficients, so the rounding changes
+// completely: Near a root, like '(x + 0.1)^2 - 0.01' for small x, the result may lose all of its
+// digits. The variable is assumed to be finite. Terms which cancel are dropped, so 'x - x' becomes
+// '0' and 'x^2 - x' becomes '(x - 1) * x', although both are NAN as written for an infinite x.
+void optimizer_rewrite_polynomials(arena_t* arena, node_t* root, e_optimizer_flags flags, optimizer_stats_t* stats)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(root);
+  ASSERT_NULL(stats);
+
+  optimizer_polynomial_list_t polys = {0};
+  node_map_t indices = {0};
+  optimizer_stack_t stack = {0};
+
+  // Post-order, so the polynomials of the children are known.
+  optimizer_stack_push(arena, &stack, root);
+
+  while (stack.count > 0)
+  {
+    optimizer_frame_t* frame = &stack.items[stack.count - 1];
+    node_t* node = frame->node;
+
+    if (frame->expanded || node_is_leaf(node))
+    {
+      optimizer_polynomial_t poly;
+      uint32_t index = OPTIMIZER_NO_POLYNOMIAL;
+
+      if (optimizer_polynomial_of(arena, node, &polys, &indices, &poly))
+      {
+        index = (uint32_t) polys.count;
+        arena_da_append(arena, &polys, poly);
+      }
+
+      node_map_put(arena, &indices, node, index);
+      stack.count--;
+      continue;
+    }
+
+    frame->expanded = true;
+
+    switch (node->type)
+    {
+      case NT_BINOP:
+        optimizer_stack_push(arena, &stack, node->as.binop.rhs);
+        optimizer_stack_push(arena, &stack, node->as.binop.lhs);
+        break;
+      case NT_FUNCTION:
+        optimizer_stack_push(arena, &stack, node->as.func.arg);
+        break;
+      case NT_PAREN:
+        optimizer_stack_push(arena, &stack, node->as.paren.arg);
+        break;
+      case NT_FMA:
+        optimizer_stack_push(arena, &stack, node->as.fma.addend);
+        optimizer_stack_push(arena, &stack, node->as.fma.product->as.binop.rhs);
+        optimizer_stack_push(arena, &stack, node->as.fma.product->as.binop.lhs);
+        break;
+      case NT_CONSTANT:
+      case NT_VARIABLE:
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+
+  // Pre-order, so only the largest polynomials get rewritten.
+  optimizer_node_list_t pending = {0};
+  arena_da_append(arena, &pending, root);
+
+  while (pending.count > 0)
+  {
+    node_t* node = pending.items[--pending.count];
+    uint32_t index = *node_map_get(&indices, node);
+
+    if (index != OPTIMIZER_NO_POLYNOMIAL)
+    {
+      const optimizer_polynomial_t* poly = &polys.items[index];
+
+      if (!poly->variable)
+        continue;
+
+      // The variable node is a leaf, so it can be shared by all uses.
+      node_t* x = (node_t*) poly->variable;
+      size_t cost = 0;
+      node_t* rewritten = is_bit_set(flags, OPT_POLY_ESTRIN)
+          ? optimizer_build_estrin(arena, poly, x, node->cursor, &cost)
+          : optimizer_build_horner(arena, poly, x, node->cursor, &cost);
+
+      if (cost < poly->cost)
+      {
+        size_t cursor = node->cursor;
+        *node = *rewritten;
+        node->cursor = cursor;
+        stats->rewrittenPolynomials++;
+      }
+      continue;
+    }
+
+    switch (node->type)
+    {
+      case NT_BINOP:
+        arena_da_append(arena, &pending, node->as.binop.rhs);
+        arena_da_append(arena, &pending, node->as.binop.lhs);
+        break;
+      case NT_FUNCTION:
+        arena_da_append(arena, &pending, node->as.func.arg);
+        break;
+      case NT_PAREN:
+        arena_da_append(arena, &pending, node->as.paren.arg);
+        break;
+      case NT_FMA:
+        arena_da_append(arena, &pending, node->as.fma.addend);
+        arena_da_append(arena, &pending, node->as.fma.product->as.binop.rhs);
+        arena_da_append(arena, &pending, node->as.fma.product->as.binop.lhs);
+        break;
+      case NT_CONSTANT:
+      case NT_VARIABLE:
+        break;
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+}
+
+
+// Builds 'base^exponent' for exponents >= 1 with exponentiation by squaring. The base and the
+// squares get used by multiple nodes, so the tree becomes a DAG.
+static node_t* optimizer_build_power(arena_t* arena, node_t* base, uint32_t exponent, size_t cursor)
+{
+  node_t* result = NULL;
+  node_t* square = base;
+
+  while (true)
+  {
+    if (exponent & 1)
+      result = result ? node_binop(arena, cursor, NO_MUL, result, square) : square;
+
+    exponent >>= 1;
+
+    if (exponent == 0)
+      return result;
+
+    square = node_binop(arena, cursor, NO_MUL, square, square);
+  }
+}
+
+// Replaces the power with the given node. The cursor of the power stays.
+static void optimizer_replace_node(node_t* node, const node_t* replacement, optimizer_stats_t* stats)
+{
+  size_t cursor = node->cursor;
+  *node = *replacement;
+  node->cursor = cursor;
+  stats->reducedPowers++;
+}
+
+static void optimizer_reduce_power(arena_t* arena, node_t* node, e_optimizer_flags flags, optimizer_stats_t* stats)
+{
+  if (node->type != NT_BINOP || node->as.binop.type != NO_POW || node->as.binop.rhs->type != NT_CONSTANT)
+    return;
+
+  node_t* base = node->as.binop.lhs;
+  double exponent = node->as.binop.rhs->as.constant;
+  size_t cursor = node->cursor;
+
+  bool isInteger = fabs(exponent) <= OPTIMIZER_MAX_POW_EXPONENT && exponent == (double) (int) exponent;
+  bool isExact = exponent == 1;
+
+  if (isInteger && exponent != 0 && (isExact || is_bit_set(flags, OPT_FAST_POW)))
+  {
+    uint32_t magnitude = (uint32_t) fabs(exponent);
+    node_t* power = optimizer_build_power(arena, base, magnitude, cursor);
+
+    optimizer_replace_node(node, exponent < 0 ? node_func(arena, cursor, NF_RECIP, power) : power, stats);
+    return;
+  }
+
+  if ((exponent == 0.5 || exponent == -0.5) && is_bit_set(flags, OPT_FAST_POW))
+  {
+    node_t* root = node_func(arena, cursor, NF_SQRT, base);
+
+    optimizer_replace_node(node, exponent < 0 ? node_func(arena, cursor, NF_RECIP, root) : root, stats);
+  }
+}
+
+// Strength reduction for powers with a constant exponent: Small integer exponents become
+// multiplications, negative ones the reciprocal of them and 'x^0.5' becomes 'sqrt(x)'.
+//
+// Only 'x^1' keeps the result. 'x * x' and '1 / x' are rounded once, but 'pow' of libm is not
+// correctly rounded and differs from them for a few inputs, so 'x^2' and 'x^-1' need 'OPT_FAST_POW'
+// like every other exponent. Like 'pow', the reciprocal of zero is infinity and no error.
+//
+// The base gets shared, so afterwards the AST is a DAG.
+void optimizer_reduce_powers(arena_t* arena, node_t* root, e_optimizer_flags flags, optimizer_stats_t* stats)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(root);
+  ASSERT_NULL(stats);
+
+  optimizer_stack_t stack = {0};
+  optimizer_stack_push(arena, &stack, root);
+
+  while (stack.count > 0)
+  {
+    optimizer_frame_t* frame = &stack.items[stack.count - 1];
+    node_t* node = frame->node;
+
+    if (frame->expanded || node_is_leaf(node))
+    {
+      optimizer_reduce_power(arena, node, flags, stats);
+      stack.count--;
+      continue;
+    }
+
+    frame->expanded = true;
+
+    switch (node->type)
+    {
+      case NT_BINOP:
+        optimizer_stack_push(arena, &stack, node->as.binop.rhs);
+        optimizer_stack_push(arena, &stack, node->as.binop.lhs);
+        break;
+      case NT_FUNCTION:
+        optimizer_stack_push(arena, &stack, node->as.func.arg);
+        break;
+      case NT_PAREN:
+        optimizer_stack_push(arena, &stack, node->as.paren.arg);
+        break;
+      case NT_FMA:
+        optimizer_stack_push(arena, &stack, node->as.fma.addend);
+        optimizer_stack_push(arena, &stack, node->as.fma.product->as.binop.rhs);
+        optimizer_stack_push(arena, &stack, node->as.fma.product->as.binop.lhs);
+        break;
+      case NT_CONSTANT:
+      case NT_VARIABLE:
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+}
+
+
+#define optimizer_is_product(node) ((node)->type == NT_BINOP && (node)->as.binop.type == NO_MUL)
+
+// Turns the addition or subtraction into a fused multiply-add if one of its operands is a
+// multiplication. Parens are kept like for reassociating, so '(a * b) + c' stays as it is.
+static void optimizer_contract_node(node_t* node, optimizer_stats_t* stats)
+{
+  if (node->type != NT_BINOP || (node->as.binop.type != NO_ADD && node->as.binop.type != NO_SUB))
+    return;
+
+  node_t* lhs = node->as.binop.lhs;
+  node_t* rhs = node->as.binop.rhs;
+  bool isSub = node->as.binop.type == NO_SUB;
+
+  // 'a * b + c' and 'a * b - c'
+  if (optimizer_is_product(lhs))
+  {
+    node->type = NT_FMA;
+    node->as.fma = (node_fma_t) { .flags = isSub ? FMA_NEGATE_ADDEND : 0, .product = lhs, .addend = rhs };
+    stats->contractedNodes++;
+    return;
+  }
+
+  // 'c + a * b' and 'c - a * b'
+  if (optimizer_is_product(rhs))
+  {
+    node->type = NT_FMA;
+    node->as.fma = (node_fma_t) { .flags = FMA_ADDEND_FIRST | (isSub ? FMA_NEGATE_PRODUCT : 0), .product = rhs, .addend = lhs };
+    stats->contractedNodes++;
+  }
+}
+
+// Fuses every multiplication with the addition or subtraction it feeds into a single 'fma'. The
+// product does not get rounded before the addition, so the result is more accurate but not the
+// same as evaluating the expression as written. Polynomials need half as many instructions.
+//
+// The AST may already be a DAG, every shared node only gets walked once.
+void optimizer_contract_fma(arena_t* arena, node_t* root, optimizer_stats_t* stats)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(root);
+  ASSERT_NULL(stats);
+
+  optimizer_node_list_t stack = {0};
+  node_map_t seen = {0};
+
+  arena_da_append(arena, &stack, root);
+
+  while (stack.count > 0)
+  {
+    node_t* node = stack.items[--stack.count];
+
+    if (node_is_leaf(node) || node_map_get(&seen, node))
+      continue;
+
+    node_map_put(arena, &seen, node, 0);
+    optimizer_contract_node(node, stats);
+
+    switch (node->type)
+    {
+      case NT_BINOP:
+        arena_da_append(arena, &stack, node->as.binop.rhs);
+        arena_da_append(arena, &stack, node->as.binop.lhs);
+        break;
+      case NT_FUNCTION:
+        arena_da_append(arena, &stack, node->as.func.arg);
+        break;
+      case NT_PAREN:
+        arena_da_append(arena, &stack, node->as.paren.arg);
+        break;
+      case NT_FMA:
+        arena_da_append(arena, &stack, node->as.fma.addend);
+        arena_da_append(arena, &stack, node->as.fma.product->as.binop.rhs);
+        arena_da_append(arena, &stack, node->as.fma.product->as.binop.lhs);
+        break;
+      case NT_CONSTANT:
+      case NT_VARIABLE:
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+}
+
+// Hash-consing: Every sub tree gets looked up in a table of the already seen sub trees. The
+// children are merged before their parent, so two sub trees are equal if their roots have the
+// same type, the same op and the same child nodes. The cursors are not compared, so the first
+// occurrence stays and all later ones point to it.
+typedef struct {
+  // NULL entries are empty.
+  node_t** items;
+  size_t capacity;
+  size_t count;
+} optimizer_node_table_t;
+
+// Frames for the merge walk. They hold the pointer to the child in the parent, so a node can be
+// replaced by the equal node that was seen first.
+typedef struct {
+  node_t** slot;
+  bool expanded;
+  bool isDivisor;
+} optimizer_slot_frame_t;
+
+typedef struct {
+  optimizer_slot_frame_t* items;
+  size_t capacity;
+  size_t count;
+} optimizer_slot_stack_t;
+
+#define optimizer_slot_stack_push(a, stack, s, divisor) \
+    arena_da_append((a), (stack), ((optimizer_slot_frame_t) { .slot = (s), .expanded = false, .isDivisor = (divisor) }))
+
+
+static inline uint64_t optimizer_hash_combine(uint64_t hash, uint64_t value)
+{
+  hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+static uint64_t optimizer_node_hash(const node_t* node)
+{
+  uint64_t hash = optimizer_hash_combine(0, (uint64_t) node->type);
+
+  switch (node->type)
+  {
+    case NT_CONSTANT:
+    {
+      uint64_t bits;
+      memcpy(&bits, &node->as.constant, sizeof(bits));
+      return optimizer_hash_combine(hash, bits);
+    }
+    case NT_VARIABLE:
+      return optimizer_hash_combine(hash, (uint64_t) node->as.variable.index);
+    case NT_BINOP:
+      hash = optimizer_hash_combine(hash, (uint64_t) node->as.binop.type);
+      hash = optimizer_hash_combine(hash, (uint64_t) (uintptr_t) node->as.binop.lhs);
+      return optimizer_hash_combine(hash, (uint64_t) (uintptr_t) node->as.binop.rhs);
+    case NT_FUNCTION:
+      hash = optimizer_hash_combine(hash, (uint64_t) node->as.func.type);
+      return optimizer_hash_combine(hash, (uint64_t) (uintptr_t) node->as.func.arg);
+    case NT_PAREN:
+      return optimizer_hash_combine(hash, (uint64_t) (uintptr_t) node->as.paren.arg);
+    case NT_FMA:
+      hash = optimizer_hash_combine(hash, (uint64_t) node->as.fma.flags);
+      hash = optimizer_hash_combine(hash, (uint64_t) (uintptr_t) node->as.fma.product->as.binop.lhs);
+      hash = optimizer_hash_combine(hash, (uint64_t) (uintptr_t) node->as.fma.product->as.binop.rhs);
+      return optimizer_hash_combine(hash, (uint64_t) (uintptr_t) node->as.fma.addend);
+    case NT_COUNT:
+    default:
+      UNREACHABLE("Invalid node-type!");
+  }
+}
+
+// The children are already merged, so they only need to be compared by address. Constants are
+// compared bitwise, so '0' and '-0' stay different.
+static bool optimizer_node_equal(const node_t* a, const node_t* b)
+{
+  if (a->type != b->type)
+    return false;
+
+  switch (a->type)
+  {
+    case NT_CONSTANT:
+      return memcmp(&a->as.constant, &b->as.constant, sizeof(double)) == 0;
+    case NT_VARIABLE:
+      return a->as.variable.index == b->as.variable.index;
+    case NT_BINOP:
+      return a->as.binop.type == b->as.binop.type && a->as.binop.lhs == b->as.binop.lhs && a->as.binop.rhs == b->as.binop.rhs;
+    case NT_FUNCTION:
+      return a->as.func.type == b->as.func.type && a->as.func.arg == b->as.func.arg;
+    case NT_PAREN:
+      return a->as.paren.arg == b->as.paren.arg;
+    case NT_FMA:
+      return a->as.fma.flags == b->as.fma.flags && a->as.fma.addend == b->as.fma.addend &&
+             a->as.fma.product->as.binop.lhs == b->as.fma.product->as.binop.lhs &&
+             a->as.fma.product->as.binop.rhs == b->as.fma.product->as.binop.rhs;
+    case NT_COUNT:
+    default:
+      UNREACHABLE("Invalid node-type!");
+  }
+}
+
+static node_t** optimizer_node_table_slot(const optimizer_node_table_t* table, const node_t* node, uint64_t hash)
+{
+  size_t mask = table->capacity - 1;
+  size_t i = (size_t) hash & mask;
+
+  while (table->items[i] && !optimizer_node_equal(table->items[i], node))
+    i = (i + 1) & mask;
+
+  return &table->items[i];
+}
+
+static void optimizer_node_table_grow(arena_t* arena, optimizer_node_table_t* table)
+{
+  optimizer_node_table_t grown = { .capacity = table->capacity == 0 ? ARENA_DA_INIT_CAP : table->capacity * 2, .count = table->count };
+  grown.items = arena_alloc(arena, grown.capacity * sizeof(node_t*));
+  memset(grown.items, 0, grown.capacity * sizeof(node_t*));
+
+  for (size_t i = 0; i < table->capacity; ++i)
+    if (table->items[i])
+      *optimizer_node_table_slot(&grown, table->items[i], optimizer_node_hash(table->items[i])) = table->items[i];
+
+  *table = grown;
+}
+
+// Returns the first seen node which is equal to the given one. If there is none the node gets
+// added and returned.
+static node_t* optimizer_node_table_intern(arena_t* arena, optimizer_node_table_t* table, node_t* node)
+{
+  if ((table->count + 1) * 2 > table->capacity)
+    optimizer_node_table_grow(arena, table);
+
+  node_t** entry = optimizer_node_table_slot(table, node, optimizer_node_hash(node));
+
+  if (!*entry)
+  {
+    *entry = node;
+    table->count++;
+  }
+
+  return *entry;
+}
+
+
+// Merges all equal sub trees, so every unique sub expression only gets evaluated once. Afterwards
+// the AST is a DAG and must only be walked by code that expects shared nodes or does not care
+// about evaluating them multiple times. The AST may already be a DAG, every shared node only gets
+// walked once.
+//
+// The divisor of a division never gets replaced, because its cursor is reported on a division by
+// zero. Its children still get merged.
+void optimizer_merge_common(arena_t* arena, node_t* root, optimizer_stats_t* stats)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(root);
+  ASSERT_NULL(stats);
+
+  optimizer_node_table_t table = {0};
+  optimizer_slot_stack_t stack = {0};
+
+  // The root is the last node of the walk, so it never gets replaced.
+  node_t* rootSlot = root;
+  optimizer_slot_stack_push(arena, &stack, &rootSlot, false);
+
+  while (stack.count > 0)
+  {
+    optimizer_slot_frame_t* frame = &stack.items[stack.count - 1];
+    node_t* node = *frame->slot;
+
+    // A node whose children were already merged finds itself or an equal node.
+    if (!frame->expanded && !node_is_leaf(node) && table.count > 0)
+    {
+      node_t** entry = optimizer_node_table_slot(&table, node, optimizer_node_hash(node));
+
+      if (*entry)
+        frame->expanded = true;
+    }
+
+    if (frame->expanded || node_is_leaf(node))
+    {
+      node_t* merged = optimizer_node_table_intern(arena, &table, node);
+
+      if (merged != node && !frame->isDivisor)
+      {
+        *frame->slot = merged;
+        stats->mergedNodes++;
+      }
+
+      stack.count--;
+      continue;
+    }
+
+    frame->expanded = true;
+
+    switch (node->type)
+    {
+      case NT_BINOP:
+        optimizer_slot_stack_push(arena, &stack, &node->as.binop.rhs, node->as.binop.type == NO_DIV);
+        optimizer_slot_stack_push(arena, &stack, &node->as.binop.lhs, false);
+        break;
+      case NT_FUNCTION:
+        optimizer_slot_stack_push(arena, &stack, &node->as.func.arg, false);
+        break;
+      case NT_PAREN:
+        optimizer_slot_stack_push(arena, &stack, &node->as.paren.arg, false);
+        break;
+      case NT_FMA:
+      {
+        // The product itself never gets evaluated, so only its operands get merged. They get
+        // walked in the order of evaluation, so the first use stays the one that gets kept.
+        bool addendFirst = is_bit_set(node->as.fma.flags, FMA_ADDEND_FIRST);
+
+        if (!addendFirst)
+          optimizer_slot_stack_push(arena, &stack, &node->as.fma.addend, false);
+
+        optimizer_slot_stack_push(arena, &stack, &node->as.fma.product->as.binop.rhs, false);
+        optimizer_slot_stack_push(arena, &stack, &node->as.fma.product->as.binop.lhs, false);
+
+        if (addendFirst)
+          optimizer_slot_stack_push(arena, &stack, &node->as.fma.addend, false);
+        break;
+      }
+      case NT_CONSTANT:
+      case NT_VARIABLE:
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+}
+
+
+// Runs all passes selected by the flags. Estrin's scheme and reducing the powers create shared
+// nodes, so only the passes after them handle a DAG. The contraction runs after the polynomials and
+// powers became multiplications, so they can be fused too.
+optimizer_stats_t optimizer_execute(arena_t* arena, node_t* root, e_optimizer_flags flags)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(root);
+
+  optimizer_stats_t stats = {0};
+
+  if (is_bit_set(flags, OPT_FOLD_CONSTANTS))
+    optimizer_fold_constants(arena, root, &stats);
+
+  if (is_bit_set(flags, OPT_REASSOCIATE))
+    optimizer_reassociate(arena, root, &stats);
+
+  if (is_bit_set(flags, OPT_POLYNOMIAL))
+    optimizer_rewrite_polynomials(arena, root, flags, &stats);
+
+  if (is_bit_set(flags, (OPT_REDUCE_POW | OPT_FAST_POW)))
+    optimizer_reduce_powers(arena, root, flags, &stats);
+
+  if (is_bit_set(flags, OPT_CONTRACT_FMA))
+    optimizer_contract_fma(arena, root, &stats);
+
+  if (is_bit_set(flags, OPT_MERGE_COMMON))
+    optimizer_merge_common(arena, root, &stats);
+
+  return stats;
+}
+
+void optimizer_print_stats(const optimizer_stats_t* stats)
+{
+  ASSERT_NULL(stats);
+
+  printf("Optimizer:\n");
+  printf("  Folded constant nodes: %zu\n", stats->foldedNodes);
+  printf("  Rebalanced chains: %zu\n", stats->rebalancedChains);
+  printf("  Rewritten polynomials: %zu\n", stats->rewrittenPolynomials);
+  printf("  Reduced powers: %zu\n", stats->reducedPowers);
+  printf("  Contracted multiply-adds: %zu\n", stats->contractedNodes);
+  printf("  Merged common nodes: %zu\n", stats->mergedNodes);
+}
+
+#endif // _OPTIMIZER_H_
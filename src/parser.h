@@ -9,7 +9,7 @@
 // Errors
 #define _S_ERROR_NAME "SEMANTIC-ERROR"
 #define _E_ERROR_NAME "EVALUATION-ERROR"
-#define _PARSER_ERROR(type, cursor, message) fprintf(stderr, type ":%zu: %s\n", (cursor), (message));
+#define _PARSER_ERROR(type, cursor, message) fprintf(ERROR_STREAM, type ":%zu: %s\n", (cursor), (message));
 #define S_ERROR(cursor, message) _PARSER_ERROR(_S_ERROR_NAME, cursor, message)
 #define E_ERROR(cursor, message) _PARSER_ERROR(_E_ERROR_NAME, cursor, message)
 
@@ -20,17 +20,22 @@ typedef enum {
   NT_BINOP,
   NT_FUNCTION,
   NT_PAREN,
+  NT_VARIABLE,
+  // Only created by the optimizer.
+  NT_FMA,
 
   NT_COUNT
 } e_node_type;
 
-static_assert(NT_COUNT == 4, "Amount of node-types have changed");
+static_assert(NT_COUNT == 6, "Amount of node-types have changed");
 
 const char* nodeTypeNames[NT_COUNT] = {
   [NT_CONSTANT] = "constant",
   [NT_BINOP] = "operator",
   [NT_FUNCTION] = "function",
-  [NT_PAREN] = "parenthesis"
+  [NT_PAREN] = "parenthesis",
+  [NT_VARIABLE] = "variable",
+  [NT_FMA] = "fused multiply-add"
 };
 
 
@@ -91,10 +96,14 @@ typedef enum {
   NF_LN,
   NF_LOG10,
 
+  // Only created by the optimizer for negative powers. It is '1 / x' but like 'pow' it gives
+  // infinity for zero instead of a division by zero error.
+  NF_RECIP,
+
   NF_COUNT
 } e_node_func_type;
 
-static_assert(NF_COUNT == 13, "Amount of function-node-types have changed");
+static_assert(NF_COUNT == 14, "Amount of function-node-types have changed");
 
 const char* nodeFunctionTypeNames[NF_COUNT] = {
   [NF_SQRT]  = "sqrt",
@@ -113,7 +122,9 @@ const char* nodeFunctionTypeNames[NF_COUNT] = {
   [NF_TANH]  = "tanh",
   
   [NF_LN]    = "ln",
-  [NF_LOG10] = "log10"
+  [NF_LOG10] = "log10",
+
+  [NF_RECIP] = "recip"
 };
 
 static inline e_node_func_type to_local_func_type(e_function_type type)
@@ -159,11 +170,39 @@ typedef struct {
   node_t* arg;
 } node_paren_t;
 
+// Variables are slots which values are given when evaluating.
+typedef struct {
+  size_t index;
+  const char* name;
+} node_variable_t;
+
+typedef enum {
+  // The addend gets evaluated before the operands of the product ('c + a * b').
+  FMA_ADDEND_FIRST   = (1u << 0),
+  FMA_NEGATE_PRODUCT = (1u << 1),
+  FMA_NEGATE_ADDEND  = (1u << 2),
+} e_fma_flags;
+
+// Indexed by the two negate flags.
+const char* nodeFmaTypeNames[4] = { "fma", "fnma", "fms", "fnms" };
+
+#define fma_type_name(flags) nodeFmaTypeNames[((flags) >> 1) & 3]
+
+// 'product + addend' with a single rounding. The product is a multiply node, but only its
+// operands get evaluated.
+typedef struct {
+  e_fma_flags flags;
+  node_t* product;
+  node_t* addend;
+} node_fma_t;
+
 typedef union {
   double constant;
   node_binop_t binop;
   node_function_t func;
   node_paren_t paren;
+  node_variable_t variable;
+  node_fma_t fma;
 } u_node_as;
 
 struct node {
@@ -174,6 +213,9 @@ struct node {
 
 
 
+#define node_is_leaf(node) ((node)->type == NT_CONSTANT || (node)->type == NT_VARIABLE)
+
+
 // Creating new nodes
 static node_t* base_node(arena_t* arena, size_t cursor, e_node_type type)
 {
@@ -214,332 +256,753 @@ node_t* node_paren(arena_t* arena, size_t cursor, node_t* arg)
   return node;
 }
 
+node_t* node_variable(arena_t* arena, size_t cursor, size_t index, const char* name)
+{
+  node_t* node = base_node(arena, cursor, NT_VARIABLE);
+  node->as.variable.index = index;
+  node->as.variable.name = name;
+  return node;
+}
 
+node_t* node_fma(arena_t* arena, size_t cursor, e_fma_flags flags, node_t* product, node_t* addend)
+{
+  assert(product->type == NT_BINOP && product->as.binop.type == NO_MUL && "The product must be a multiply node!");
 
-node_t* ast_eval(arena_t* arena, node_t* expr)
+  node_t* node = base_node(arena, cursor, NT_FMA);
+  node->as.fma.flags = flags;
+  node->as.fma.product = product;
+  node->as.fma.addend = addend;
+  return node;
+}
+
+// Negating is exact, so the result is still rounded only once.
+static inline double fma_apply(e_fma_flags flags, double a, double b, double c)
 {
-  ASSERT_NULL(arena);
-  ASSERT_NULL(expr);
+  return fma(is_bit_set(flags, FMA_NEGATE_PRODUCT) ? -a : a, b, is_bit_set(flags, FMA_NEGATE_ADDEND) ? -c : c);
+}
+
+
+
+// Evaluation status
+typedef enum {
+  ES_SUCCESS,
+  ES_DIVISION_BY_ZERO,
+
+  ES_COUNT
+} e_eval_status_type;
+
+static_assert(ES_COUNT == 2, "Amount of eval-status-types have changed");
+
+const char* evalStatusMessages[ES_COUNT] = {
+  [ES_SUCCESS]          = "Success",
+  [ES_DIVISION_BY_ZERO] = "Tried to divide by zero!",
+};
+
+typedef struct {
+  e_eval_status_type type;
+  size_t cursor;
+} eval_status_t;
+
+#define EVAL_STATUS_SUCCESS()               ((eval_status_t) { .type = ES_SUCCESS, .cursor = 0       })
+#define EVAL_STATUS_ERROR(statusType, cur)  ((eval_status_t) { .type = (statusType), .cursor = (cur) })
+
+#define eval_status_is_error(status)  ((status)->type != ES_SUCCESS)
+#define E_ERROR_STATUS(status)        E_ERROR((status)->cursor, evalStatusMessages[(status)->type])
+
+
+// All pre defined functions take a single argument and map directly to 'math.h'.
+typedef double (*node_func_impl_t)(double);
+
+static double node_recip(double x)
+{
+  return 1.0 / x;
+}
+
+const node_func_impl_t nodeFunctionImpls[NF_COUNT] = {
+  [NF_SQRT]  = sqrt,
+  [NF_EXP]   = exp,
+
+  [NF_SIN]   = sin,
+  [NF_ASIN]  = asin,
+  [NF_SINH]  = sinh,
+
+  [NF_COS]   = cos,
+  [NF_ACOS]  = acos,
+  [NF_COSH]  = cosh,
+
+  [NF_TAN]   = tan,
+  [NF_ATAN]  = atan,
+  [NF_TANH]  = tanh,
+
+  [NF_LN]    = log,
+  [NF_LOG10] = log10,
+
+  [NF_RECIP] = node_recip
+};
+
+
+
+// Explicit stacks for walking a tree without recursion, so deeply nested trees can't overflow the
+// C stack. The first items live in the stack itself, only deeper trees grow on the heap.
+#define WALK_STACK_INLINE_CAPACITY 64
+
+typedef struct {
+  const node_t* node;
+  size_t depth;
+  // How many children of the node were already walked.
+  size_t stage;
+} walk_frame_t;
+
+typedef struct {
+  walk_frame_t* items;
+  size_t capacity;
+  size_t count;
+  walk_frame_t inlineItems[WALK_STACK_INLINE_CAPACITY];
+} walk_frame_stack_t;
+
+typedef struct {
+  double* items;
+  size_t capacity;
+  size_t count;
+  double inlineItems[WALK_STACK_INLINE_CAPACITY];
+} walk_value_stack_t;
 
-  switch (expr->type)
+static void* walk_stack_grow(void* items, bool isInline, size_t* capacity, size_t itemSize)
+{
+  size_t newCapacity = *capacity * 2;
+  void* newItems;
+
+  if (isInline)
   {
-    case NT_CONSTANT:
-      return expr;
-    case NT_BINOP:
-    {
-      node_t* lhs = ast_eval(arena, expr->as.binop.lhs);
-      if (!lhs) return NULL;
-      node_t* rhs = ast_eval(arena, expr->as.binop.rhs);
-      if (!rhs) return NULL;
+    newItems = malloc(newCapacity * itemSize);
+    if (newItems) memcpy(newItems, items, *capacity * itemSize);
+  }
+  else
+    newItems = realloc(items, newCapacity * itemSize);
+
+  assert(newItems && "Not enough memory!");
+  *capacity = newCapacity;
+  return newItems;
+}
+
+#define walk_stack_init(stack)                                                                \
+    do {                                                                                      \
+      (stack)->items = (stack)->inlineItems;                                                  \
+      (stack)->capacity = WALK_STACK_INLINE_CAPACITY;                                         \
+      (stack)->count = 0;                                                                     \
+    } while (0)
+
+#define walk_stack_push(stack, item)                                                          \
+    do {                                                                                      \
+      if ((stack)->count >= (stack)->capacity)                                                \
+        (stack)->items = walk_stack_grow((stack)->items, (stack)->items == (stack)->inlineItems, \
+                                         &(stack)->capacity, sizeof(*(stack)->items));        \
+      (stack)->items[(stack)->count++] = (item);                                              \
+    } while (0)
+
+#define walk_stack_free(stack)                                                                \
+    do {                                                                                      \
+      if ((stack)->items != (stack)->inlineItems)                                             \
+        free((stack)->items);                                                                 \
+    } while (0)
+
+#define walk_frame_push(stack, n, d) walk_stack_push((stack), ((walk_frame_t) { .node = (n), .depth = (d), .stage = 0 }))
+
+
+// Evaluates the tree. Only trees which are deeper than the inline stacks allocate. The status must
+// be set to success by the caller and only gets overwritten on the first error.
+static double ast_eval_node(const node_t* expr, const double* variables, eval_status_t* status)
+{
+  walk_frame_stack_t frames;
+  walk_value_stack_t values;
+  walk_stack_init(&frames);
+  walk_stack_init(&values);
+
+  walk_frame_push(&frames, expr, 0);
+
+  while (frames.count > 0)
+  {
+    walk_frame_t* frame = &frames.items[frames.count - 1];
+    const node_t* node = frame->node;
 
-      switch (expr->as.binop.type)
+    switch (node->type)
+    {
+      case NT_CONSTANT:
       {
-        case NO_ADD: return node_constant(arena, expr->cursor, lhs->as.constant + rhs->as.constant);
-        case NO_SUB: return node_constant(arena, expr->cursor, lhs->as.constant - rhs->as.constant);
-        case NO_MUL: return node_constant(arena, expr->cursor, lhs->as.constant * rhs->as.constant);
-        case NO_DIV:
-        {
-          if (rhs->as.constant == 0)
-          {
-            E_ERROR(rhs->cursor, "Tried to divide by zero!");
-            return NULL;
-          }
-          return node_constant(arena, expr->cursor, lhs->as.constant / rhs->as.constant);
-        }
-        case NO_POW: return node_constant(arena, expr->cursor, pow(lhs->as.constant, rhs->as.constant));
-        case NO_COUNT:
-        default:
-          UNREACHABLE("Invalid binop-node-type!");
+        walk_stack_push(&values, node->as.constant);
+        frames.count--;
+        break;
       }
-      break;
-    }
-    case NT_FUNCTION:
-      // Functions could support different numbers of arguments in the future.
-      switch (expr->as.func.type)
+      case NT_BINOP:
       {
-        case NF_SQRT:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, sqrt(func->as.constant));
-        }
-        case NF_EXP:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, exp(func->as.constant));
-        }
-        case NF_SIN:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, sin(func->as.constant));
-        }
-        case NF_ASIN:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, asin(func->as.constant));
-        }
-        case NF_SINH:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, sinh(func->as.constant));
-        }
-        case NF_COS:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, cos(func->as.constant));
-        }
-        case NF_ACOS:
+        if (frame->stage == 0)
         {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, acos(func->as.constant));
+          // The rhs gets pushed first so the lhs gets evaluated first.
+          frame->stage = 1;
+          walk_frame_push(&frames, node->as.binop.rhs, 0);
+          walk_frame_push(&frames, node->as.binop.lhs, 0);
+          break;
         }
-        case NF_COSH:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, cosh(func->as.constant));
-        }
-        case NF_TAN:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, tan(func->as.constant));
-        }
-        case NF_ATAN:
-        {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, atan(func->as.constant));
-        }
-        case NF_TANH:
+
+        double rhs = values.items[--values.count];
+        double* lhs = &values.items[values.count - 1];
+        frames.count--;
+
+        switch (node->as.binop.type)
         {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, tanh(func->as.constant));
+          case NO_ADD: *lhs += rhs; break;
+          case NO_SUB: *lhs -= rhs; break;
+          case NO_MUL: *lhs *= rhs; break;
+          case NO_DIV:
+          {
+            if (rhs == 0)
+            {
+              *status = EVAL_STATUS_ERROR(ES_DIVISION_BY_ZERO, node->as.binop.rhs->cursor);
+              frames.count = 0;
+              break;
+            }
+            *lhs /= rhs;
+            break;
+          }
+          case NO_POW: *lhs = pow(*lhs, rhs); break;
+          case NO_COUNT:
+          default:
+            UNREACHABLE("Invalid binop-node-type!");
         }
-        case NF_LN:
+        break;
+      }
+      case NT_FUNCTION:
+      {
+        if (node->as.func.type >= NF_COUNT)
+          UNREACHABLE("Invalid function-node-type!");
+
+        // Functions could support different numbers of arguments in the future.
+        if (frame->stage == 0)
         {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, log(func->as.constant));
+          frame->stage = 1;
+          walk_frame_push(&frames, node->as.func.arg, 0);
+          break;
         }
-        case NF_LOG10:
+
+        double* arg = &values.items[values.count - 1];
+        *arg = nodeFunctionImpls[node->as.func.type](*arg);
+        frames.count--;
+        break;
+      }
+      case NT_PAREN:
+        frame->node = node->as.paren.arg;
+        break;
+      case NT_VARIABLE:
+      {
+        assert(variables && "The expression uses variables but no values were given!");
+        walk_stack_push(&values, variables[node->as.variable.index]);
+        frames.count--;
+        break;
+      }
+      case NT_FMA:
+      {
+        const node_fma_t* fma = &node->as.fma;
+        bool addendFirst = is_bit_set(fma->flags, FMA_ADDEND_FIRST);
+
+        if (frame->stage == 0)
         {
-          node_t* func = ast_eval(arena, expr->as.func.arg);
-          if (!func) return NULL;
-          return node_constant(arena, func->cursor, log10(func->as.constant));
+          // The operands get pushed in reverse, so they get evaluated in their order.
+          frame->stage = 1;
+
+          if (!addendFirst)
+            walk_frame_push(&frames, fma->addend, 0);
+
+          walk_frame_push(&frames, fma->product->as.binop.rhs, 0);
+          walk_frame_push(&frames, fma->product->as.binop.lhs, 0);
+
+          if (addendFirst)
+            walk_frame_push(&frames, fma->addend, 0);
+          break;
         }
-        case NF_COUNT:
-        default:
-          UNREACHABLE("Invalid function-node-type!");
+
+        values.count -= 2;
+        double* operands = &values.items[values.count - 1];
+        double c = addendFirst ? operands[0] : operands[2];
+        double a = addendFirst ? operands[1] : operands[0];
+        double b = addendFirst ? operands[2] : operands[1];
+
+        operands[0] = fma_apply(fma->flags, a, b, c);
+        frames.count--;
+        break;
       }
-      break;
-    case NT_PAREN:
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
+    }
+  }
+
+  double result = eval_status_is_error(status) ? NAN : values.items[0];
+
+  walk_stack_free(&frames);
+  walk_stack_free(&values);
+  return result;
+}
+
+// Evaluates the given AST to a plain value. The variables hold the value of every variable slot
+// and can be NULL if the expression has no variables. On an error 'NAN' gets returned and the
+// status contains the error type and the cursor of the failing node.
+double ast_eval_value(const node_t* expr, const double* variables, eval_status_t* status)
+{
+  ASSERT_NULL(expr);
+  ASSERT_NULL(status);
+
+  *status = EVAL_STATUS_SUCCESS();
+  return ast_eval_node(expr, variables, status);
+}
+
+
+// INFO: Only kept for compatibility. Use 'ast_eval_value' instead, which does not allocate.
+node_t* ast_eval(arena_t* arena, node_t* expr)
+{
+  ASSERT_NULL(arena);
+  ASSERT_NULL(expr);
+
+  eval_status_t status;
+  double value = ast_eval_value(expr, NULL, &status);
+
+  if (eval_status_is_error(&status))
+  {
+    E_ERROR_STATUS(&status);
+    return NULL;
+  }
+
+  return node_constant(arena, expr->cursor, value);
+}
+
+
+// The semantic checks of a single token. They only look at the neighbouring tokens, so they run
+// during the parse pass. Every error gets reported and false gets returned.
+static bool check_value(const lexer_t* lexer, size_t i)
+{
+  const token_t* tok = lex_at(lexer, i);
+
+  if (i > 0)
+  {
+    const token_t* lastTok = lex_at(lexer, i - 1);
+
+    if (tok_is(lastTok, TT_OPERATOR) ||
+        tok_is_paren(lastTok, PT_OPAREN))
+      return true;
+
+    S_ERROR(tok_cursor(tok), "Expected an operator or an open paren before a number or constant!");
+    return false;
+  }
+
+  return true;
+}
+
+static bool check_operator(const lexer_t* lexer, size_t i)
+{
+  const token_t* tok = lex_at(lexer, i);
+
+  // Checks if this is the last token (the last must not be an opeartor).
+  if (!lex_next_in_range(lexer, i))
+  {
+    S_ERROR(tok_cursor(tok), "An operator can't be the last token!");
+    return false;
+  }
+
+  const token_t* nextTok = lex_at(lexer, i + 1);
+
+  if (i > 0)
+  {
+    const token_t* lastTok = lex_at(lexer, i - 1);
+
+    // Checks if the last token was a number or a closing paren.
+    if (tok_is_value(lastTok) ||
+        tok_is_paren(lastTok, PT_CPAREN))
+      return true;
+
+    // Checks for ".. '(' '+'/'-' NUMBER ..".
+    if (tok_is_paren(lastTok, PT_OPAREN) &&
+        tok_is_number_operator(tok) &&
+        tok_is(nextTok, TT_NUMBER))
+      return true;
+
+    // Checks if last token was an operator, the current is a number operator and the next is a number ".. OPERATOR '+'/'-' NUMBER ..".
+    if (tok_is(lastTok, TT_OPERATOR) &&
+        tok_is_number_operator(tok) &&
+        tok_is(nextTok, TT_NUMBER))
+      return true;
+  }
+
+  if (tok_is_number_operator(tok) && tok_is(nextTok, TT_NUMBER))
+    return true;
+
+  S_ERROR(tok_cursor(tok), "Invalid usage of an operator!");
+  return false;
+}
+
+static bool check_paren(const lexer_t* lexer, size_t i, size_t* parenCount)
+{
+  const token_t* tok = lex_at(lexer, i);
+
+  if (tok_paren(tok) == PT_OPAREN)
+  {
+    (*parenCount)++;
+
+    if (i > 0)
     {
-      node_t* argEval = ast_eval(arena, expr->as.paren.arg);
-      if (!argEval) return NULL;
-      return node_constant(arena, expr->cursor, argEval->as.constant);
+      const token_t* lastTok = lex_at(lexer, i - 1);
+
+      if (tok_is_paren(lastTok, PT_CPAREN))
+      {
+        S_ERROR(tok_cursor(tok), "Expected operator! Before an open paren must NOT be a closing paren.");
+        return false;
+      }
+
+      if (tok_not(lastTok, TT_OPERATOR) && !tok_is_paren(lastTok, PT_OPAREN))
+      {
+        S_ERROR(tok_cursor(tok), "Expected operator or open paren!");
+        return false;
+      }
     }
-    case NT_COUNT:
+  }
+  else if (tok_paren(tok) == PT_CPAREN)
+  {
+    if (*parenCount <= 0)
+    {
+      S_ERROR(tok_cursor(tok), "Too many closing parens!");
+      return false;
+    }
+
+    (*parenCount)--;
+
+    if (i > 0)
+    {
+      const token_t* lastTok = lex_at(lexer, i - 1);
+
+      if (tok_is(lastTok, TT_OPERATOR))
+      {
+        S_ERROR(tok_cursor(tok), "Expected an expression after an operator but got a closing paren!");
+        return false;
+      }
+
+      if (tok_is_paren(lastTok, PT_OPAREN))
+      {
+        S_ERROR(tok_cursor(tok), "Expected an argument expression inside the parens!");
+        return false;
+      }
+    }
+  }
+
+  if (!lex_next_in_range(lexer, i) && *parenCount > 0)
+  {
+    S_ERROR(tok_cursor(tok), "Expected closing paren!");
+    return false;
+  }
+
+  return true;
+}
+
+// If the function is valid, the open paren after it belongs to the function and must get skipped.
+static bool check_function(const lexer_t* lexer, size_t i)
+{
+  const token_t* tok = lex_at(lexer, i);
+
+  // Checks that after the current initializer there are still at least 3 more tokens because a function needs 
+  // an open paren, at least a single argument and a closing paren.
+  if (!lex_next_in_range(lexer, i + 2))
+  {
+    S_ERROR(tok_cursor(tok), "A function initializer can't be the last token because it needs an open and a closing paren and an argument expression inside them!");
+    return false;
+  }
+
+  const token_t* nextTok = lex_at(lexer, i + 1);
+
+  // Checks if last token was a function initializer and also if the current is an open paren ("FUNC(<-...)").
+  if (tok_not_specific_paren(nextTok, PT_OPAREN))
+  {
+    S_ERROR(tok_cursor(nextTok), "Expected an open paren after a function initializer!");
+    return false;
+  }
+
+  if (i > 0)
+  {
+    const token_t* lastTok = lex_at(lexer, i - 1);
+
+    // Checks if the last token was an operator or an open paren.
+    if (tok_not(lastTok, TT_OPERATOR) &&
+        tok_not_specific_paren(lastTok, PT_OPAREN))
+    {
+      S_ERROR(tok_cursor(lastTok), "Before a function initializer must be an operator or an open paren!");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+
+// The parser is an iterative shunting-yard parser. Operators and open parens wait on an explicit
+// operator stack until their operands are parsed, and the finished sub trees wait on an operand
+// stack. Both stacks live in the arena, so even millions of nested parens can't overflow the C stack.
+//
+// Higher binds stronger. '^' is right associative, all other operators are left associative.
+static const int binopPrecedence[NO_COUNT] = {
+  [NO_ADD] = 1,
+  [NO_SUB] = 1,
+  [NO_MUL] = 2,
+  [NO_DIV] = 2,
+  [NO_POW] = 3,
+};
+
+#define binop_is_right_associative(type) ((type) == NO_POW)
+
+
+typedef enum {
+  PE_BINOP,
+  // An open paren which creates a paren node when it gets closed.
+  PE_PAREN,
+  // A function initializer with its open paren. Closing it creates the function node.
+  PE_FUNCTION,
+  // A '-' sign before the base of a '^'. It binds weaker than '^' and stronger than every other
+  // operator, so '-2^2' is '-(2^2)'.
+  PE_NEGATE,
+} e_parse_entry_type;
+
+typedef struct {
+  e_parse_entry_type type;
+  size_t cursor;
+  union {
+    e_node_binop_type binop;
+    e_node_func_type func;
+  } as;
+} parse_entry_t;
+
+typedef struct {
+  parse_entry_t* items;
+  size_t capacity;
+  size_t count;
+} parse_operator_stack_t;
+
+typedef struct {
+  node_t** items;
+  size_t capacity;
+  size_t count;
+} parse_operand_stack_t;
+
+
+static node_t* parse_value(arena_t* arena, const lexer_t* lexer, const token_t* token)
+{
+  switch (tok_type(token))
+  {
+    case TT_NUMBER:        return node_constant(arena, tok_cursor(token), tok_number(lexer, token));
+    case TT_MATH_CONSTANT: return node_constant(arena, tok_cursor(token), mathConstantTypeValues[tok_constant(token)]);
+    case TT_VARIABLE:      return node_variable(arena, tok_cursor(token), tok_variable(token), lexer->variables->items[tok_variable(token)]);
+    case TT_OPERATOR:
+    case TT_PAREN:
+    case TT_FUNCTION:
+    case TT_LITERAL:
+    case TT_COUNT:
     default:
-      UNREACHABLE("Invalid node-type!");
+      UNREACHABLE("Token is not a value!");
   }
 }
 
+// Replaces the two top operands with the binop on top of the operator stack.
+static void parse_reduce_binop(arena_t* arena, parse_operator_stack_t* operators, parse_operand_stack_t* operands)
+{
+  assert(operands->count >= 2 && "Missing operands!");
 
-static bool check_semantics(lexer_t* lexer)
+  parse_entry_t entry = operators->items[--operators->count];
+  assert(entry.type == PE_BINOP && "Expected a binop!");
+
+  node_t* rhs = operands->items[--operands->count];
+  node_t* lhs = operands->items[operands->count - 1];
+  operands->items[operands->count - 1] = node_binop(arena, entry.cursor, entry.as.binop, lhs, rhs);
+}
+
+// Negates the top operand with the negation on top of the operator stack. Multiplying with -1 is
+// exact, like the sign which gets folded into a number.
+static void parse_reduce_negate(arena_t* arena, parse_operator_stack_t* operators, parse_operand_stack_t* operands)
 {
-  ASSERT_NULL(lexer);
+  assert(operands->count >= 1 && "Missing operand!");
+
+  parse_entry_t entry = operators->items[--operators->count];
+  assert(entry.type == PE_NEGATE && "Expected a negation!");
+
+  node_t** operand = &operands->items[operands->count - 1];
+  *operand = node_binop(arena, entry.cursor, NO_MUL, node_constant(arena, entry.cursor, -1), *operand);
+}
 
-  if (lexer->count <= 0)
+// Reduces the binop or negation on top of the operator stack if it binds at least as strong as
+// the following binop of the given type.
+static bool parse_reduce_before(arena_t* arena, parse_operator_stack_t* operators, parse_operand_stack_t* operands, e_node_binop_type type)
+{
+  if (operators->count == 0)
     return false;
-  
+
+  const parse_entry_t* top = &operators->items[operators->count - 1];
+
+  if (top->type == PE_NEGATE)
+  {
+    if (type == NO_POW)
+      return false;
+
+    parse_reduce_negate(arena, operators, operands);
+    return true;
+  }
+
+  if (top->type != PE_BINOP)
+    return false;
+
+  if (binopPrecedence[top->as.binop] < binopPrecedence[type] ||
+      (binopPrecedence[top->as.binop] == binopPrecedence[type] && binop_is_right_associative(type)))
+    return false;
+
+  parse_reduce_binop(arena, operators, operands);
+  return true;
+}
+
+// Reduces all binops and negations till the next open paren or function on the operator stack.
+static void parse_reduce_group(arena_t* arena, parse_operator_stack_t* operators, parse_operand_stack_t* operands)
+{
+  while (operators->count > 0)
+  {
+    e_parse_entry_type top = operators->items[operators->count - 1].type;
+
+    if (top == PE_BINOP)
+      parse_reduce_binop(arena, operators, operands);
+    else if (top == PE_NEGATE)
+      parse_reduce_negate(arena, operators, operands);
+    else
+      break;
+  }
+}
+
+
+// Checks and parses the tokens in a single pass. After the first error the tree is not built
+// anymore, but the remaining tokens still get checked, so every error gets reported.
+static node_t* parse_tokens(arena_t* arena, const lexer_t* lexer)
+{
+  parse_operator_stack_t operators = {0};
+  parse_operand_stack_t operands = {0};
+
   bool isError = false;
   size_t parenCount = 0;
-  
+
+  // True if the next token starts an operand, so a '+' or '-' there is the sign of a number.
+  bool expectOperand = true;
+  // The sign before the next number or NULL.
+  const token_t* sign = NULL;
+
   for (size_t i = 0; i < lexer->count; ++i)
   {
-    token_t* tok = lex_at(lexer, i);
-    
-    switch (tok->type)
+    const token_t* tok = lex_at(lexer, i);
+
+    switch (tok_type(tok))
     {
       case TT_MATH_CONSTANT:
       case TT_NUMBER:
+      case TT_VARIABLE:
       {
-        if (i > 0)
-        {
-          token_t* lastTok = lex_at(lexer, i - 1);
-          
-          if (tok_is(lastTok, TT_OPERATOR) ||
-              tok_is_paren(lastTok, PT_OPAREN))
-            continue;
-
-          S_ERROR(tok->cursor, "Expected an operator or an open paren before a number or constant!");
+        if (!check_value(lexer, i))
           isError = true;
+
+        if (isError)
           continue;
+
+        node_t* value = parse_value(arena, lexer, tok);
+
+        // The checks only allow a sign directly before a number, so it gets part of the constant.
+        // The base of a '^' gets negated after the power instead.
+        if (sign)
+        {
+          const token_t* next = lex_next_in_range(lexer, i) ? lex_at(lexer, i + 1) : NULL;
+          bool isBase = next && tok_is(next, TT_OPERATOR) && tok_operator(next) == OP_POW;
+
+          if (tok_operator(sign) == OP_SUB && isBase)
+            arena_da_append(arena, &operators, ((parse_entry_t) { .type = PE_NEGATE, .cursor = tok_cursor(sign) }));
+          else
+          {
+            value->cursor = tok_cursor(sign);
+            if (tok_operator(sign) == OP_SUB)
+              value->as.constant = -value->as.constant;
+          }
+
+          sign = NULL;
         }
 
+        arena_da_append(arena, &operands, value);
+        expectOperand = false;
         continue;
       }
       case TT_OPERATOR:
       {
-        // Checks if this is the last token (the last must not be an opeartor).
-        if (!lex_next_in_range(lexer, i))
-        {
-          S_ERROR(tok->cursor, "An operator can't be the last token!");
+        if (!check_operator(lexer, i))
           isError = true;
+
+        if (isError)
           continue;
-        }
-        
-        token_t* nextTok = lex_at(lexer, i + 1);
 
-        if (i > 0)
+        if (expectOperand)
         {
-          token_t* lastTok = lex_at(lexer, i - 1);
-          
-          // Checks if the last token was a number or a closing paren.
-          if (tok_is(lastTok, TT_NUMBER) ||
-              tok_is(lastTok, TT_MATH_CONSTANT) ||
-              tok_is_paren(lastTok, PT_CPAREN))
-            continue;
-
-          // Checks for ".. ')' OPERATOR NUMBER ..".
-          if (tok_is_paren(lastTok, PT_CPAREN) &&
-              tok_is(nextTok, TT_NUMBER))
-            continue;
-
-          // Checks for ".. '(' '+'/'-' NUMBER ..".
-          if (tok_is_paren(lastTok, PT_OPAREN) &&
-              tok_is_number_operator(tok) &&
-              tok_is(nextTok, TT_NUMBER))
-            continue;
-
-          // Checks if last token was an operator, the current is a number operator and the next is a number ".. OPERATOR '+'/'-' NUMBER ..".
-          if (tok_is(lastTok, TT_OPERATOR) &&
-              tok_is_number_operator(tok) &&
-              tok_is(nextTok, TT_NUMBER))
-            continue;
+          sign = tok;
+          continue;
         }
 
-        if (tok_is_number_operator(tok) && tok_is(nextTok, TT_NUMBER))
-          continue;
+        e_node_binop_type type = to_local_binop_type(tok_operator(tok));
+
+        while (parse_reduce_before(arena, &operators, &operands, type));
 
-        S_ERROR(tok->cursor, "Invalid usage of an operator!");
-        isError = true;
+        arena_da_append(arena, &operators, ((parse_entry_t) { .type = PE_BINOP, .cursor = tok_cursor(tok), .as.binop = type }));
+        expectOperand = true;
         continue;
       }
       case TT_PAREN:
       {
-        e_paren_type ptype = tok->as.paren;
-
-        if (ptype == PT_OPAREN)
-        {
-          parenCount++;
-          
-          if (i > 0)
-          {
-            token_t* lastTok = lex_at(lexer, i - 1);
+        if (!check_paren(lexer, i, &parenCount))
+          isError = true;
 
-            if (tok_is_paren(lastTok, PT_CPAREN))
-            {
-              S_ERROR(tok->cursor, "Expected operator! Before an open paren must NOT be a closing paren.");
-              isError = true;
-              continue;
-            }
+        if (isError)
+          continue;
 
-            if (tok_not(lastTok, TT_OPERATOR) && !tok_is_paren(lastTok, PT_OPAREN))
-            {
-              S_ERROR(tok->cursor, "Expected operator or open paren!");
-              isError = true;
-              continue;
-            }
-          }
-        }
-        else if (ptype == PT_CPAREN)
+        if (tok_paren(tok) == PT_OPAREN)
         {
-          if (parenCount <= 0)
-          {
-            S_ERROR(tok->cursor, "Too many closing parens!");
-            isError = true;
-            continue;
-          }
-          
-          parenCount--;
+          arena_da_append(arena, &operators, ((parse_entry_t) { .type = PE_PAREN, .cursor = tok_cursor(tok) }));
+          expectOperand = true;
+          continue;
+        }
 
-          if (i > 0)
-          {
-            token_t* lastTok = lex_at(lexer, i - 1);
+        parse_reduce_group(arena, &operators, &operands);
+        assert(operators.count > 0 && operands.count > 0 && "Unbalanced parens!");
 
-            if (tok_is(lastTok, TT_OPERATOR))
-            {
-              S_ERROR(tok->cursor, "Expected an expression after an operator but got a closing paren!");
-              isError = true;
-              continue;
-            }
+        parse_entry_t entry = operators.items[--operators.count];
+        node_t** arg = &operands.items[operands.count - 1];
 
-            if (tok_is_paren(lastTok, PT_OPAREN))
-            {
-              S_ERROR(tok->cursor, "Expected an argument expression inside the parens!");
-              isError = true;
-              continue;
-            }
-          }
-        }
-
-        if (!lex_next_in_range(lexer, i) && parenCount > 0)
-        {
-          S_ERROR(tok->cursor, "Expected closing paren!");
-          isError = true;
-          continue;
-        }
+        // The parens of a function belong to the function, so they don't get their own node.
+        if (entry.type == PE_FUNCTION)
+          *arg = node_func(arena, entry.cursor, entry.as.func, *arg);
+        else
+          *arg = node_paren(arena, entry.cursor, *arg);
 
+        expectOperand = false;
         continue;
       }
       case TT_FUNCTION:
       {
-        // Checks that after the current initializer there are still at least 3 more tokens because a function needs 
-        // an open paren, at least a single argument and a closing paren.
-        if (!lex_next_in_range(lexer, i + 2))
+        if (!check_function(lexer, i))
         {
-          S_ERROR(tok->cursor, "A function initializer can't be the last token because it needs an open and a closing paren and an argument expression inside them!");
           isError = true;
           continue;
         }
 
-        token_t* nextTok = lex_at(lexer, i + 1);
-
-        // Checks if last token was a function initializer and also if the current is an open paren ("FUNC(<-...)").
-        if (tok_not_specific_paren(nextTok, PT_OPAREN))
-        {
-          S_ERROR(nextTok->cursor, "Expected an open paren after a function initializer!");
-          isError = true;
-          continue;
-        }
-
-        if (i > 0)
-        {
-          token_t* lastTok = lex_at(lexer, i - 1);
-
-          // Checks if the last token was an operator or an open paren.
-          if (tok_not(lastTok, TT_OPERATOR) &&
-              tok_not_specific_paren(lastTok, PT_OPAREN))
-          {
-            S_ERROR(lastTok->cursor, "Before a function initializer must be an operator or an open paren!");
-            isError = true;
-            continue;
-          }
-        }
-
-        // This ignores the cheking for the next token because the checks here make sure that the next is an open paren.
+        // The open paren gets skipped, the function entry closes with its closing paren.
         parenCount++;
         i++;
 
+        if (isError)
+          continue;
+
+        arena_da_append(arena, &operators, ((parse_entry_t) { .type = PE_FUNCTION, .cursor = tok_cursor(tok), .as.func = to_local_func_type(tok_function(tok)) }));
+        expectOperand = true;
         continue;
       }
       case TT_LITERAL:
@@ -550,7 +1013,7 @@ static bool check_semantics(lexer_t* lexer)
         // > '=': for equations like '10 + 5 = 20 - 5'. This could return f.e. 'true' or 'false'.
         //        Also it could maybe be used for assigning an expression to a variable.
 
-        S_ERROR(tok->cursor, "Literal not implemented yet!");
+        S_ERROR(tok_cursor(tok), "Literal not implemented yet!");
         isError = true; // TODO: Rethink!
         continue;
       }
@@ -562,80 +1025,17 @@ static bool check_semantics(lexer_t* lexer)
 
   if (parenCount != 0 && !isError)
   {
-    S_ERROR(lex_at(lexer, lexer->count - 1)->cursor, "Invalid paren usage!");
+    S_ERROR(tok_cursor(lex_at(lexer, lexer->count - 1)), "Invalid paren usage!");
     isError = true;
   }
 
-  return isError;
-}
-
-
-
-static node_t* try_parse_constant(arena_t* arena, lexer_t* lexer, size_t index);
-static node_t* try_parse_binop(arena_t* arena, lexer_t* lexer, size_t index);
-static node_t* try_parse_func(arena_t* arena, lexer_t* lexer, size_t index);
-static node_t* try_parse_paren(arena_t* arena, lexer_t* lexer, size_t index);
-
-
-static node_t* try_parse_constant(arena_t* arena, lexer_t* lexer, size_t index)
-{
-  ASSERT_NULL(arena);
-  ASSERT_NULL(lexer);
-
-  token_t* token = lex_at(lexer, index);
-  
-  if (tok_is(token, TT_NUMBER))
-    return node_constant(arena, token->cursor, token->as.number);
-  else if (tok_is(token, TT_MATH_CONSTANT))
-    return node_constant(arena, token->cursor, mathConstantTypeValues[token->as.constant]);
-  else return NULL;
-}
-
-static node_t* try_parse_binop(arena_t* arena, lexer_t* lexer, size_t index)
-{
-  ASSERT_NULL(arena);
-  ASSERT_NULL(lexer);
-
-  token_t* token = lex_at(lexer, index);
-
-  if (tok_is(token, TT_OPERATOR))
-  {
-    // TODO: Implement! Parse left and right argument tree.
+  if (isError)
     return NULL;
-  }
-  else return NULL;
-}
-
-static node_t* try_parse_func(arena_t* arena, lexer_t* lexer, size_t index)
-{
-  ASSERT_NULL(arena);
-  ASSERT_NULL(lexer);
 
-  token_t* token = lex_at(lexer, index);
+  parse_reduce_group(arena, &operators, &operands);
+  assert(operators.count == 0 && operands.count == 1 && "Unbalanced expression!");
 
-  if (tok_is(token, TT_FUNCTION))
-  {
-    node_t* arg = try_parse_paren(arena, lexer, index + 1);
-    if (!arg) return NULL;
-    return node_func(arena, token->cursor, to_local_func_type(token->as.function), arg);
-  }
-  else return NULL;
-}
-
-static node_t* try_parse_paren(arena_t* arena, lexer_t* lexer, size_t index)
-{
-  ASSERT_NULL(arena);
-  ASSERT_NULL(lexer);
-
-  token_t* token = lex_at(lexer, index);
-
-  if (tok_is(token, TT_PAREN))
-  {
-    // TODO: Implement! Parse everything till the till the corresponding closing paren.
-    // Paren-Arguments can contain sub parens, functions, etc.
-    return NULL;
-  }
-  else return NULL;
+  return operands.items[0];
 }
 
 
@@ -648,44 +1048,9 @@ node_t* parser_execute(arena_t* arena, lexer_t* lexer)
   if (lexer->isError || lexer->count <= 0)
     return NULL;
 
-  printf("INFO: AST generator and parser is currently under developement.\n");
-
-  // TODO:
-  // The parser needs to reed to the next operator, paren, or func for every node.
-  // Order checking: Brackets -> Exponents -> Multiplication -> Division -> Addition -> Substraction
-  // A stack for checking nested expressions in brackets. Also if the brackets are used correctly.
-  // Paren checking: 2 Open '(' should have 2 Closing ')' after.
-  // After a constant / nubmer MUST come an operator, function, or closing paren
-  
-  if (!check_semantics(lexer))
-    return NULL;
-
   // IN: "EN + 5 / (5 * 0)"
-  // AST: "add(EN, divide(5, paren(mult(5, 0))))"
-  // Getting constants - global.h: mathConstantTypeValues[token->as.constant]
-
-  node_t* root = NULL;
-
-  /*for (size_t i = 0; i < lexer->count; ++i)
-  {
-    token_t* tok = lex_at(lexer, i);
-
-    // TODO: Implement!
-    (void) tok;
-
-    break;
-
-    switch (tok->type)
-    {
-
-      case TT_COUNT:
-      default:
-        UNREACHABLE("Invalid token-type!");
-    }
-  }*/
-
-  // TODO: Return root node!
-  return root;
+  // AST: "add(EN, divide(5, paren(multiply(5, 0))))"
+  return parse_tokens(arena, lexer);
 }
 
 
@@ -698,64 +1063,122 @@ node_t* parser_execute(arena_t* arena, lexer_t* lexer)
     } while(0)
 
 
+// Prints the node and its children with the explicit stack of 'ast_eval_node', so deeply nested
+// trees can get printed as well. 'stage' counts the children which were already printed.
 void print_node_ex(node_t* node, bool indented, size_t deph)
 {
   ASSERT_NULL(node);
 
-  switch (node->type) {
-    case NT_CONSTANT:
-    {
-      _PRINT_DEPTH_SPACES(indented, deph);
-      printf(DOUBLE_PRINT_FORMAT, node->as.constant);
-      break;
-    }
-    case NT_BINOP:
-    {
-      if (node->as.binop.type >= NO_COUNT)
-        UNREACHABLE("Invalid binop-node-type!");
-      
-      _PRINT_DEPTH_SPACES(indented, deph);
-      printf("%s(", nodeBinopTypeNames[node->as.binop.type]);
-      if (indented) printf("\n");
-      print_node_ex(node->as.binop.lhs, indented, deph + 1);
-      printf(",%s", indented ? "\n" : " ");
-      print_node_ex(node->as.binop.rhs, indented, deph + 1);
-      if (indented) printf("\n");
-      _PRINT_DEPTH_SPACES(indented, deph);
-      printf(")");
-      break;
-    }
-    case NT_FUNCTION:
-    {
-      if (node->as.func.type >= NF_COUNT)
-        UNREACHABLE("Invalid func-node-type!");
-      
-      _PRINT_DEPTH_SPACES(indented, deph);
-      printf("%s(", nodeFunctionTypeNames[node->as.func.type]);
-      bool isArgTypeConst = node->as.func.arg->type == NT_CONSTANT;
-      if (indented && !isArgTypeConst) printf("\n");
-      print_node_ex(node->as.func.arg, indented, !isArgTypeConst ? deph + 1 : 0);
-      if (indented && !isArgTypeConst) printf("\n");
-      _PRINT_DEPTH_SPACES(indented, !isArgTypeConst ? deph : 0);
-      printf(")");
-      break;
-    }
-    case NT_PAREN:
-    {
-      _PRINT_DEPTH_SPACES(indented, deph);
-      printf("paren(");
-      bool isArgTypeConst = node->as.paren.arg->type == NT_CONSTANT;
-      if (indented && !isArgTypeConst) printf("\n");
-      print_node_ex(node->as.paren.arg, indented, !isArgTypeConst ? deph + 1 : 0);
-      if (indented && !isArgTypeConst) printf("\n");
-      _PRINT_DEPTH_SPACES(indented, !isArgTypeConst ? deph : 0);
-      printf(")");
-      break;
+  walk_frame_stack_t frames;
+  walk_stack_init(&frames);
+  walk_frame_push(&frames, node, deph);
+
+  while (frames.count > 0)
+  {
+    walk_frame_t* frame = &frames.items[frames.count - 1];
+    const node_t* current = frame->node;
+    const size_t depth = frame->depth;
+    const size_t stage = frame->stage++;
+
+    switch (current->type) {
+      case NT_CONSTANT:
+      {
+        _PRINT_DEPTH_SPACES(indented, depth);
+        printf(DOUBLE_PRINT_FORMAT, current->as.constant);
+        frames.count--;
+        break;
+      }
+      case NT_BINOP:
+      {
+        if (current->as.binop.type >= NO_COUNT)
+          UNREACHABLE("Invalid binop-node-type!");
+
+        if (stage == 0)
+        {
+          _PRINT_DEPTH_SPACES(indented, depth);
+          printf("%s(", nodeBinopTypeNames[current->as.binop.type]);
+          if (indented) printf("\n");
+          walk_frame_push(&frames, current->as.binop.lhs, depth + 1);
+        }
+        else if (stage == 1)
+        {
+          printf(",%s", indented ? "\n" : " ");
+          walk_frame_push(&frames, current->as.binop.rhs, depth + 1);
+        }
+        else
+        {
+          if (indented) printf("\n");
+          _PRINT_DEPTH_SPACES(indented, depth);
+          printf(")");
+          frames.count--;
+        }
+        break;
+      }
+      case NT_FUNCTION:
+      case NT_PAREN:
+      {
+        if (current->type == NT_FUNCTION && current->as.func.type >= NF_COUNT)
+          UNREACHABLE("Invalid func-node-type!");
+
+        const node_t* arg = current->type == NT_FUNCTION ? current->as.func.arg : current->as.paren.arg;
+        bool isArgTypeConst = node_is_leaf(arg);
+
+        if (stage == 0)
+        {
+          _PRINT_DEPTH_SPACES(indented, depth);
+          printf("%s(", current->type == NT_FUNCTION ? nodeFunctionTypeNames[current->as.func.type] : "paren");
+          if (indented && !isArgTypeConst) printf("\n");
+          walk_frame_push(&frames, arg, !isArgTypeConst ? depth + 1 : 0);
+        }
+        else
+        {
+          if (indented && !isArgTypeConst) printf("\n");
+          _PRINT_DEPTH_SPACES(indented, !isArgTypeConst ? depth : 0);
+          printf(")");
+          frames.count--;
+        }
+        break;
+      }
+      case NT_VARIABLE:
+      {
+        _PRINT_DEPTH_SPACES(indented, depth);
+        if (current->as.variable.name) printf("%s", current->as.variable.name);
+        else printf("var[%zu]", current->as.variable.index);
+        frames.count--;
+        break;
+      }
+      case NT_FMA:
+      {
+        const node_t* product = current->as.fma.product;
+
+        if (stage == 0)
+        {
+          _PRINT_DEPTH_SPACES(indented, depth);
+          printf("%s(", fma_type_name(current->as.fma.flags));
+          if (indented) printf("\n");
+          walk_frame_push(&frames, product->as.binop.lhs, depth + 1);
+        }
+        else if (stage < 3)
+        {
+          printf(",%s", indented ? "\n" : " ");
+          walk_frame_push(&frames, stage == 1 ? product->as.binop.rhs : current->as.fma.addend, depth + 1);
+        }
+        else
+        {
+          if (indented) printf("\n");
+          _PRINT_DEPTH_SPACES(indented, depth);
+          printf(")");
+          frames.count--;
+        }
+        break;
+      }
+      case NT_COUNT:
+      default:
+        UNREACHABLE("Invalid node-type!");
     }
-    case NT_COUNT:
-    default:
-      UNREACHABLE("Invalid node-type!");
   }
+
+  walk_stack_free(&frames);
 }
 
 
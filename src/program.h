@@ -3,7 +3,9 @@
 
 #include "config.h"
 #include "versioning.h"
-#include "parser.h"
+#include "benchmark.h"
+#include "mathtest.h"
+#include "exprfile.h"
 
 
 // Program informations
@@ -35,6 +37,11 @@ typedef enum {
   PFF_HELP       = (1u << 2),
   PFF_VERSION    = (1u << 3),
   PFF_TEST_AST   = (1u << 4),   // TODO: Remove later! This is just for testing.
+  PFF_BENCHMARK  = (1u << 5),
+  PFF_TEST_MATH  = (1u << 6),
+  PFF_FILE       = (1u << 7),
+  PFF_FAST_MATH  = (1u << 8),
+  PFF_PRECISION  = (1u << 9),
 } e_program_function_flags;
 
 // Must be the same layout as 'e_program_function_flags'!
@@ -43,13 +50,18 @@ typedef enum {
   PFT_HELP,
   PFT_VERSION,
   PFT_TEST_AST, // TODO: Remove later! This is just for testing.
+  PFT_BENCHMARK,
+  PFT_TEST_MATH,
+  PFT_FILE,
+  PFT_FAST_MATH,
+  PFT_PRECISION,
   
   PFT_COUNT,
   PFT_EXPRESSION,
   PFT_INVALID,
 } e_program_function_type;
 
-static_assert(PFT_COUNT == 4, "Amount of program-function-types have changed");
+static_assert(PFT_COUNT == 9, "Amount of program-function-types have changed");
 
 static e_program_function_flags function_type_to_flag(e_program_function_type type)
 {
@@ -59,6 +71,11 @@ static e_program_function_flags function_type_to_flag(e_program_function_type ty
     case PFT_HELP:       return PFF_HELP;
     case PFT_VERSION:    return PFF_VERSION;
     case PFT_TEST_AST:   return PFF_TEST_AST; // TODO: Remove later! This is just for testing.
+    case PFT_BENCHMARK:  return PFF_BENCHMARK;
+    case PFT_TEST_MATH:  return PFF_TEST_MATH;
+    case PFT_FILE:       return PFF_FILE;
+    case PFT_FAST_MATH:  return PFF_FAST_MATH;
+    case PFT_PRECISION:  return PFF_PRECISION;
     case PFT_INVALID:    return PFF_ERROR;
     case PFT_COUNT:
     default:
@@ -74,6 +91,11 @@ const char* shortProgFuncTypeIdentifier[PFT_COUNT] = {
   [PFT_HELP]     = "h",
   [PFT_VERSION]  = "v",
   [PFT_TEST_AST] = "ta", // TODO: Remove later! This is just for testing.
+  [PFT_BENCHMARK] = "bm",
+  [PFT_TEST_MATH] = "tm",
+  [PFT_FILE]     = "f",
+  [PFT_FAST_MATH] = "fm",
+  [PFT_PRECISION] = "p",
 };
 
 #define LONG_PREFIX "--"
@@ -83,6 +105,11 @@ const char* longProgFuncTypeIdentifier[PFT_COUNT] = {
   [PFT_HELP]     = "help",
   [PFT_VERSION]  = "version",
   [PFT_TEST_AST] = "test-ast", // TODO: Remove later! This is just for testing.
+  [PFT_BENCHMARK] = "benchmark",
+  [PFT_TEST_MATH] = "test-math",
+  [PFT_FILE]     = "file",
+  [PFT_FAST_MATH] = "fast-math",
+  [PFT_PRECISION] = "precision",
 };
 
 // TODO: Rethink:
@@ -103,6 +130,11 @@ const char* progFuncTypeDescriptions[PFT_COUNT] = {
   [PFT_HELP]     = "Display this help and exit.",
   [PFT_VERSION]  = "Output version information and exit.",
   [PFT_TEST_AST] = "Tests the ast generation and evaluation of pre defined expressions.", // TODO: Remove later! This is just for testing.
+  [PFT_BENCHMARK] = "Run the performance benchmarks and exit.",
+  [PFT_TEST_MATH] = "Compare the vectorized math functions with libm and exit.",
+  [PFT_FILE]     = "Evaluate every line of the given FILE in parallel and exit.",
+  [PFT_FAST_MATH] = "Allow optimizations of the expression which may change the last bits of the result.",
+  [PFT_PRECISION] = "Print results with PRECISION decimal places instead of the shortest exact form.",
 };
 
 
@@ -114,6 +146,9 @@ typedef struct {
   char* programName;
   char** argv;
   char* inputExpression;
+  char* inputFile;
+  // Decimal places of the printed results or 'NUMBER_FORMAT_SHORTEST'.
+  int precision;
 } program_t;
 
 
@@ -159,6 +194,8 @@ static inline void program_init(program_t* prog, int argc, char** argv)
   prog->argc = --argc;
   prog->argv = ++argv;
   prog->inputExpression = NULL;
+  prog->inputFile = NULL;
+  prog->precision = NUMBER_FORMAT_SHORTEST;
 }
 
 
@@ -166,6 +203,31 @@ static inline void program_set_error(program_t* prog)
 {
   prog->funcFlags = PFF_ERROR;
   prog->inputExpression = NULL;
+  prog->inputFile = NULL;
+  prog->precision = NUMBER_FORMAT_SHORTEST;
+}
+
+
+// Parses the argument of the precision flag. Returns 'NUMBER_FORMAT_SHORTEST' if it is not a number
+// between 0 and 'NUMBER_FORMAT_MAX_PRECISION'.
+static int cstr_to_precision(const char* cstr)
+{
+  size_t len = strlen(cstr);
+
+  if (len == 0 || len > 2)
+    return NUMBER_FORMAT_SHORTEST;
+
+  int precision = 0;
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    if (!isdigit(cstr[i]))
+      return NUMBER_FORMAT_SHORTEST;
+
+    precision = precision * 10 + (cstr[i] - '0');
+  }
+
+  return precision <= NUMBER_FORMAT_MAX_PRECISION ? precision : NUMBER_FORMAT_SHORTEST;
 }
 
 
@@ -174,8 +236,8 @@ static inline void program_set_error(program_t* prog)
 static void print_usage(e_program_function_flags flags, const char* programName, int argc, char** argv);
 static void print_help(const char* programName);
 static void print_current_version(const char* programName);
-static bool handle_math_input(const char* input, bool verbose);
-static void test_ast_eval();
+static bool handle_math_input(const char* input, e_optimizer_flags optimizerFlags, int precision, bool verbose);
+static bool test_ast_eval();
 
 
 
@@ -221,6 +283,36 @@ program_t validate_cli_input(int argc, char** argv)
     if (flag == PFF_EXPRESSION)
       prog.inputExpression = *currentArgv;
 
+    // The file flag takes the next argument as the path of the file.
+    if (flag == PFF_FILE)
+    {
+      if (++i >= prog.argc)
+      {
+        program_set_error(&prog);
+        break;
+      }
+
+      prog.inputFile = *(++currentArgv);
+    }
+
+    // The precision flag takes the next argument as the amount of decimal places.
+    if (flag == PFF_PRECISION)
+    {
+      if (++i >= prog.argc)
+      {
+        program_set_error(&prog);
+        break;
+      }
+
+      prog.precision = cstr_to_precision(*(++currentArgv));
+
+      if (prog.precision == NUMBER_FORMAT_SHORTEST)
+      {
+        program_set_error(&prog);
+        break;
+      }
+    }
+
     currentArgv++;
   }
 
@@ -230,12 +322,24 @@ program_t validate_cli_input(int argc, char** argv)
 
 int handle_program(program_t* program)
 {
+  // Fast math only changes how expressions get optimized and the precision how the results get
+  // printed, so both can only be combined with an expression or a file.
+  const bool fastMath = is_bit_set(program->funcFlags, PFF_FAST_MATH);
+  const bool precision = is_bit_set(program->funcFlags, PFF_PRECISION);
+  const e_program_function_flags modeFlags = program->funcFlags & ~(PFF_FAST_MATH | PFF_PRECISION);
+  const e_optimizer_flags optimizerFlags = fastMath ? OPT_FAST_MATH : OPT_DEFAULT;
+
   // Checking for invalid usage.
   if (program->funcFlags == PFF_ERROR ||
-      is_only_bit_set(program->funcFlags, PFF_VERBOSE) ||
-      is_not_only_bit_set(program->funcFlags, PFF_HELP) ||
-      is_not_only_bit_set(program->funcFlags, PFF_VERSION) ||
-      is_not_only_bit_set(program->funcFlags, PFF_TEST_AST)) // TODO: Remove later! Just for testing.
+      (fastMath && !is_bit_set(modeFlags, (PFF_EXPRESSION | PFF_FILE))) ||
+      (precision && !is_bit_set(modeFlags, (PFF_EXPRESSION | PFF_FILE))) ||
+      is_only_bit_set(modeFlags, PFF_VERBOSE) ||
+      is_not_only_bit_set(modeFlags, PFF_HELP) ||
+      is_not_only_bit_set(modeFlags, PFF_VERSION) ||
+      is_not_only_bit_set(modeFlags, PFF_TEST_AST) || // TODO: Remove later! Just for testing.
+      is_not_only_bit_set(modeFlags, PFF_BENCHMARK) ||
+      is_not_only_bit_set(modeFlags, PFF_TEST_MATH) ||
+      is_not_only_bit_set(modeFlags, PFF_FILE))
   {
     print_usage(program->funcFlags, program->programName, program->argc, program->argv);
     return EXIT_FAILURE;
@@ -258,17 +362,36 @@ int handle_program(program_t* program)
   // TODO: Remove later! Just for testing.
   if (is_only_bit_set(program->funcFlags, PFF_TEST_AST))
   {
-    test_ast_eval();
+    return test_ast_eval() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  // Checking if the benchmarks should run.
+  if (is_only_bit_set(program->funcFlags, PFF_BENCHMARK))
+  {
+    run_benchmarks();
     return EXIT_SUCCESS;
   }
 
+  // Checking if the math tests should run.
+  if (is_only_bit_set(program->funcFlags, PFF_TEST_MATH))
+    return run_math_tests() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+  // Checking if every line of a file should get evaluated.
+  if (is_only_bit_set(modeFlags, PFF_FILE))
+  {
+    change_global_program_mode(GPM_EXPRESSION_FILE);
+
+    bool success = handle_expression_file(program->inputFile, optimizerFlags, program->precision);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
   // Checking if an expression should get executed and if it should be verbose.
   if (is_bit_set(program->funcFlags, PFF_EXPRESSION))
   {
     // TODO: Rethink! Changes to the simple expression eval mode with limited features.
     change_global_program_mode(GPM_SINGLE_CLI_EXPRESSION_ARG);
 
-    bool success = handle_math_input(program->inputExpression, is_bit_set(program->funcFlags, PFF_VERBOSE));
+    bool success = handle_math_input(program->inputExpression, optimizerFlags, program->precision, is_bit_set(program->funcFlags, PFF_VERBOSE));
     return success ? EXIT_SUCCESS : EXIT_FAILURE;
   }
 
@@ -278,54 +401,25 @@ int handle_program(program_t* program)
 
 
 // All programs functions.
-static bool handle_math_input(const char* input, bool verbose)
+static bool handle_math_input(const char* input, e_optimizer_flags optimizerFlags, int precision, bool verbose)
 {
   arena_t arena = {0};
+  double result = 0;
 
   if (verbose)
     printf("Executing VERBOSE:\n");
 
-  tokenizer_t tokenizer = tokenizer_execute(&arena, input);
-  
-  if (tokenizer.isError) {
-    arena_free(&arena);
-    return false;
-  }
-
-  if (verbose)
-    tokenizer_print(&tokenizer);
-  
-  lexer_t lexer = lexer_execute(&arena, &tokenizer);
-
-  if (lexer.isError) {
-    arena_free(&arena);
-    return false;
-  }
-
-  if (verbose)
-    lexer_print(&lexer);
-
-  node_t* rootNode = parser_execute(&arena, &lexer);
-
-  if (!rootNode) {
-    arena_free(&arena);
-    return false;
-  }
-
-  if (verbose)
-    print_node(rootNode, true);
+  bool success = expression_evaluate(&arena, input, optimizerFlags, verbose, &result);
 
-  node_t* evaluatedNode = ast_eval(&arena, rootNode);
-  
-  if (!evaluatedNode) {
-    arena_free(&arena);
-    return false;
+  if (success)
+  {
+    char formatted[NUMBER_FORMAT_BUFFER_SIZE];
+    expression_format_result(result, precision, formatted);
+    printf("Result = %s\n", formatted);
   }
 
-  printf("Result = " DOUBLE_PRINT_FORMAT "\n", evaluatedNode->as.constant);
-
   arena_free(&arena);
-  return true;
+  return success;
 }
 
 
@@ -351,6 +445,24 @@ static void print_usage(e_program_function_flags flags, const char* programName,
     fprintf(stderr, "  Usage: '" IDENTIFIER_STRING_ARGS " EXPRESSION' or '" IDENTIFIER_STRING_ARGS " EXPRESSION'\n", short_full_identifier(PFT_VERBOSE), long_full_identifier(PFT_VERBOSE));
   }
 
+  if (is_bit_set(flags, PFF_FILE))
+  {
+    fprintf(stderr, "Expression file:\n");
+    fprintf(stderr, "  Usage: '" IDENTIFIER_STRING_ARGS " FILE' or '" IDENTIFIER_STRING_ARGS " FILE'\n", short_full_identifier(PFT_FILE), long_full_identifier(PFT_FILE));
+  }
+
+  if (is_bit_set(flags, PFF_PRECISION))
+  {
+    fprintf(stderr, "Precision:\n");
+    fprintf(stderr, "  Usage: '" IDENTIFIER_STRING_ARGS " PRECISION EXPRESSION' or '" IDENTIFIER_STRING_ARGS " PRECISION " IDENTIFIER_STRING_ARGS " FILE' with a PRECISION between 0 and %d\n", short_full_identifier(PFT_PRECISION), short_full_identifier(PFT_PRECISION), short_full_identifier(PFT_FILE), NUMBER_FORMAT_MAX_PRECISION);
+  }
+
+  if (is_bit_set(flags, PFF_FAST_MATH))
+  {
+    fprintf(stderr, "Fast math:\n");
+    fprintf(stderr, "  Usage: '" IDENTIFIER_STRING_ARGS " EXPRESSION' or '" IDENTIFIER_STRING_ARGS " " IDENTIFIER_STRING_ARGS " FILE'\n", short_full_identifier(PFT_FAST_MATH), long_full_identifier(PFT_FAST_MATH), short_full_identifier(PFT_FILE));
+  }
+
   fprintf(stderr, "'%s " IDENTIFIER_STRING_ARGS "' or '" IDENTIFIER_STRING_ARGS "' for more information.\n", programName, long_full_identifier(PFT_HELP), short_full_identifier(PFT_HELP));
 }
 
@@ -419,281 +531,1492 @@ static void print_current_version(const char* programName)
 
 
 // INFO: Just for testing! Remove later!
-static void test_ast_eval()
+// Every failed check gets counted, so '-ta' can fail with the exit code.
+static size_t testErrorCount = 0;
+
+#define TEST_ERROR(...) (testErrorCount++, printf("ERROR: " __VA_ARGS__))
+
+// The packed tokens are compared as a whole and the numbers of the pools bitwise.
+static bool test_same_tokens(const lexer_t* a, const lexer_t* b)
 {
-  arena_t arena = {0};
-  bool freeAfterEachTest = false;
+  if (a->isError != b->isError || a->count != b->count || a->numberCount != b->numberCount)
+    return false;
 
-  printf("AST testing:\n\n");
+  if (a->count > 0 && memcmp(a->items, b->items, a->count * sizeof(token_t)) != 0)
+    return false;
 
-  // TEST 1
-  printf("Test 1:\n");
+  for (size_t i = 0; i < a->numberCount; ++i)
   {
-    // IN: "1 + 2 + (PI ^ 2) / 3"
-    // AST: add(1.00000, add(2.00000, divide(paren(pow(3.14159, 2.00000)), 3.00000)))
-    // = 6,28986
-    node_t* test =
-      node_binop(&arena, 0, NO_ADD,
-        node_constant(&arena, 0, 1),
-        node_binop(&arena, 0, NO_ADD,
-          node_constant(&arena, 0, 2),
-          node_binop(&arena, 0, NO_DIV,
-            node_paren(&arena, 0,
-              node_binop(&arena, 0, NO_POW,
-                node_constant(&arena, 0, mathConstantTypeValues[MC_PI]),
-                node_constant(&arena, 0, 2)
-              )
-            ),
-            node_constant(&arena, 0, 3)
-          )
-        )
-      );
+    double x = lex_number(a, i);
+    double y = lex_number(b, i);
 
-    printf("Input = 1 + 2 + (PI ^ 2) / 3\n");
-    print_node(test, true);
-    
-    node_t* evaluated = ast_eval(&arena, test);
-    if (evaluated)
-      printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated->as.constant);
+    if (memcmp(&x, &y, sizeof(double)) != 0)
+      return false;
+  }
+
+  return true;
+}
 
-    printf("\n");
+static void test_eval_node(arena_t* arena, const char* input, node_t* test)
+{
+  printf("Input = %s\n", input);
+  print_node(test, true);
 
-    if (freeAfterEachTest)
-      arena_free(&arena);
+  bytecode_t bytecode = compiler_execute(arena, test);
+  bytecode_print(&bytecode);
+
+  eval_status_t status;
+  double evaluated = ast_eval_value(test, NULL, &status);
+  
+  if (eval_status_is_error(&status)) {
+    E_ERROR_STATUS(&status);
   }
+  else
+    printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated);
 
+  // The node pool must behave exactly like the tree evaluator.
+  ast_pool_t pool = ast_pool_from_node(arena, test);
+  eval_status_t poolStatus;
+  double poolEvaluated = ast_pool_eval(&pool, NULL, &poolStatus);
 
-  // TEST 2
-  printf("Test 2:\n");
-  {
-    // IN: "ln(10)"
-    // AST: ln(10)
-    // = 2.30258
-    node_t* test =
-      node_func(&arena, 0, NF_LN,
-        node_constant(&arena, 0, 10));
-    
-    printf("Input = ln(10)\n");
-    print_node(test, true);
-    
-    node_t* evaluated = ast_eval(&arena, test);
-    if (evaluated)
-      printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated->as.constant);
+  if (poolStatus.type != status.type || poolStatus.cursor != status.cursor ||
+      (!eval_status_is_error(&status) && poolEvaluated != evaluated))
+    TEST_ERROR("The AST pool result (" DOUBLE_PRINT_FORMAT ") differs from the AST result!\n", poolEvaluated);
 
-    printf("\n");
+  // The vm must behave exactly like the tree evaluator.
+  eval_status_t vmStatus;
+  double vmEvaluated = vm_execute(&bytecode, NULL, &vmStatus);
 
-    if (freeAfterEachTest)
-      arena_free(&arena);
-  }
+  if (vmStatus.type != status.type || vmStatus.cursor != status.cursor ||
+      (!eval_status_is_error(&status) && vmEvaluated != evaluated))
+    TEST_ERROR("The vm result (" DOUBLE_PRINT_FORMAT ") differs from the AST result!\n", vmEvaluated);
 
+  jit_code_t jit = jit_compile(arena, &bytecode);
+  eval_status_t jitStatus;
+  double jitEvaluated = jit_execute(&jit, NULL, &jitStatus);
+  jit_free(&jit);
 
-  // TEST 3
-  printf("Test 3:\n");
-  {
-    // IN: "100.53 + sqrt(3.5 - EN) + cos(44.23 * 6.4^2) / 8.3 + ln(10) - PI + ln(5^EC)"
-    // AST: add(100.53000, add(sqrt(substract(3.50000, 2.71828)), add(divide(acos(multiply(44.23000, pow(6.40000, 2.00000))), 8.30000), substract(ln(10.00000), add(3.14159, ln(pow(5.00000, 0.57722)))))))
-    // = 317.91853
-    node_t* test =
-      node_binop(&arena, 0, NO_ADD,
-        node_constant(&arena, 0, 100.53),
-        node_binop(&arena, 0, NO_ADD,
-          node_func(&arena, 0, NF_SQRT,
-            node_binop(&arena, 0, NO_SUB,
-              node_constant(&arena, 0, 3.5),
-              node_constant(&arena, 0, mathConstantTypeValues[MC_EULERS_NUMBER])
-            )
-          ),
-          node_binop(&arena, 0, NO_ADD,
-            node_binop(&arena, 0, NO_DIV,
-              node_func(&arena, 0, NF_COS,
-                node_binop(&arena, 0, NO_MUL,
-                  node_constant(&arena, 0, 44.23),
-                  node_binop(&arena, 0, NO_POW,
-                    node_constant(&arena, 0, 6.4),
-                    node_constant(&arena, 0, 2)
-                  )
-                )
-              ),
-              node_constant(&arena, 0, 8.3)
-            ),
-            node_binop(&arena, 0, NO_SUB,
-              node_func(&arena, 0, NF_LN,
-                node_constant(&arena, 0, 10)
-              ),
-              node_binop(&arena, 0, NO_ADD,
-                node_constant(&arena, 0, mathConstantTypeValues[MC_PI]),
-                node_func(&arena, 0, NF_LN,
-                  node_binop(&arena, 0, NO_POW,
-                    node_constant(&arena, 0, 5),
-                    node_constant(&arena, 0, mathConstantTypeValues[MC_EULERS_CONSTANT])
-                  )
-                )
-              )
-            )
-          )
-        )
-      );
+  if (jitStatus.type != status.type || jitStatus.cursor != status.cursor ||
+      (!eval_status_is_error(&status) && jitEvaluated != evaluated))
+    TEST_ERROR("The jit result (" DOUBLE_PRINT_FORMAT ") differs from the AST result!\n", jitEvaluated);
 
-    printf("Input = 100.53 + sqrt(3.5 - EN) + cos(44.23 * 6.4^2) / 8.3 + ln(10) - PI + ln(5^EC)\n");
-    print_node(test, true);
-    
-    node_t* evaluated = ast_eval(&arena, test);
-    if (evaluated)
-      printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated->as.constant);
+  // The parsed input must give the same result. The trees above group equal operators from the
+  // right, so the result may differ by a few ULP.
+  tokenizer_t tokenizer = tokenizer_execute(arena, input);
+  lexer_t lexer = lexer_execute(arena, &tokenizer);
+  lexer_t scanned = lexer_scan(arena, input);
 
-    printf("\n");
+  if (!test_same_tokens(&lexer, &scanned))
+    TEST_ERROR("The scanned tokens differ from the lexed tokens!\n");
 
-    if (freeAfterEachTest)
-      arena_free(&arena);
-  }
+  node_t* parsed = parser_execute(arena, &scanned);
 
+  eval_status_t parsedStatus;
+  double parsedEvaluated = parsed ? ast_eval_value(parsed, NULL, &parsedStatus) : NAN;
 
-  // TEST 4
-  printf("Test 4:\n");
+  if (!parsed || parsedStatus.type != status.type ||
+      (!eval_status_is_error(&status) && mathtest_ulp_distance(parsedEvaluated, evaluated) > 4))
+    TEST_ERROR("The result of the parsed input (" DOUBLE_PRINT_FORMAT ") differs from the AST result!\n", parsedEvaluated);
+
+  // Folding the constants must not change the result or the error.
+  if (parsed)
   {
-    // IN: "10.5 * exp(4)"
-    // AST: mult(10.5, exp(4))
-    // = 573.28058
-    node_t* test =
-      node_binop(&arena, 0, NO_MUL,
-        node_constant(&arena, 0, 10.5),
-        node_func(&arena, 0, NF_EXP,
-          node_constant(&arena, 0, 4)
-        )
-      );
-    
-    printf("Input = 10.5 * exp(4)\n");
-    print_node(test, true);
-    
-    node_t* evaluated = ast_eval(&arena, test);
-    if (evaluated)
-      printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated->as.constant);
+    optimizer_stats_t stats = optimizer_execute(arena, parsed, OPT_DEFAULT);
 
-    printf("\n");
+    eval_status_t foldedStatus;
+    double foldedEvaluated = ast_eval_value(parsed, NULL, &foldedStatus);
 
-    if (freeAfterEachTest)
-      arena_free(&arena);
+    if (foldedStatus.type != parsedStatus.type || foldedStatus.cursor != parsedStatus.cursor ||
+        (!eval_status_is_error(&parsedStatus) && !bench_same_result(foldedEvaluated, parsedEvaluated)))
+      TEST_ERROR("The result of the optimized AST (" DOUBLE_PRINT_FORMAT ") differs from the parsed AST!\n", foldedEvaluated);
+    else
+      optimizer_print_stats(&stats);
   }
 
+  printf("\n");
+}
 
-  // TEST 5
-  printf("Test 5:\n");
-  {
-    // IN: "10 + 5 / (5 * 0)"
-    // AST: "add(10, divide(5, paren(mult(5, 0))))"
-    // = ERR (Divide by Zero)
-    node_t* test =
-      node_binop(&arena, 3, NO_ADD,
-        node_constant(&arena, 0, 10),
-        node_binop(&arena, 6, NO_DIV,
-          node_constant(&arena, 4, 5),
-          node_paren(&arena, 8,
-            node_binop(&arena, 10, NO_MUL,
-              node_constant(&arena, 9, 5),
-              node_constant(&arena, 11, 0)
-            )
-          )
-        )
-      );
+// Compares bitwise if no ULP distance is allowed, so '0' and '-0' are different.
+static bool test_close_result(double a, double b, uint64_t maxUlp)
+{
+  return maxUlp == 0 ? bench_same_result(a, b) : mathtest_ulp_distance(a, b) <= maxUlp;
+}
 
-    printf("Input = 10 + 5 / (5 * 0)\n");
-    print_node(test, true);
+// The batch evaluation must behave exactly like evaluating every row alone. Afterwards the tree gets
+// optimized with the given passes.
+static void test_batch_node(arena_t* arena, const char* input, node_t* test, e_optimizer_flags optimizerFlags, const double* const* columns, size_t variableCount, size_t rowCount)
+{
+  printf("Input = %s\n", input);
+  print_node(test, true);
 
-    node_t* evaluated = ast_eval(&arena, test);
-    if (evaluated)
-      printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated->as.constant);
+  bytecode_t bytecode = compiler_execute(arena, test);
+  bytecode_print(&bytecode);
 
-    printf("\n");
+  batch_t batch = batch_compile(arena, &bytecode);
+  double* results = arena_alloc(arena, rowCount * sizeof(double));
+  eval_status_t* statuses = arena_alloc(arena, rowCount * sizeof(eval_status_t));
+  double* variables = arena_alloc(arena, variableCount * sizeof(double));
 
-    if (freeAfterEachTest)
-      arena_free(&arena);
-  }
+  size_t failed = batch_execute(&batch, columns, rowCount, results, statuses);
+  size_t vmFailed = 0;
 
-  
-  // TEST 6
-  printf("Test 6:\n");
+  for (size_t r = 0; r < rowCount; ++r)
   {
-    // IN: "(5 * 0)"
-    // AST: "paren(mult(5, 0))"
-    // = 5
-    node_t* test =
-      node_paren(&arena, 0,
-        node_binop(&arena, 0, NO_MUL,
-          node_constant(&arena, 0, 5),
-          node_constant(&arena, 0, 0)
-        )
-      );
+    for (size_t v = 0; v < variableCount; ++v)
+      variables[v] = columns[v][r];
 
-    printf("Input = (5 * 0)\n");
-    print_node(test, true);
+    printf("Row %zu:\n", r);
 
-    node_t* evaluated = ast_eval(&arena, test);
-    if (evaluated)
-      printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated->as.constant);
+    if (eval_status_is_error(&statuses[r])) {
+      E_ERROR_STATUS(&statuses[r]);
+    }
+    else
+      printf("= " DOUBLE_PRINT_FORMAT "\n", results[r]);
 
-    printf("\n");
+    eval_status_t vmStatus;
+    double vmEvaluated = vm_execute(&bytecode, variables, &vmStatus);
 
-    if (freeAfterEachTest)
-      arena_free(&arena);
+    if (eval_status_is_error(&vmStatus))
+      vmFailed++;
+
+    // The vectorized functions may differ from libm by a few ULP.
+    if (vmStatus.type != statuses[r].type || vmStatus.cursor != statuses[r].cursor ||
+        (!eval_status_is_error(&vmStatus) && mathtest_ulp_distance(vmEvaluated, results[r]) > 4))
+      TEST_ERROR("The batch result of row %zu differs from the vm result (" DOUBLE_PRINT_FORMAT ")!\n", r, vmEvaluated);
   }
 
+  if (failed != vmFailed)
+    TEST_ERROR("The batch reported %zu failed rows instead of %zu!\n", failed, vmFailed);
 
-  // TEST 7
-  printf("Test 7:\n");
+  // The optimized AST is a DAG if sub trees were merged. Its bytecode must give the same errors and
+  // exactly the same results, except if passes were selected which may change the last bits.
+  optimizer_stats_t stats = optimizer_execute(arena, test, optimizerFlags);
+  uint64_t maxUlp = is_bit_set(optimizerFlags, OPT_VALUE_CHANGING) ? 16 : 0;
+  optimizer_print_stats(&stats);
+
+  bytecode_t optimized = compiler_execute(arena, test);
+  bytecode_print(&optimized);
+
+  batch_t optimizedBatch = batch_compile(arena, &optimized);
+  double* optimizedResults = arena_alloc(arena, rowCount * sizeof(double));
+  eval_status_t* optimizedStatuses = arena_alloc(arena, rowCount * sizeof(eval_status_t));
+  batch_execute(&optimizedBatch, columns, rowCount, optimizedResults, optimizedStatuses);
+
+  jit_code_t jit = jit_compile(arena, &optimized);
+
+  for (size_t r = 0; r < rowCount; ++r)
   {
-    // IN: "10 / 0"
-    // AST: "div(10, 0)"
-    // = ERR (Divide by Zero)
-    node_t* test =
-      node_binop(&arena, 2, NO_DIV,
-        node_constant(&arena, 0, 10),
-        node_constant(&arena, 4, 0)
-      );
+    for (size_t v = 0; v < variableCount; ++v)
+      variables[v] = columns[v][r];
 
-    printf("Input = 10 / 0\n");
-    print_node(test, true);
+    eval_status_t vmStatus;
+    double vmEvaluated = vm_execute(&bytecode, variables, &vmStatus);
 
-    node_t* evaluated = ast_eval(&arena, test);
-    if (evaluated)
-      printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated->as.constant);
+    eval_status_t optimizedStatus;
+    double optimizedEvaluated = vm_execute(&optimized, variables, &optimizedStatus);
 
-    printf("\n");
+    eval_status_t poolStatus;
+    ast_pool_t pool = ast_pool_from_node(arena, test);
+    double poolEvaluated = ast_pool_eval(&pool, variables, &poolStatus);
 
-    if (freeAfterEachTest)
-      arena_free(&arena);
+    eval_status_t jitStatus;
+    double jitEvaluated = jit_execute(&jit, variables, &jitStatus);
+
+    if (optimizedStatus.type != vmStatus.type || optimizedStatus.cursor != vmStatus.cursor ||
+        (!eval_status_is_error(&vmStatus) && !test_close_result(optimizedEvaluated, vmEvaluated, maxUlp)))
+      TEST_ERROR("The optimized vm result of row %zu (" DOUBLE_PRINT_FORMAT ") differs from the vm result!\n", r, optimizedEvaluated);
+
+    if (poolStatus.type != vmStatus.type || poolStatus.cursor != vmStatus.cursor ||
+        (!eval_status_is_error(&vmStatus) && !test_close_result(poolEvaluated, vmEvaluated, maxUlp)))
+      TEST_ERROR("The optimized AST pool result of row %zu (" DOUBLE_PRINT_FORMAT ") differs from the vm result!\n", r, poolEvaluated);
+
+    if (jitStatus.type != vmStatus.type || jitStatus.cursor != vmStatus.cursor ||
+        (!eval_status_is_error(&vmStatus) && !test_close_result(jitEvaluated, vmEvaluated, maxUlp)))
+      TEST_ERROR("The optimized jit result of row %zu (" DOUBLE_PRINT_FORMAT ") differs from the vm result!\n", r, jitEvaluated);
+
+    if (optimizedStatuses[r].type != statuses[r].type || optimizedStatuses[r].cursor != statuses[r].cursor ||
+        (!eval_status_is_error(&statuses[r]) && !test_close_result(optimizedResults[r], results[r], maxUlp)))
+      TEST_ERROR("The optimized batch result of row %zu differs from the batch result!\n", r);
   }
 
+  jit_free(&jit);
+  printf("\n");
+}
 
-  // TEST 8
-  printf("Test 8:\n");
+// Every keyword must be found by its full identifier and never by a shorter prefix, which
+// catches stale perfect hash tables in 'global.h'.
+static void test_keyword_lookup()
+{
+  printf("Keywords:\n");
+
+  for (size_t i = 0; i < MC_COUNT; ++i)
   {
-    // IN: "10 / (4)"
-    // AST: "div(10, paren(4))"
-    // = 2.5
-    node_t* test =
-      node_binop(&arena, 2, NO_DIV,
-        node_constant(&arena, 0, 10),
-        node_paren(&arena, 4,
-          node_constant(&arena, 5, 4)
-        )
-      );
+    const char* identifier = mathConstantTypeIdentifiers[i];
+    const size_t len = strlen(identifier);
 
-    printf("Input = 10 / (4)\n");
-    print_node(test, true);
+    if (cstr_to_math_constant_type_ex(identifier, len) != (e_math_constant_type) i)
+      TEST_ERROR("The math-constant '%s' was not found!\n", identifier);
+
+    for (size_t l = 1; l < len; ++l)
+      if (cstr_to_math_constant_type_ex(identifier, l) == (e_math_constant_type) i)
+        TEST_ERROR("The math-constant '%s' was found by the prefix '%.*s'!\n", identifier, (int) l, identifier);
+  }
 
-    node_t* evaluated = ast_eval(&arena, test);
-    if (evaluated)
-      printf("= " DOUBLE_PRINT_FORMAT "\n", evaluated->as.constant);
+  for (size_t i = 0; i < FT_COUNT; ++i)
+  {
+    const char* identifier = functionTypeIdentifiers[i];
+    const size_t len = strlen(identifier);
 
-    printf("\n");
+    if (cstr_to_function_type_ex(identifier, len) != (e_function_type) i)
+      TEST_ERROR("The function '%s' was not found!\n", identifier);
 
-    if (freeAfterEachTest)
-      arena_free(&arena);
+    for (size_t l = 1; l < len; ++l)
+      if (cstr_to_function_type_ex(identifier, l) == (e_function_type) i)
+        TEST_ERROR("The function '%s' was found by the prefix '%.*s'!\n", identifier, (int) l, identifier);
   }
 
+  printf("\n");
+}
 
-  if (!freeAfterEachTest)
-    arena_free(&arena);
+// Enough variables that the hash table of the list gets rebuilt a few times.
+static void test_variable_lookup()
+{
+  enum { variableCount = 100 };
+
+  arena_t arena = {0};
+  variable_list_t variables = {0};
+
+  printf("Variables:\n");
+
+  for (size_t i = 0; i < variableCount; ++i)
+  {
+    char* name = arena_alloc(&arena, 8);
+    snprintf(name, 8, "v%zu", i);
+
+    if (variable_list_add(&arena, &variables, name) != i)
+      TEST_ERROR("The variable '%s' didn't get the next slot!\n", name);
+  }
+
+  for (size_t i = 0; i < variableCount; ++i)
+  {
+    const char* name = variables.items[i];
+    const size_t len = strlen(name);
+
+    if (variable_list_find(&variables, name, len) != i || variable_list_add(&arena, &variables, name) != i)
+      TEST_ERROR("The variable '%s' was not found in its slot!\n", name);
+
+    // 'v1' is a prefix of 'v10', but must not be found by it.
+    if (len > 2 && variable_list_find(&variables, name, len - 1) == i)
+      TEST_ERROR("The variable '%s' was found by the prefix '%.*s'!\n", name, (int) len - 1, name);
+  }
+
+  if (variables.count != variableCount || variable_list_find(&variables, "v100", 4) != VARIABLE_INVALID)
+    TEST_ERROR("The variable list has %zu variables instead of %d!\n", variables.count, variableCount);
+
+  // Both lexers must find the variables and keep the keywords.
+  const char* input = "v1 + v10 * sin(v99) - PI";
+  tokenizer_t tokenizer = tokenizer_execute(&arena, input);
+  lexer_t lexer = lexer_execute_ex(&arena, &tokenizer, &variables);
+  lexer_t scanned = lexer_scan_ex(&arena, input, &variables);
+
+  if (!test_same_tokens(&lexer, &scanned) || scanned.count != 10 || tok_variable(&scanned.items[0]) != 1 ||
+      tok_variable(&scanned.items[2]) != 10 || tok_variable(&scanned.items[6]) != 99 || tok_not(&scanned.items[9], TT_MATH_CONSTANT))
+    TEST_ERROR("The variables of '%s' were not lexed!\n", input);
+
+  arena_free(&arena);
+  printf("\n");
+}
+
+// The char-classes of the scanner must split the input like the tokenizer.
+static void test_char_classes()
+{
+  printf("Char-classes:\n");
+
+  for (int c = 1; c < 256; ++c)
+  {
+    e_char_class expected = isspace(c)                   ? CC_SPACE
+                          : isdigit(c)                   ? CC_DIGIT
+                          : c_is_decimal_seperator(c)    ? CC_DECIMAL_SEPERATOR
+                          : c_is_operator((char) c)       ? CC_OPERATOR
+                          : c_is_paren((char) c)          ? CC_PAREN
+                          : c_is_common_literal((char) c) ? CC_COMMON_LITERAL
+                          : CC_SYMBOL;
+
+    int expectedType = expected == CC_OPERATOR       ? (int) char_to_operator_type((char) c)
+                     : expected == CC_PAREN          ? (int) char_to_paren_type((char) c)
+                     : expected == CC_COMMON_LITERAL ? (int) char_to_common_literal_type((char) c)
+                     : 0;
+
+    if (char_class(c) != expected || charClassTable[c].type != expectedType)
+      TEST_ERROR("The char-class of the character %d is wrong!\n", c);
+  }
+
+  printf("\n");
+}
+
+// Compares the number parser with 'strtod' on a few hard cases, random digit strings, the exact
+// decimal values of random doubles and the exact halfway points between two doubles.
+static void test_number_parse_case(const char* cstr)
+{
+  double parsed;
+  double expected = strtod(cstr, NULL);
+
+  if (!number_parse(cstr, strlen(cstr), &parsed) || memcmp(&parsed, &expected, sizeof(double)) != 0)
+    TEST_ERROR("The number '%.60s' got parsed as %.17g instead of %.17g!\n", cstr, parsed, expected);
+}
+
+// Both lexers and the parser must keep the full double, no float or other rounding on the way.
+static void test_lexed_number(arena_t* arena, const char* cstr)
+{
+  double expected = strtod(cstr, NULL);
+
+  tokenizer_t tokenizer = tokenizer_execute(arena, cstr);
+  lexer_t lexer = lexer_execute(arena, &tokenizer);
+  lexer_t scanned = lexer_scan(arena, cstr);
+  const lexer_t* lexers[] = { &lexer, &scanned };
+
+  for (size_t l = 0; l < ARRAY_LEN(lexers); ++l)
+  {
+    const lexer_t* lexed = lexers[l];
+
+    if (lexed->isError || lexed->count == 0 || tok_type(&lexed->items[0]) != TT_NUMBER ||
+        memcmp(&tok_number(lexed, &lexed->items[0]), &expected, sizeof(double)) != 0)
+      TEST_ERROR("The number '%.60s' got lexed as %.17g instead of %.17g!\n", cstr,
+                 lexed->count > 0 && tok_type(&lexed->items[0]) == TT_NUMBER ? tok_number(lexed, &lexed->items[0]) : NAN, expected);
+  }
+
+  node_t* parsed = parser_execute(arena, &scanned);
+
+  if (!parsed || parsed->type != NT_CONSTANT || memcmp(&parsed->as.constant, &expected, sizeof(double)) != 0)
+    TEST_ERROR("The number '%.60s' got parsed into the AST as %.17g instead of %.17g!\n", cstr,
+               parsed && parsed->type == NT_CONSTANT ? parsed->as.constant : NAN, expected);
+}
+
+static void test_number_parsing()
+{
+  static const char* cases[] = {
+    "0", "00", "0.0", ".5", "5.", "0.1", "0.3", "123.456", "9007199254740992", "9007199254740993",
+    "9007199254740995", "18446744073709551615", "18446744073709551616", "99999999999999999999",
+    "1.00000000000000011102230246251565404236316680908203125",
+    "1.00000000000000011102230246251565404236316680908203126",
+    "0.000000000000000000000000000000000000000000000000000000000000000000000000001",
+    "7.2057594037927933", "0.1000000000000000055511151231257827021181583404541015625",
+  };
+
+  // Long enough for the exact decimal value of every double.
+  static char buffer[1200];
+  uint32_t state = 7;
+
+  printf("Number parsing:\n");
+
+  arena_t arena = {0};
+
+  for (size_t i = 0; i < ARRAY_LEN(cases); ++i)
+  {
+    test_number_parse_case(cases[i]);
+    test_lexed_number(&arena, cases[i]);
+  }
+
+  arena_free(&arena);
+
+  for (size_t i = 0; i < 20000; ++i)
+  {
+    size_t length = 1 + bench_random(&state) % 40;
+    size_t seperator = bench_random(&state) % (length + 4);
+
+    for (size_t d = 0; d < length; ++d)
+      buffer[d] = (char) ('0' + bench_random(&state) % 10);
+    buffer[length] = '\0';
+
+    if (seperator <= length)
+    {
+      memmove(buffer + seperator + 1, buffer + seperator, length - seperator + 1);
+      buffer[seperator] = _DECIMAL_SEPERATOR_CHARACTER;
+    }
+
+    test_number_parse_case(buffer);
+  }
+
+  for (size_t i = 0; i < 2000; ++i)
+  {
+    uint64_t bits = ((uint64_t) bench_random(&state) << 48) ^ ((uint64_t) bench_random(&state) << 32) ^
+                    ((uint64_t) bench_random(&state) << 16) ^ (uint64_t) bench_random(&state);
+    double value;
+    bits &= ~(1ull << 63);
+    memcpy(&value, &bits, sizeof(value));
+
+    if (!isfinite(value))
+      continue;
+
+    snprintf(buffer, sizeof(buffer), "%.1100f", value);
+    test_number_parse_case(buffer);
+
+    // The long double of x86 holds the halfway point exactly.
+    long double halfway = (long double) value + ((long double) nextafter(value, INFINITY) - (long double) value) / 2;
+    snprintf(buffer, sizeof(buffer), "%.1100Lf", halfway);
+    test_number_parse_case(buffer);
+  }
+
+  printf("\n");
+}
+
+// The shortest form must parse back to the same double and one significant digit less must not,
+// the fixed form must be the same as '%.*f'.
+static void test_number_format_case(double value, int precision)
+{
+  char formatted[NUMBER_FORMAT_BUFFER_SIZE];
+  char expected[NUMBER_FORMAT_BUFFER_SIZE];
+
+  number_format(value, formatted);
+
+  if (!isnan(value))
+  {
+    double parsed = strtod(formatted, NULL);
+
+    if (memcmp(&parsed, &value, sizeof(double)) != 0)
+      TEST_ERROR("The shortest form '%s' of %.17g doesn't parse back to it!\n", formatted, value);
+
+    // The digits between the first and the last one which is not zero.
+    size_t significantDigits = 0;
+    size_t digits = 0;
+
+    for (const char* c = formatted; *c && *c != 'e'; ++c)
+    {
+      if (!isdigit(*c) || (digits == 0 && *c == '0'))
+        continue;
+
+      ++digits;
+
+      if (*c != '0')
+        significantDigits = digits;
+    }
+
+    if (significantDigits > 1 && isfinite(value))
+    {
+      snprintf(expected, sizeof(expected), "%.*e", (int) significantDigits - 2, value);
+      parsed = strtod(expected, NULL);
+
+      if (memcmp(&parsed, &value, sizeof(double)) == 0)
+        TEST_ERROR("The shortest form '%s' of %.17g is not the shortest ('%s')!\n", formatted, value, expected);
+    }
+  }
+
+  number_format_fixed(value, precision, formatted);
+  snprintf(expected, sizeof(expected), "%.*f", precision, value);
+
+  if (strcmp(formatted, expected) != 0)
+    TEST_ERROR("The fixed form '%s' of %.17g differs from '%s'!\n", formatted, value, expected);
+}
+
+static void test_number_formatting()
+{
+  static const double cases[] = {
+    0.0, -0.0, 1.0, -1.0, 0.1, 0.3, 0.1 + 0.2, 1.0 / 3.0, 0.125, 0.375, 2.5, 2.675, 1.005, 100.0,
+    123456.789, 1e21, 1e22, 1e23, 1e-6, 1e-7, 5e-324, 2.2250738585072014e-308, DBL_MAX, 9007199254740993.0,
+    0x1p53, 0x1p64, 0.99999949999, 0.0000049999999, INFINITY, -INFINITY, NAN,
+  };
+
+  uint32_t state = 17;
+
+  printf("Number formatting:\n");
+
+  for (size_t i = 0; i < ARRAY_LEN(cases); ++i)
+    for (int precision = 0; precision <= NUMBER_FORMAT_MAX_PRECISION; ++precision)
+      test_number_format_case(cases[i], precision);
+
+  for (size_t i = 0; i < 20000; ++i)
+  {
+    uint64_t bits = ((uint64_t) bench_random(&state) << 48) ^ ((uint64_t) bench_random(&state) << 32) ^
+                    ((uint64_t) bench_random(&state) << 16) ^ (uint64_t) bench_random(&state);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+
+    // Every second value is a short decimal, like most results.
+    if (i % 2)
+      value = (double) (bench_random(&state) % 1000000) / numparseExactPowers[bench_random(&state) % 8];
+
+    test_number_format_case(value, (int) (bench_random(&state) % (NUMBER_FORMAT_MAX_PRECISION + 1)));
+  }
+
+  printf("\n");
+}
+
+// Rewinding to a mark must free everything after it and keep the regions for the next
+// allocations.
+static void test_arena_rewind()
+{
+  arena_t arena = {0};
+
+  printf("Arena:\n");
+
+  arena_alloc(&arena, 100);
+  arena_mark_t mark = arena_mark(&arena);
+  arena_stats_t marked = arena_stats(&arena);
+
+  void* first = arena_alloc(&arena, 200);
+  arena_alloc(&arena, REGION_DEFAULT_CAPACITY * 4 * sizeof(uintptr_t));
+  size_t regions = arena_stats(&arena).regionsHeld;
+
+  arena_rewind(&arena, mark);
+  arena_stats_t rewound = arena_stats(&arena);
+
+  if (rewound.bytesInUse != marked.bytesInUse || rewound.regionsHeld != regions)
+    TEST_ERROR("Rewinding the arena didn't free the memory after the mark!\n");
+
+  if (arena_alloc(&arena, 200) != first)
+    TEST_ERROR("Rewinding the arena didn't reuse the memory after the mark!\n");
+
+  arena_rewind(&arena, (arena_mark_t) {0});
+
+  if (arena_stats(&arena).bytesInUse != 0)
+    TEST_ERROR("Rewinding to an empty arena didn't reset it!\n");
+
+  arena_free(&arena);
+  printf("\n");
+}
+
+// Growing the last allocation must happen in place, so the token arrays of large inputs don't
+// leave their old copies behind in the arena.
+static void test_arena_realloc()
+{
+  arena_t arena = {0};
+
+  printf("Arena realloc:\n");
+
+  char* top = arena_alloc(&arena, 64);
+  memset(top, 'x', 64);
+
+  if (arena_realloc(&arena, top, 64, 128) != top || arena_stats(&arena).bytesInUse != 128)
+    TEST_ERROR("Growing the last allocation didn't happen in place!\n");
+
+  arena_alloc(&arena, 8);
+  char* moved = arena_realloc(&arena, top, 128, 256);
+
+  if (moved == top || memcmp(moved, top, 64) != 0)
+    TEST_ERROR("Growing an allocation in the middle didn't copy it!\n");
+
+  arena_reset(&arena);
+
+  // Two tokens per term and every second one is a number, whose value shares the allocation of
+  // the tokens. So the arena must only hold that one allocation.
+  size_t terms = 100000;
+  char* input = malloc(terms * 2);
+  for (size_t i = 0; i < terms; ++i)
+  {
+    input[i * 2] = '1';
+    input[i * 2 + 1] = '+';
+  }
+  input[terms * 2 - 1] = '\0';
+
+  lexer_t lexer = lexer_scan(&arena, input);
+  arena_stats_t stats = arena_stats(&arena);
+
+  if (lexer.isError || stats.bytesInUse != lexer.capacity * sizeof(token_t))
+    TEST_ERROR("Scanning a large input left dead copies of the tokens in the arena (%zu bytes in use, %zu bytes of tokens)!\n",
+      stats.bytesInUse, lexer.capacity * sizeof(token_t));
+
+  arena_reset(&arena);
+
+  tokenizer_t tokenizer = tokenizer_execute(&arena, input);
+  lexer = lexer_execute(&arena, &tokenizer);
+  stats = arena_stats(&arena);
+
+  if (lexer.isError || stats.bytesInUse != tokenizer.capacity * sizeof(input_token_t) + lexer.capacity * sizeof(token_t))
+    TEST_ERROR("Lexing a large input left dead copies of the tokens in the arena (%zu bytes in use)!\n", stats.bytesInUse);
+
+  free(input);
+  arena_free(&arena);
+  printf("\n");
+}
+
+typedef struct {
+  size_t* items;
+  size_t capacity;
+  size_t count;
+} test_numbers_t;
+
+// Every backend and growth policy must give aligned allocations which don't overlap, also while
+// a big array grows and moves between regions.
+static void test_arena_backends()
+{
+  static const char* backends[] = { "malloc", "mmap", "hugepage" };
+  static const size_t alignments[] = { 8, 16, 64, 4096 };
+
+  printf("Arena backends:\n");
+
+  for (size_t b = 0; b < ARRAY_LEN(backends); ++b)
+  {
+    for (size_t g = 0; g < ARENA_GROWTH_COUNT; ++g)
+    {
+      arena_t arena = { .backend = (e_arena_backend) (ARENA_BACKEND_MALLOC + b), .growth = (e_arena_growth) g };
+      test_numbers_t numbers = {0};
+      unsigned char* blocks[64];
+      bool failed = false;
+
+      for (size_t i = 0; i < ARRAY_LEN(blocks); ++i)
+      {
+        size_t alignment = alignments[i % ARRAY_LEN(alignments)];
+        size_t size = 1 + i * 97;
+
+        blocks[i] = arena_alloc_aligned(&arena, size, alignment);
+        memset(blocks[i], (int) i, size);
+
+        if ((uintptr_t) blocks[i] % alignment != 0)
+          failed = true;
+
+        for (size_t n = 0; n < 4096; ++n)
+          arena_da_append(&arena, &numbers, i * 4096 + n);
+      }
+
+      for (size_t i = 0; i < ARRAY_LEN(blocks); ++i)
+        for (size_t j = 0; j < 1 + i * 97; ++j)
+          if (blocks[i][j] != (unsigned char) i)
+            failed = true;
+
+      for (size_t n = 0; n < numbers.count; ++n)
+        if (numbers.items[n] != n)
+          failed = true;
+
+      if (failed)
+        TEST_ERROR("The arena with the %s backend and growth %zu gave wrong memory!\n", backends[b], g);
+
+      // Without growth the 2 MB of numbers alone would need 256 regions of the default capacity.
+      if (arena_stats(&arena).regionsHeld > 16)
+        TEST_ERROR("The arena with the %s backend and growth %zu needed %zu regions!\n", backends[b], g, arena_stats(&arena).regionsHeld);
+
+      arena_free(&arena);
+    }
+  }
+
+  printf("\n");
+}
+
+static void test_arena_pool_task(void* context, size_t worker, size_t task)
+{
+  (void) context;
+  (void) worker;
+
+  arena_t arena = arena_pool_acquire();
+  memset(arena_alloc(&arena, 1024 + task * 64), 0, 1024 + task * 64);
+  arena_pool_release(&arena);
+}
+
+// A released arena must come back with its regions, the pools must stay below the limit and the
+// pools of exited threads must be freed.
+static void test_arena_pool()
+{
+  printf("Arena pool:\n");
+
+  arena_t arena = arena_pool_acquire();
+  arena_alloc(&arena, 100);
+  region_t* region = arena.begin;
+  arena_pool_release(&arena);
+
+  arena = arena_pool_acquire();
+
+  if (arena.begin != region || arena_stats(&arena).bytesInUse != 0)
+    TEST_ERROR("The arena pool didn't recycle the released arena!\n");
+
+  arena_pool_set_limit(64 << 10);
+  arena_alloc(&arena, 1 << 20);
+  arena_pool_release(&arena);
+
+  if (arena_pool_retained() == 0 || arena_pool_retained() > 64 << 10)
+    TEST_ERROR("The arena pool retained %zu bytes with a limit of %d bytes!\n", arena_pool_retained(), 64 << 10);
+
+  arena_pool_set_limit(ARENA_POOL_DEFAULT_LIMIT);
+
+  work_pool_run(4, 64, test_arena_pool_task, NULL);
+  arena_pool_thread_free();
+
+  if (arena_pool_retained() != 0)
+    TEST_ERROR("The arena pools still retain %zu bytes after their threads exited!\n", arena_pool_retained());
+
+  printf("\n");
+}
+
+// The same expressions as fresh trees, because the optimizer rewrites them in place. Every
+// expression only uses the arithmetic and 'pow', so the batch evaluation also has to be exact.
+static node_t* test_build_strict_expression(arena_t* arena, size_t index)
+{
+  switch (index)
+  {
+    // "x^2 + y^-1 * x^1"
+    case 0:
+      return node_binop(arena, 4, NO_ADD,
+               node_binop(arena, 1, NO_POW, node_variable(arena, 0, 0, "x"), node_constant(arena, 2, 2)),
+               node_binop(arena, 11, NO_MUL,
+                 node_binop(arena, 7, NO_POW, node_variable(arena, 6, 1, "y"), node_constant(arena, 8, -1)),
+                 node_binop(arena, 14, NO_POW, node_variable(arena, 13, 0, "x"), node_constant(arena, 15, 1))));
+    // "(x^2 - x^3) / (y^-1 + 2^3) + x^2"
+    case 1:
+      return node_binop(arena, 27, NO_ADD,
+               node_binop(arena, 12, NO_DIV,
+                 node_binop(arena, 5, NO_SUB,
+                   node_binop(arena, 2, NO_POW, node_variable(arena, 1, 0, "x"), node_constant(arena, 3, 2)),
+                   node_binop(arena, 8, NO_POW, node_variable(arena, 7, 0, "x"), node_constant(arena, 9, 3))),
+                 node_binop(arena, 19, NO_ADD,
+                   node_binop(arena, 16, NO_POW, node_variable(arena, 15, 1, "y"), node_constant(arena, 17, -1)),
+                   node_binop(arena, 22, NO_POW, node_constant(arena, 21, 2), node_constant(arena, 23, 3)))),
+               node_binop(arena, 30, NO_POW, node_variable(arena, 29, 0, "x"), node_constant(arena, 31, 2)));
+    // "(x * y)^2 / (x * y)^-1 - y^-1"
+    case 2:
+      return node_binop(arena, 24, NO_SUB,
+               node_binop(arena, 10, NO_DIV,
+                 node_binop(arena, 7, NO_POW,
+                   node_binop(arena, 3, NO_MUL, node_variable(arena, 1, 0, "x"), node_variable(arena, 5, 1, "y")),
+                   node_constant(arena, 8, 2)),
+                 node_binop(arena, 18, NO_POW,
+                   node_binop(arena, 14, NO_MUL, node_variable(arena, 12, 0, "x"), node_variable(arena, 16, 1, "y")),
+                   node_constant(arena, 20, -1))),
+               node_binop(arena, 27, NO_POW, node_variable(arena, 26, 1, "y"), node_constant(arena, 28, -1)));
+    default:
+      UNREACHABLE("Strict expression not implemented!");
+  }
+}
+
+// The default passes must keep every result bit identical to the unoptimized tree. 'pow' of libm is
+// not correctly rounded, so only random values find the few inputs where a rewrite changes it.
+static void test_strict_optimizer()
+{
+  enum { expressionCount = 3, rowCount = 1 << 16 };
+
+  arena_t arena = {0};
+  uint32_t state = 29;
+
+  printf("Strict optimizer:\n");
+
+  double* xs = arena_alloc(&arena, rowCount * sizeof(double));
+  double* ys = arena_alloc(&arena, rowCount * sizeof(double));
+  const double* columns[] = { xs, ys };
+
+  // Every second value has random bits, the others are short values of every magnitude and zeros.
+  for (size_t r = 0; r < rowCount; ++r)
+  {
+    for (size_t v = 0; v < ARRAY_LEN(columns); ++v)
+    {
+      uint64_t bits = ((uint64_t) bench_random(&state) << 48) ^ ((uint64_t) bench_random(&state) << 32) ^
+                      ((uint64_t) bench_random(&state) << 16) ^ (uint64_t) bench_random(&state);
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+
+      if (r % 2)
+        value = r % 64 == 1 ? 0 : ldexp(bench_random_value(&state), (int) (bench_random(&state) % 128) - 64);
+
+      ((double*) columns[v])[r] = value;
+    }
+  }
+
+  double* results = arena_alloc(&arena, rowCount * sizeof(double));
+  eval_status_t* statuses = arena_alloc(&arena, rowCount * sizeof(eval_status_t));
+
+  for (size_t e = 0; e < expressionCount; ++e)
+  {
+    bytecode_t plain = compiler_execute(&arena, test_build_strict_expression(&arena, e));
+
+    node_t* root = test_build_strict_expression(&arena, e);
+    optimizer_execute(&arena, root, OPT_DEFAULT);
+    bytecode_t optimized = compiler_execute(&arena, root);
+
+    jit_code_t jit = jit_compile(&arena, &optimized);
+    batch_t batch = batch_compile(&arena, &optimized);
+    batch_execute(&batch, columns, rowCount, results, statuses);
+
+    size_t differences = 0;
+
+    for (size_t r = 0; r < rowCount; ++r)
+    {
+      double variables[] = { xs[r], ys[r] };
+
+      eval_status_t plainStatus, vmStatus, jitStatus;
+      double expected = vm_execute(&plain, variables, &plainStatus);
+      double vmEvaluated = vm_execute(&optimized, variables, &vmStatus);
+      double jitEvaluated = jit_execute(&jit, variables, &jitStatus);
+
+      const eval_status_t* optimizedStatuses[] = { &vmStatus, &jitStatus, &statuses[r] };
+      const double optimizedResults[] = { vmEvaluated, jitEvaluated, results[r] };
+
+      for (size_t o = 0; o < ARRAY_LEN(optimizedResults); ++o)
+      {
+        if (optimizedStatuses[o]->type != plainStatus.type || optimizedStatuses[o]->cursor != plainStatus.cursor ||
+            (!eval_status_is_error(&plainStatus) && !bench_same_result(optimizedResults[o], expected)))
+        {
+          if (differences++ == 0)
+            TEST_ERROR("The optimized result of expression %zu differs for x = %.17g, y = %.17g (%.17g instead of %.17g)!\n",
+                       e, xs[r], ys[r], optimizedResults[o], expected);
+        }
+      }
+    }
+
+    if (differences > 1)
+      TEST_ERROR("The optimized results of expression %zu differ %zu times in %d rows!\n", e, differences, rowCount);
+
+    jit_free(&jit);
+  }
+
+  arena_free(&arena);
+  printf("\n");
+}
+
+static bool test_ast_eval()
+{
+  arena_t arena = {0};
+  bool freeAfterEachTest = false;
+
+  printf("AST testing:\n\n");
+
+  test_keyword_lookup();
+  test_variable_lookup();
+  test_char_classes();
+  test_number_parsing();
+  test_number_formatting();
+  test_arena_rewind();
+  test_arena_realloc();
+  test_arena_backends();
+  test_arena_pool();
+  test_strict_optimizer();
+
+  // TEST 1
+  printf("Test 1:\n");
+  {
+    // IN: "1 + 2 + (PI ^ 2) / 3"
+    // AST: add(1.00000, add(2.00000, divide(paren(pow(3.14159, 2.00000)), 3.00000)))
+    // = 6,28986
+    node_t* test =
+      node_binop(&arena, 0, NO_ADD,
+        node_constant(&arena, 0, 1),
+        node_binop(&arena, 0, NO_ADD,
+          node_constant(&arena, 0, 2),
+          node_binop(&arena, 0, NO_DIV,
+            node_paren(&arena, 0,
+              node_binop(&arena, 0, NO_POW,
+                node_constant(&arena, 0, mathConstantTypeValues[MC_PI]),
+                node_constant(&arena, 0, 2)
+              )
+            ),
+            node_constant(&arena, 0, 3)
+          )
+        )
+      );
+
+    test_eval_node(&arena, "1 + 2 + (PI ^ 2) / 3", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 2
+  printf("Test 2:\n");
+  {
+    // IN: "ln(10)"
+    // AST: ln(10)
+    // = 2.30258
+    node_t* test =
+      node_func(&arena, 0, NF_LN,
+        node_constant(&arena, 0, 10));
+    
+    test_eval_node(&arena, "ln(10)", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 3
+  printf("Test 3:\n");
+  {
+    // IN: "100.53 + sqrt(3.5 - EN) + cos(44.23 * 6.4^2) / 8.3 + ln(10) - PI + ln(5^EC)"
+    // AST: add(substract(add(add(add(100.53000, sqrt(substract(3.50000, 2.71828))), divide(cos(multiply(44.23000, pow(6.40000, 2.00000))), 8.30000)), ln(10.00000)), 3.14159), ln(pow(5.00000, 0.57722)))
+    // = 101.44295
+    node_t* test =
+      node_binop(&arena, 0, NO_ADD,
+        node_binop(&arena, 0, NO_SUB,
+          node_binop(&arena, 0, NO_ADD,
+            node_binop(&arena, 0, NO_ADD,
+              node_binop(&arena, 0, NO_ADD,
+                node_constant(&arena, 0, 100.53),
+                node_func(&arena, 0, NF_SQRT,
+                  node_binop(&arena, 0, NO_SUB,
+                    node_constant(&arena, 0, 3.5),
+                    node_constant(&arena, 0, mathConstantTypeValues[MC_EULERS_NUMBER])
+                  )
+                )
+              ),
+              node_binop(&arena, 0, NO_DIV,
+                node_func(&arena, 0, NF_COS,
+                  node_binop(&arena, 0, NO_MUL,
+                    node_constant(&arena, 0, 44.23),
+                    node_binop(&arena, 0, NO_POW,
+                      node_constant(&arena, 0, 6.4),
+                      node_constant(&arena, 0, 2)
+                    )
+                  )
+                ),
+                node_constant(&arena, 0, 8.3)
+              )
+            ),
+            node_func(&arena, 0, NF_LN,
+              node_constant(&arena, 0, 10)
+            )
+          ),
+          node_constant(&arena, 0, mathConstantTypeValues[MC_PI])
+        ),
+        node_func(&arena, 0, NF_LN,
+          node_binop(&arena, 0, NO_POW,
+            node_constant(&arena, 0, 5),
+            node_constant(&arena, 0, mathConstantTypeValues[MC_EULERS_CONSTANT])
+          )
+        )
+      );
+
+    test_eval_node(&arena, "100.53 + sqrt(3.5 - EN) + cos(44.23 * 6.4^2) / 8.3 + ln(10) - PI + ln(5^EC)", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 4
+  printf("Test 4:\n");
+  {
+    // IN: "10.5 * exp(4)"
+    // AST: mult(10.5, exp(4))
+    // = 573.28058
+    node_t* test =
+      node_binop(&arena, 0, NO_MUL,
+        node_constant(&arena, 0, 10.5),
+        node_func(&arena, 0, NF_EXP,
+          node_constant(&arena, 0, 4)
+        )
+      );
+    
+    test_eval_node(&arena, "10.5 * exp(4)", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 5
+  printf("Test 5:\n");
+  {
+    // IN: "10 + 5 / (5 * 0)"
+    // AST: "add(10, divide(5, paren(mult(5, 0))))"
+    // = ERR (Divide by Zero)
+    node_t* test =
+      node_binop(&arena, 3, NO_ADD,
+        node_constant(&arena, 0, 10),
+        node_binop(&arena, 6, NO_DIV,
+          node_constant(&arena, 4, 5),
+          node_paren(&arena, 8,
+            node_binop(&arena, 10, NO_MUL,
+              node_constant(&arena, 9, 5),
+              node_constant(&arena, 11, 0)
+            )
+          )
+        )
+      );
+
+    test_eval_node(&arena, "10 + 5 / (5 * 0)", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+  
+  // TEST 6
+  printf("Test 6:\n");
+  {
+    // IN: "(5 * 0)"
+    // AST: "paren(mult(5, 0))"
+    // = 5
+    node_t* test =
+      node_paren(&arena, 0,
+        node_binop(&arena, 0, NO_MUL,
+          node_constant(&arena, 0, 5),
+          node_constant(&arena, 0, 0)
+        )
+      );
+
+    test_eval_node(&arena, "(5 * 0)", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 7
+  printf("Test 7:\n");
+  {
+    // IN: "10 / 0"
+    // AST: "div(10, 0)"
+    // = ERR (Divide by Zero)
+    node_t* test =
+      node_binop(&arena, 2, NO_DIV,
+        node_constant(&arena, 0, 10),
+        node_constant(&arena, 4, 0)
+      );
+
+    test_eval_node(&arena, "10 / 0", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 8
+  printf("Test 8:\n");
+  {
+    // IN: "10 / (4)"
+    // AST: "div(10, paren(4))"
+    // = 2.5
+    node_t* test =
+      node_binop(&arena, 2, NO_DIV,
+        node_constant(&arena, 0, 10),
+        node_paren(&arena, 4,
+          node_constant(&arena, 5, 4)
+        )
+      );
+
+    test_eval_node(&arena, "10 / (4)", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 9
+  printf("Test 9:\n");
+  {
+    // IN: "x / (y - 2) + sin(x)" for 7 rows of x and y
+    // AST: "add(div(x, paren(sub(y, 2))), sin(x))"
+    // = ERR (Divide by Zero) for every row with 'y = 2'
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 4, 0.25 };
+    static const double ys[] = { 4, 2, 0, 2, -1, 3, 1e10 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 12, NO_ADD,
+        node_binop(&arena, 2, NO_DIV,
+          node_variable(&arena, 0, 0, "x"),
+          node_paren(&arena, 4,
+            node_binop(&arena, 7, NO_SUB,
+              node_variable(&arena, 5, 1, "y"),
+              node_constant(&arena, 9, 2)
+            )
+          )
+        ),
+        node_func(&arena, 14, NF_SIN,
+          node_variable(&arena, 18, 0, "x")
+        )
+      );
+
+    test_batch_node(&arena, "x / (y - 2) + sin(x)", test, OPT_DEFAULT, columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 10
+  printf("Test 10:\n");
+  {
+    // IN: "sin(x - EN) * y + sin(x - EN) / (y - 2)" for 7 rows of x and y
+    // AST: "add(mul(sin(sub(x, EN)), y), div(sin(sub(x, EN)), paren(sub(y, 2))))"
+    // The optimizer merges the second 'sin(x - EN)' and the 'y' in the divisor into the first ones.
+    // = ERR (Divide by Zero) for every row with 'y = 2'
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 4, 0.25 };
+    static const double ys[] = { 4, 2, 0, 2, -1, 3, 1e10 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 15, NO_ADD,
+        node_binop(&arena, 11, NO_MUL,
+          node_func(&arena, 0, NF_SIN,
+            node_binop(&arena, 6, NO_SUB,
+              node_variable(&arena, 4, 0, "x"),
+              node_constant(&arena, 8, mathConstantTypeValues[MC_EULERS_NUMBER])
+            )
+          ),
+          node_variable(&arena, 13, 1, "y")
+        ),
+        node_binop(&arena, 29, NO_DIV,
+          node_func(&arena, 17, NF_SIN,
+            node_binop(&arena, 23, NO_SUB,
+              node_variable(&arena, 21, 0, "x"),
+              node_constant(&arena, 25, mathConstantTypeValues[MC_EULERS_NUMBER])
+            )
+          ),
+          node_paren(&arena, 31,
+            node_binop(&arena, 34, NO_SUB,
+              node_variable(&arena, 32, 1, "y"),
+              node_constant(&arena, 36, 2)
+            )
+          )
+        )
+      );
+
+    test_batch_node(&arena, "sin(x - EN) * y + sin(x - EN) / (y - 2)", test, OPT_DEFAULT, columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 11
+  printf("Test 11:\n");
+  {
+    // IN: "x + y + 2 + x * y * 0.5 * y + x / (y - 2) + 1" for 7 rows of x and y
+    // AST: "add(add(add(add(add(x, y), 2), mul(mul(mul(x, y), 0.5), y)), div(x, paren(sub(y, 2)))), 1)"
+    // Fast math rebalances the chain of additions and the chain of multiplications.
+    // = ERR (Divide by Zero) for every row with 'y = 2'
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 4, 0.25 };
+    static const double ys[] = { 4, 2, 0, 2, -1, 3, 1e10 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 42, NO_ADD,
+        node_binop(&arena, 28, NO_ADD,
+          node_binop(&arena, 10, NO_ADD,
+            node_binop(&arena, 6, NO_ADD,
+              node_binop(&arena, 2, NO_ADD,
+                node_variable(&arena, 0, 0, "x"),
+                node_variable(&arena, 4, 1, "y")
+              ),
+              node_constant(&arena, 8, 2)
+            ),
+            node_binop(&arena, 24, NO_MUL,
+              node_binop(&arena, 18, NO_MUL,
+                node_binop(&arena, 14, NO_MUL,
+                  node_variable(&arena, 12, 0, "x"),
+                  node_variable(&arena, 16, 1, "y")
+                ),
+                node_constant(&arena, 20, 0.5)
+              ),
+              node_variable(&arena, 26, 1, "y")
+            )
+          ),
+          node_binop(&arena, 32, NO_DIV,
+            node_variable(&arena, 30, 0, "x"),
+            node_paren(&arena, 34,
+              node_binop(&arena, 37, NO_SUB,
+                node_variable(&arena, 35, 1, "y"),
+                node_constant(&arena, 39, 2)
+              )
+            )
+          )
+        ),
+        node_constant(&arena, 44, 1)
+      );
+
+    test_batch_node(&arena, "x + y + 2 + x * y * 0.5 * y + x / (y - 2) + 1", test, OPT_FAST_MATH, columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+  printf("Test 12:\n");
+  {
+    // IN: "x^2 + y^-1 * x^1" for 7 rows of x and y
+    // AST: "add(pow(x, 2), mul(pow(y, -1), pow(x, 1)))"
+    // The default passes only replace 'x^1', 'x^2' and 'y^-1' keep 'pow' to keep the result.
+    // = -INFINITY for the row with 'y = 0'
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 1e200, 0.25 };
+    static const double ys[] = { 4, 2, 0, 3, -1, 1e-300, -0.1 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 4, NO_ADD,
+        node_binop(&arena, 1, NO_POW,
+          node_variable(&arena, 0, 0, "x"),
+          node_constant(&arena, 2, 2)
+        ),
+        node_binop(&arena, 11, NO_MUL,
+          node_binop(&arena, 7, NO_POW,
+            node_variable(&arena, 6, 1, "y"),
+            node_constant(&arena, 8, -1)
+          ),
+          node_binop(&arena, 14, NO_POW,
+            node_variable(&arena, 13, 0, "x"),
+            node_constant(&arena, 15, 1)
+          )
+        )
+      );
+
+    test_batch_node(&arena, "x^2 + y^-1 * x^1", test, OPT_DEFAULT, columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+  printf("Test 13:\n");
+  {
+    // IN: "x^3 - y^-2 + x^0.5 * y^5" for 7 rows of x and y
+    // AST: "add(sub(pow(x, 3), pow(y, -2)), mul(pow(x, 0.5), pow(y, 5)))"
+    // Fast math also turns the other exponents into multiplications, reciprocals and 'sqrt'.
+    // = NAN for every row with a negative x
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 4, 0.25 };
+    static const double ys[] = { 4, 2, 0, 3, -1, 1.5, 1e10 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 11, NO_ADD,
+        node_binop(&arena, 4, NO_SUB,
+          node_binop(&arena, 1, NO_POW,
+            node_variable(&arena, 0, 0, "x"),
+            node_constant(&arena, 2, 3)
+          ),
+          node_binop(&arena, 7, NO_POW,
+            node_variable(&arena, 6, 1, "y"),
+            node_constant(&arena, 8, -2)
+          )
+        ),
+        node_binop(&arena, 19, NO_MUL,
+          node_binop(&arena, 14, NO_POW,
+            node_variable(&arena, 13, 0, "x"),
+            node_constant(&arena, 15, 0.5)
+          ),
+          node_binop(&arena, 22, NO_POW,
+            node_variable(&arena, 21, 1, "y"),
+            node_constant(&arena, 23, 5)
+          )
+        )
+      );
+
+    test_batch_node(&arena, "x^3 - y^-2 + x^0.5 * y^5", test, OPT_FAST_MATH, columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+  printf("Test 14:\n");
+  {
+    // IN: "x * x - y + x * 0.5 - 1 / (y - 2) * x" for 7 rows of x and y
+    // AST: "sub(add(sub(mul(x, x), y), mul(x, 0.5)), mul(div(1, paren(sub(y, 2))), x))"
+    // Fast math fuses every multiplication with the addition or subtraction after it.
+    // = ERR (Divide by Zero) for every row with 'y = 2'
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 4, 0.25 };
+    static const double ys[] = { 4, 2, 0, 2, -1, 3, 1e10 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 20, NO_SUB,
+        node_binop(&arena, 10, NO_ADD,
+          node_binop(&arena, 6, NO_SUB,
+            node_binop(&arena, 2, NO_MUL,
+              node_variable(&arena, 0, 0, "x"),
+              node_variable(&arena, 4, 0, "x")
+            ),
+            node_variable(&arena, 8, 1, "y")
+          ),
+          node_binop(&arena, 14, NO_MUL,
+            node_variable(&arena, 12, 0, "x"),
+            node_constant(&arena, 16, 0.5)
+          )
+        ),
+        node_binop(&arena, 34, NO_MUL,
+          node_binop(&arena, 24, NO_DIV,
+            node_constant(&arena, 22, 1),
+            node_paren(&arena, 26,
+              node_binop(&arena, 29, NO_SUB,
+                node_variable(&arena, 27, 1, "y"),
+                node_constant(&arena, 31, 2)
+              )
+            )
+          ),
+          node_variable(&arena, 36, 0, "x")
+        )
+      );
+
+    test_batch_node(&arena, "x * x - y + x * 0.5 - 1 / (y - 2) * x", test, OPT_FAST_MATH, columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+  printf("Test 15:\n");
+  {
+    // IN: "3 * x^3 + x * x - 2 * x + 1 + sin(y)" for 7 rows of x and y
+    // AST: "add(add(sub(add(mul(3, pow(x, 3)), mul(x, x)), mul(2, x)), 1), sin(y))"
+    // Fast math rewrites the polynomial in x into Horner form '((3 * x + 1) * x - 2) * x + 1'.
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 4, 0.25 };
+    static const double ys[] = { 4, 2, 0, 2, -1, 3, 1e10 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 28, NO_ADD,
+        node_binop(&arena, 24, NO_ADD,
+          node_binop(&arena, 16, NO_SUB,
+            node_binop(&arena, 8, NO_ADD,
+              node_binop(&arena, 2, NO_MUL,
+                node_constant(&arena, 0, 3),
+                node_binop(&arena, 5, NO_POW,
+                  node_variable(&arena, 4, 0, "x"),
+                  node_constant(&arena, 6, 3)
+                )
+              ),
+              node_binop(&arena, 12, NO_MUL,
+                node_variable(&arena, 10, 0, "x"),
+                node_variable(&arena, 14, 0, "x")
+              )
+            ),
+            node_binop(&arena, 20, NO_MUL,
+              node_constant(&arena, 18, 2),
+              node_variable(&arena, 22, 0, "x")
+            )
+          ),
+          node_constant(&arena, 26, 1)
+        ),
+        node_func(&arena, 30, NF_SIN,
+          node_variable(&arena, 34, 1, "y")
+        )
+      );
+
+    test_batch_node(&arena, "3 * x^3 + x * x - 2 * x + 1 + sin(y)", test, OPT_FAST_MATH, columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+  printf("Test 16:\n");
+  {
+    // IN: "x^4 - 3 * x^2 + 2 * x - 5 + y * y" for 7 rows of x and y
+    // AST: "add(sub(add(sub(pow(x, 4), mul(3, pow(x, 2))), mul(2, x)), 5), mul(y, y))"
+    // Estrin's scheme rewrites the polynomial in x into 'x^2 * x^2 + (-3 * x^2 + (2 * x - 5))' and
+    // only computes 'x^2' once.
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 4, 0.25 };
+    static const double ys[] = { 4, 2, 0, 2, -1, 3, 1e10 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 26, NO_ADD,
+        node_binop(&arena, 22, NO_SUB,
+          node_binop(&arena, 14, NO_ADD,
+            node_binop(&arena, 4, NO_SUB,
+              node_binop(&arena, 1, NO_POW,
+                node_variable(&arena, 0, 0, "x"),
+                node_constant(&arena, 2, 4)
+              ),
+              node_binop(&arena, 8, NO_MUL,
+                node_constant(&arena, 6, 3),
+                node_binop(&arena, 11, NO_POW,
+                  node_variable(&arena, 10, 0, "x"),
+                  node_constant(&arena, 12, 2)
+                )
+              )
+            ),
+            node_binop(&arena, 18, NO_MUL,
+              node_constant(&arena, 16, 2),
+              node_variable(&arena, 20, 0, "x")
+            )
+          ),
+          node_constant(&arena, 24, 5)
+        ),
+        node_binop(&arena, 30, NO_MUL,
+          node_variable(&arena, 28, 1, "y"),
+          node_variable(&arena, 32, 1, "y")
+        )
+      );
+
+    test_batch_node(&arena, "x^4 - 3 * x^2 + 2 * x - 5 + y * y", test, batch_optimizer_flags(true, BATCH_POLY_ESTRIN), columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 17
+  printf("Test 17:\n");
+  {
+    // IN: "-2^2"
+    // AST: multiply(-1.00000, pow(2.00000, 2.00000))
+    // = -4
+    // The sign of the base gets applied after the power.
+    node_t* test =
+      node_binop(&arena, 0, NO_MUL,
+        node_constant(&arena, 0, -1),
+        node_binop(&arena, 2, NO_POW,
+          node_constant(&arena, 1, 2),
+          node_constant(&arena, 3, 2)
+        )
+      );
+
+    test_eval_node(&arena, "-2^2", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 18
+  printf("Test 18:\n");
+  {
+    // IN: "2 * -3^2"
+    // AST: multiply(2.00000, multiply(-1.00000, pow(3.00000, 2.00000)))
+    // = -18
+    node_t* test =
+      node_binop(&arena, 2, NO_MUL,
+        node_constant(&arena, 0, 2),
+        node_binop(&arena, 4, NO_MUL,
+          node_constant(&arena, 4, -1),
+          node_binop(&arena, 6, NO_POW,
+            node_constant(&arena, 5, 3),
+            node_constant(&arena, 7, 2)
+          )
+        )
+      );
+
+    test_eval_node(&arena, "2 * -3^2", test);
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  // TEST 19
+  printf("Test 19:\n");
+  {
+    // IN: "x * 0 + x - x + y" for 7 rows of x and y
+    // AST: "add(sub(add(mul(x, 0), x), x), y)"
+    // The polynomial in x cancels to zero, so Estrin's scheme leaves only '0 + y'.
+    static const double xs[] = { 1, 2.5, -3, 0, 10, 1e300, -0.25 };
+    static const double ys[] = { 4, 2, 0, 2, -1, 3, 1e10 };
+    const double* columns[] = { xs, ys };
+
+    node_t* test =
+      node_binop(&arena, 14, NO_ADD,
+        node_binop(&arena, 10, NO_SUB,
+          node_binop(&arena, 6, NO_ADD,
+            node_binop(&arena, 2, NO_MUL,
+              node_variable(&arena, 0, 0, "x"),
+              node_constant(&arena, 4, 0)
+            ),
+            node_variable(&arena, 8, 0, "x")
+          ),
+          node_variable(&arena, 12, 0, "x")
+        ),
+        node_variable(&arena, 16, 1, "y")
+      );
+
+    test_batch_node(&arena, "x * 0 + x - x + y", test, batch_optimizer_flags(true, BATCH_POLY_ESTRIN), columns, ARRAY_LEN(columns), ARRAY_LEN(xs));
+
+    if (freeAfterEachTest)
+      arena_free(&arena);
+  }
+
+
+  if (!freeAfterEachTest)
+    arena_free(&arena);
+
+  if (testErrorCount > 0)
+  {
+    printf("ERROR: %zu AST tests failed!\n", testErrorCount);
+    return false;
+  }
+
+  printf("All AST tests passed.\n");
+  return true;
 }
 
 #endif // _PROGRAM_H_
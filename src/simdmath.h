@@ -0,0 +1,794 @@
+#ifndef _SIMDMATH_H_
+#define _SIMDMATH_H_
+
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+  #include <immintrin.h>
+#endif
+
+#include "parser.h"
+
+
+// Vectorized versions of every function in 'functionTypeIdentifiers'. Every kernel works on a whole
+// vector of 'SIMD_VECTOR_SIZE' doubles with the GCC vector extensions (also supported by clang) and
+// has no branches per lane. Lanes outside of the range a kernel handles (NAN, infinities, subnormals,
+// overflows and domain errors) get computed with libm afterwards, so they give exactly the same
+// results as the scalar evaluation.
+//
+// The range reductions and polynomials are taken from fdlibm. Maximum errors in ULP compared to
+// libm, measured over dense input ranges by the math tests ('-tm'):
+//
+//   sqrt            0   (correctly rounded like libm)
+//   exp             1
+//   ln              1
+//   log10           2
+//   sin, cos        1   (|x| <= 2^20, libm above)
+//   tan             3   (|x| <= 2^20, libm above)
+//   atan            1
+//   asin, acos      2
+//   sinh, cosh      2
+//   tanh            2
+//
+// The vectors are as wide as the registers of the enabled instruction set: 2 lanes with SSE2,
+// 4 lanes with 'SIMD=avx2' and 8 lanes with 'SIMD=avx512'. The batch evaluation only uses the
+// kernels which were measured to be faster than libm with the current vector size (see
+// 'simdFunctionImpls').
+#if defined(__AVX512F__)
+  #define SIMD_VECTOR_SIZE 8
+#elif defined(__AVX__)
+  #define SIMD_VECTOR_SIZE 4
+#else
+  #define SIMD_VECTOR_SIZE 2
+#endif
+
+typedef double simd_vector_t __attribute__((vector_size(SIMD_VECTOR_SIZE * sizeof(double))));
+typedef int64_t simd_mask_t __attribute__((vector_size(SIMD_VECTOR_SIZE * sizeof(int64_t))));
+
+// Applies a function to 'count' values in place. The values must be aligned to the size of
+// 'simd_vector_t' and 'count' must be a multiple of 'SIMD_VECTOR_SIZE'.
+typedef void (*simd_func_impl_t)(double* values, size_t count);
+
+
+// The kernels are built from many small helpers, which must all end up in a single loop body.
+#define SIMD_INLINE static inline __attribute__((always_inline))
+
+
+// Adding and subtracting 1.5 * 2^52 rounds to the nearest integer for |x| < 2^51. The integer
+// then also is in the lower bits of the sum.
+#define SIMD_ROUND_MAGIC 0x1.8p52
+#define SIMD_ROUND_MAGIC_BITS 0x4338000000000000LL
+
+#define SIMD_SIGN_MASK INT64_MIN
+#define SIMD_ABS_MASK INT64_MAX
+
+SIMD_INLINE simd_vector_t simd_select(simd_mask_t mask, simd_vector_t a, simd_vector_t b)
+{
+  return (simd_vector_t) (((simd_mask_t) a & mask) | ((simd_mask_t) b & ~mask));
+}
+
+SIMD_INLINE simd_vector_t simd_abs(simd_vector_t x)
+{
+  return (simd_vector_t) ((simd_mask_t) x & SIMD_ABS_MASK);
+}
+
+// Flips the sign of every lane which has the sign bit set in 'sign'.
+SIMD_INLINE simd_vector_t simd_xor_sign(simd_vector_t x, simd_mask_t sign)
+{
+  return (simd_vector_t) ((simd_mask_t) x ^ (sign & SIMD_SIGN_MASK));
+}
+
+// Only for |value| < 2^51.
+SIMD_INLINE simd_vector_t simd_int_to_double(simd_mask_t value)
+{
+  return (simd_vector_t) (value + SIMD_ROUND_MAGIC_BITS) - SIMD_ROUND_MAGIC;
+}
+
+// True if any lane of the mask is set. Masks only hold 0 or -1 in every lane.
+SIMD_INLINE bool simd_any(simd_mask_t mask)
+{
+#if defined(__AVX512F__)
+  return _mm512_test_epi64_mask((__m512i) mask, (__m512i) mask) != 0;
+#elif defined(__AVX__)
+  return _mm256_movemask_pd((__m256d) mask) != 0;
+#elif defined(__SSE2__)
+  return _mm_movemask_pd((__m128d) mask) != 0;
+#else
+  int64_t any = 0;
+
+  for (size_t i = 0; i < SIMD_VECTOR_SIZE; ++i)
+    any |= mask[i];
+
+  return any != 0;
+#endif
+}
+
+SIMD_INLINE simd_vector_t simd_sqrt_vector(simd_vector_t x)
+{
+#if defined(__AVX512F__)
+  return (simd_vector_t) _mm512_sqrt_pd((__m512d) x);
+#elif defined(__AVX__)
+  return (simd_vector_t) _mm256_sqrt_pd((__m256d) x);
+#elif defined(__SSE2__)
+  union { simd_vector_t vector; __m128d halves[SIMD_VECTOR_SIZE / 2]; } parts = { .vector = x };
+
+  for (size_t i = 0; i < SIMD_VECTOR_SIZE / 2; ++i)
+    parts.halves[i] = _mm_sqrt_pd(parts.halves[i]);
+
+  return parts.vector;
+#else
+  for (size_t i = 0; i < SIMD_VECTOR_SIZE; ++i)
+    x[i] = sqrt(x[i]);
+
+  return x;
+#endif
+}
+
+
+
+// The FMA instructions are enabled with 'SIMD=avx2' and 'SIMD=avx512'.
+#if defined(__AVX512F__) || defined(__FMA__)
+  #define SIMD_NATIVE_FMA
+#endif
+
+// 'a * b + c' with a single rounding. Uses the FMA instructions if they are enabled, else libm for
+// every lane.
+SIMD_INLINE simd_vector_t simd_fma_vector(simd_vector_t a, simd_vector_t b, simd_vector_t c)
+{
+#if defined(__AVX512F__)
+  return (simd_vector_t) _mm512_fmadd_pd((__m512d) a, (__m512d) b, (__m512d) c);
+#elif defined(__FMA__)
+  return (simd_vector_t) _mm256_fmadd_pd((__m256d) a, (__m256d) b, (__m256d) c);
+#else
+  for (size_t i = 0; i < SIMD_VECTOR_SIZE; ++i)
+    a[i] = fma(a[i], b[i], c[i]);
+
+  return a;
+#endif
+}
+
+
+// Every kernel returns the result for all lanes and sets the lanes in 'slow' which must be
+// computed by libm instead.
+
+SIMD_INLINE simd_vector_t simd_sqrt_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  // Negative values are left to libm, so 'errno' gets set like in the scalar evaluation.
+  *slow = ~(x >= 0);
+  return simd_sqrt_vector(x);
+}
+
+
+// exp(x) = 2^n * exp(r) with n = round(x / ln2) and |r| <= ln2 / 2. 'r' is computed with a
+// two part ln2 (Cody-Waite) and exp(r) with its taylor series up to r^13.
+#define SIMD_EXP_MAX_ARG 708.0
+#define SIMD_LOG2E 0x1.71547652b82fep+0
+#define SIMD_LN2_HI 0x1.62e42fee00000p-1
+#define SIMD_LN2_LO 0x1.a39ef35793c76p-33
+
+SIMD_INLINE simd_vector_t simd_exp_fast(simd_vector_t x)
+{
+  simd_vector_t t = x * SIMD_LOG2E + SIMD_ROUND_MAGIC;
+  simd_vector_t n = t - SIMD_ROUND_MAGIC;
+  simd_vector_t r = (x - n * SIMD_LN2_HI) - n * SIMD_LN2_LO;
+
+  simd_vector_t p = r * (1.0 / 6227020800.0) + (1.0 / 479001600.0);
+  p = p * r + (1.0 / 39916800.0);
+  p = p * r + (1.0 / 3628800.0);
+  p = p * r + (1.0 / 362880.0);
+  p = p * r + (1.0 / 40320.0);
+  p = p * r + (1.0 / 5040.0);
+  p = p * r + (1.0 / 720.0);
+  p = p * r + (1.0 / 120.0);
+  p = p * r + (1.0 / 24.0);
+  p = p * r + (1.0 / 6.0);
+  p = p * r + 0.5;
+
+  simd_vector_t y = 1.0 + (r + r * r * p);
+
+  // |n| <= 1022, so 2^n always is a normal number.
+  simd_mask_t exponent = ((simd_mask_t) t - SIMD_ROUND_MAGIC_BITS) + 1023;
+  return y * (simd_vector_t) (exponent << 52);
+}
+
+SIMD_INLINE simd_vector_t simd_exp_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = ~(simd_abs(x) <= SIMD_EXP_MAX_ARG);
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+  return simd_exp_fast(x);
+}
+
+
+// log(x) = k * ln2 + log(1 + f) with 1 + f in [sqrt(2) / 2, sqrt(2)]. log(1 + f) gets computed
+// with s = f / (2 + f) like in fdlibm.
+typedef struct {
+  simd_vector_t k;
+  simd_vector_t f;
+  simd_vector_t hfsq;
+  // s * (hfsq + R(s^2))
+  simd_vector_t r;
+} simd_log_parts_t;
+
+SIMD_INLINE simd_log_parts_t simd_log_reduce(simd_vector_t x)
+{
+  static const double lg1 = 6.666666666666735130e-01;
+  static const double lg2 = 3.999999999940941908e-01;
+  static const double lg3 = 2.857142874366239149e-01;
+  static const double lg4 = 2.222219843214978396e-01;
+  static const double lg5 = 1.818357216161805012e-01;
+  static const double lg6 = 1.531383769920937332e-01;
+  static const double lg7 = 1.479819860511658591e-01;
+
+  simd_mask_t bits = (simd_mask_t) x;
+  simd_mask_t exponent = (bits >> 52) - 1023;
+  simd_vector_t m = (simd_vector_t) ((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+
+  simd_mask_t big = m > M_SQRT2;
+  m = simd_select(big, m * 0.5, m);
+  // 'big' is -1 for every lane which got halved.
+  exponent -= big;
+
+  simd_log_parts_t parts;
+  parts.k = simd_int_to_double(exponent);
+  parts.f = m - 1.0;
+  parts.hfsq = 0.5 * parts.f * parts.f;
+
+  simd_vector_t s = parts.f / (2.0 + parts.f);
+  simd_vector_t z = s * s;
+  simd_vector_t w = z * z;
+  simd_vector_t t1 = w * (lg2 + w * (lg4 + w * lg6));
+  simd_vector_t t2 = z * (lg1 + w * (lg3 + w * (lg5 + w * lg7)));
+  parts.r = s * (parts.hfsq + (t1 + t2));
+
+  return parts;
+}
+
+SIMD_INLINE simd_mask_t simd_log_slow_lanes(simd_vector_t x)
+{
+  // Zero, negative values, subnormals, infinity and NAN.
+  return ~((x >= DBL_MIN) & (x <= DBL_MAX));
+}
+
+SIMD_INLINE simd_vector_t simd_ln_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = simd_log_slow_lanes(x);
+  x = simd_select(*slow, (simd_vector_t) {0} + 1.0, x);
+
+  simd_log_parts_t p = simd_log_reduce(x);
+  return p.k * SIMD_LN2_HI - ((p.hfsq - (p.r + p.k * SIMD_LN2_LO)) - p.f);
+}
+
+// Multiplies with 1 / ln10 in extra precision like the fdlibm 'log10', so exact powers of ten
+// stay exact.
+SIMD_INLINE simd_vector_t simd_log10_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  static const double ivln10hi = 0x1.bcb7b15200000p-2;
+  static const double ivln10lo = 0x1.b9438ca9aadd5p-36;
+  static const double log10_2hi = 0x1.34413509f6000p-2;
+  static const double log10_2lo = 0x1.9fef311f12b36p-42;
+
+  *slow = simd_log_slow_lanes(x);
+  x = simd_select(*slow, (simd_vector_t) {0} + 1.0, x);
+
+  simd_log_parts_t p = simd_log_reduce(x);
+
+  // The upper 32 bits of f - hfsq, so hi * ivln10hi is exact.
+  simd_vector_t hi = (simd_vector_t) ((simd_mask_t) (p.f - p.hfsq) & ~(int64_t) 0xffffffff);
+  simd_vector_t lo = ((p.f - hi) - p.hfsq) + p.r;
+
+  simd_vector_t valHi = hi * ivln10hi;
+  simd_vector_t y2 = p.k * log10_2hi;
+  simd_vector_t valLo = p.k * log10_2lo + (lo + hi) * ivln10lo + lo * ivln10hi;
+
+  simd_vector_t w = y2 + valHi;
+  valLo += (y2 - w) + valHi;
+
+  return valLo + w;
+}
+
+
+// Reduces x to y0 + y1 = x - n * pi/2 with |y0| <= pi/4. pi/2 is split into three 33 bit parts
+// (fdlibm 'rem_pio2'), so every product with n is exact for |n| < 2^20.
+#define SIMD_TRIG_MAX_ARG 0x1p20
+
+typedef struct {
+  simd_vector_t y0;
+  simd_vector_t y1;
+  simd_mask_t n;
+} simd_trig_parts_t;
+
+SIMD_INLINE simd_trig_parts_t simd_trig_reduce(simd_vector_t x)
+{
+  static const double invpio2 = 0x1.45f306dc9c883p-1;
+  static const double pio2_1  = 0x1.921fb54400000p+0;
+  static const double pio2_2  = 0x1.0b4611a600000p-34;
+  static const double pio2_2t = 0x1.3198a2e037073p-69;
+  static const double pio2_3  = 0x1.3198a2e000000p-69;
+  static const double pio2_3t = 0x1.b839a252049c1p-104;
+
+  simd_vector_t t = x * invpio2 + SIMD_ROUND_MAGIC;
+  simd_vector_t n = t - SIMD_ROUND_MAGIC;
+
+  simd_vector_t r = x - n * pio2_1;
+
+  simd_vector_t prev = r;
+  simd_vector_t w = n * pio2_2;
+  r = prev - w;
+  w = n * pio2_2t - ((prev - r) - w);
+
+  prev = r;
+  w = n * pio2_3;
+  r = prev - w;
+  w = n * pio2_3t - ((prev - r) - w);
+
+  simd_trig_parts_t parts;
+  parts.y0 = r - w;
+  parts.y1 = (r - parts.y0) - w;
+  parts.n = (simd_mask_t) t - SIMD_ROUND_MAGIC_BITS;
+  return parts;
+}
+
+// fdlibm '__kernel_sin' for |x| <= pi/4, where y is the tail of x.
+SIMD_INLINE simd_vector_t simd_sin_poly(simd_vector_t x, simd_vector_t y)
+{
+  static const double s1 = -1.66666666666666324348e-01;
+  static const double s2 =  8.33333333332248946124e-03;
+  static const double s3 = -1.98412698298579493134e-04;
+  static const double s4 =  2.75573137070700676789e-06;
+  static const double s5 = -2.50507602534068634195e-08;
+  static const double s6 =  1.58969099521155010221e-10;
+
+  simd_vector_t z = x * x;
+  simd_vector_t v = z * x;
+  simd_vector_t r = s2 + z * (s3 + z * (s4 + z * (s5 + z * s6)));
+  return x - ((z * (0.5 * y - v * r) - y) - v * s1);
+}
+
+// fdlibm '__kernel_cos' for |x| <= pi/4, where y is the tail of x.
+SIMD_INLINE simd_vector_t simd_cos_poly(simd_vector_t x, simd_vector_t y)
+{
+  static const double c1 =  4.16666666666666019037e-02;
+  static const double c2 = -1.38888888888741095749e-03;
+  static const double c3 =  2.48015872894767294178e-05;
+  static const double c4 = -2.75573143513906633035e-07;
+  static const double c5 =  2.08757232129817482790e-09;
+  static const double c6 = -1.13596475577881948265e-11;
+
+  simd_vector_t z = x * x;
+  simd_vector_t r = z * (c1 + z * (c2 + z * (c3 + z * (c4 + z * (c5 + z * c6)))));
+  simd_vector_t hz = 0.5 * z;
+  simd_vector_t w = 1.0 - hz;
+  return w + (((1.0 - w) - hz) + (z * r - x * y));
+}
+
+SIMD_INLINE simd_mask_t simd_trig_slow_lanes(simd_vector_t x)
+{
+  // Infinity, NAN and arguments which need a more precise reduction.
+  return ~(simd_abs(x) <= SIMD_TRIG_MAX_ARG);
+}
+
+SIMD_INLINE simd_vector_t simd_sin_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = simd_trig_slow_lanes(x);
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+
+  simd_trig_parts_t p = simd_trig_reduce(x);
+  simd_vector_t s = simd_sin_poly(p.y0, p.y1);
+  simd_vector_t c = simd_cos_poly(p.y0, p.y1);
+
+  // Quadrant 0: sin, 1: cos, 2: -sin, 3: -cos
+  simd_vector_t result = simd_select((p.n & 1) == 1, c, s);
+  return simd_xor_sign(result, (p.n & 2) == 2);
+}
+
+SIMD_INLINE simd_vector_t simd_cos_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = simd_trig_slow_lanes(x);
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+
+  simd_trig_parts_t p = simd_trig_reduce(x);
+  simd_vector_t s = simd_sin_poly(p.y0, p.y1);
+  simd_vector_t c = simd_cos_poly(p.y0, p.y1);
+
+  // Quadrant 0: cos, 1: -sin, 2: -cos, 3: sin
+  simd_vector_t result = simd_select((p.n & 1) == 1, s, c);
+  return simd_xor_sign(result, ((p.n + 1) & 2) == 2);
+}
+
+SIMD_INLINE simd_vector_t simd_tan_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = simd_trig_slow_lanes(x);
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+
+  simd_trig_parts_t p = simd_trig_reduce(x);
+  simd_vector_t s = simd_sin_poly(p.y0, p.y1);
+  simd_vector_t c = simd_cos_poly(p.y0, p.y1);
+
+  // Even quadrants: sin / cos, odd quadrants: -cos / sin
+  simd_mask_t odd = (p.n & 1) == 1;
+  return simd_xor_sign(simd_select(odd, c, s), odd) / simd_select(odd, s, c);
+}
+
+
+// fdlibm 'atan': |x| gets reduced to one of five intervals around atan(0), atan(0.5), atan(1),
+// atan(1.5) and atan(inf). Works for every argument except NAN.
+SIMD_INLINE simd_vector_t simd_atan_fast(simd_vector_t x)
+{
+  static const double atanhi[] = {
+    4.63647609000806093515e-01, // atan(0.5)
+    7.85398163397448278999e-01, // atan(1.0)
+    9.82793723247329054082e-01, // atan(1.5)
+    1.57079632679489655800e+00, // atan(inf)
+  };
+  static const double atanlo[] = {
+    2.26987774529616870924e-17,
+    3.06161699786838301793e-17,
+    1.39033110312309984516e-17,
+    6.12323399573676603587e-17,
+  };
+  static const double at[] = {
+     3.33333333333329318027e-01,
+    -1.99999999998764832476e-01,
+     1.42857142725034663711e-01,
+    -1.11111104054623557880e-01,
+     9.09088713343650656196e-02,
+    -7.69187620504482999495e-02,
+     6.66107313738753120669e-02,
+    -5.83357013379057348645e-02,
+     4.97687799461593236017e-02,
+    -3.65315727442169155270e-02,
+     1.62858201153657823623e-02,
+  };
+
+  simd_vector_t ax = simd_abs(x);
+  simd_vector_t one = (simd_vector_t) {0} + 1.0;
+
+  simd_mask_t below7_16 = ax < 0.4375;
+  simd_mask_t below11_16 = ax < 0.6875;
+  simd_mask_t below19_16 = ax < 1.1875;
+  simd_mask_t below39_16 = ax < 2.4375;
+
+  // Selected from the widest to the narrowest interval, because the intervals are nested.
+  simd_vector_t num = simd_select(below39_16, ax - 1.5, -one);
+  simd_vector_t den = simd_select(below39_16, 1.0 + 1.5 * ax, ax);
+  simd_vector_t hi = simd_select(below39_16, (simd_vector_t) {0} + atanhi[2], (simd_vector_t) {0} + atanhi[3]);
+  simd_vector_t lo = simd_select(below39_16, (simd_vector_t) {0} + atanlo[2], (simd_vector_t) {0} + atanlo[3]);
+
+  num = simd_select(below19_16, ax - 1.0, num);
+  den = simd_select(below19_16, ax + 1.0, den);
+  hi = simd_select(below19_16, (simd_vector_t) {0} + atanhi[1], hi);
+  lo = simd_select(below19_16, (simd_vector_t) {0} + atanlo[1], lo);
+
+  num = simd_select(below11_16, 2.0 * ax - 1.0, num);
+  den = simd_select(below11_16, 2.0 + ax, den);
+  hi = simd_select(below11_16, (simd_vector_t) {0} + atanhi[0], hi);
+  lo = simd_select(below11_16, (simd_vector_t) {0} + atanlo[0], lo);
+
+  num = simd_select(below7_16, ax, num);
+  den = simd_select(below7_16, one, den);
+  hi = simd_select(below7_16, (simd_vector_t) {0}, hi);
+  lo = simd_select(below7_16, (simd_vector_t) {0}, lo);
+
+  simd_vector_t t = num / den;
+  simd_vector_t z = t * t;
+  simd_vector_t w = z * z;
+  simd_vector_t s1 = z * (at[0] + w * (at[2] + w * (at[4] + w * (at[6] + w * (at[8] + w * at[10])))));
+  simd_vector_t s2 = w * (at[1] + w * (at[3] + w * (at[5] + w * (at[7] + w * at[9]))));
+
+  // For the innermost interval hi and lo are 0, which gives t - t * (s1 + s2).
+  simd_vector_t result = hi - ((t * (s1 + s2) - lo) - t);
+  return simd_xor_sign(result, (simd_mask_t) x);
+}
+
+SIMD_INLINE simd_vector_t simd_atan_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = x != x;
+  return simd_atan_fast(x);
+}
+
+// asin(x) = atan(x / sqrt(1 - x^2))
+SIMD_INLINE simd_vector_t simd_asin_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = ~(simd_abs(x) <= 1.0);
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+
+  return simd_atan_fast(x / simd_sqrt_vector((1.0 - x) * (1.0 + x)));
+}
+
+// acos(x) = 2 * atan(sqrt((1 - x) / (1 + x)))
+SIMD_INLINE simd_vector_t simd_acos_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = ~(simd_abs(x) <= 1.0);
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+
+  return 2.0 * simd_atan_fast(simd_sqrt_vector((1.0 - x) / (1.0 + x)));
+}
+
+
+// Taylor series of sinh up to x^21 for |x| < 1, where (e^x - e^-x) / 2 would cancel. The result
+// is hi + lo, where lo holds the rounding error of the last addition.
+SIMD_INLINE simd_vector_t simd_sinh_series(simd_vector_t x, simd_vector_t* lo)
+{
+  simd_vector_t z = x * x;
+
+  simd_vector_t p = z * (1.0 / 51090942171709440000.0) + (1.0 / 121645100408832000.0);
+  p = p * z + (1.0 / 355687428096000.0);
+  p = p * z + (1.0 / 1307674368000.0);
+  p = p * z + (1.0 / 6227020800.0);
+  p = p * z + (1.0 / 39916800.0);
+  p = p * z + (1.0 / 362880.0);
+  p = p * z + (1.0 / 5040.0);
+  p = p * z + (1.0 / 120.0);
+  p = p * z + (1.0 / 6.0);
+
+  simd_vector_t tail = x * z * p;
+  simd_vector_t hi = x + tail;
+  *lo = tail - (hi - x);
+  return hi;
+}
+
+// Taylor series of cosh up to x^22 for |x| < 1 as hi + lo.
+SIMD_INLINE simd_vector_t simd_cosh_series(simd_vector_t x, simd_vector_t* lo)
+{
+  simd_vector_t z = x * x;
+
+  simd_vector_t p = z * (1.0 / 1124000727777607680000.0) + (1.0 / 2432902008176640000.0);
+  p = p * z + (1.0 / 6402373705728000.0);
+  p = p * z + (1.0 / 20922789888000.0);
+  p = p * z + (1.0 / 87178291200.0);
+  p = p * z + (1.0 / 479001600.0);
+  p = p * z + (1.0 / 3628800.0);
+  p = p * z + (1.0 / 40320.0);
+  p = p * z + (1.0 / 720.0);
+  p = p * z + (1.0 / 24.0);
+  p = p * z + 0.5;
+
+  simd_vector_t tail = z * p;
+  simd_vector_t hi = 1.0 + tail;
+  *lo = tail - (hi - 1.0);
+  return hi;
+}
+
+// Exact product a * b = hi + lo without fma (Dekker).
+SIMD_INLINE simd_vector_t simd_two_product(simd_vector_t a, simd_vector_t b, simd_vector_t* lo)
+{
+  simd_vector_t ca = 134217729.0 * a;
+  simd_vector_t aHi = ca - (ca - a);
+  simd_vector_t aLo = a - aHi;
+  simd_vector_t cb = 134217729.0 * b;
+  simd_vector_t bHi = cb - (cb - b);
+  simd_vector_t bLo = b - bHi;
+
+  simd_vector_t hi = a * b;
+  *lo = ((aHi * bHi - hi) + aHi * bLo + aLo * bHi) + aLo * bLo;
+  return hi;
+}
+
+SIMD_INLINE simd_vector_t simd_sinh_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = ~(simd_abs(x) <= SIMD_EXP_MAX_ARG);
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+
+  simd_vector_t ax = simd_abs(x);
+  simd_vector_t e = simd_exp_fast(ax);
+  simd_vector_t big = simd_xor_sign(0.5 * e - 0.5 / e, (simd_mask_t) x);
+
+  simd_vector_t lo;
+  simd_vector_t small = simd_sinh_series(x, &lo);
+
+  return simd_select(ax < 1.0, small + lo, big);
+}
+
+SIMD_INLINE simd_vector_t simd_cosh_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = ~(simd_abs(x) <= SIMD_EXP_MAX_ARG);
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+
+  simd_vector_t e = simd_exp_fast(simd_abs(x));
+  return 0.5 * e + 0.5 / e;
+}
+
+// tanh(x) = sinh(x) / cosh(x) with both series for |x| < 1 and 1 - 2 / (e^2x + 1) otherwise. The
+// small case divides in extra precision, because every rounding error of the series would
+// otherwise be doubled relative to the result. tanh(20) already rounds to 1, so the argument of
+// exp is limited to 20.
+SIMD_INLINE simd_vector_t simd_tanh_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = x != x;
+  x = simd_select(*slow, (simd_vector_t) {0}, x);
+
+  simd_vector_t ax = simd_abs(x);
+  simd_vector_t e = simd_exp_fast(simd_select(ax < 20.0, ax, (simd_vector_t) {0} + 20.0));
+
+  simd_vector_t sinhLo, coshLo, productLo;
+  simd_vector_t sinhHi = simd_sinh_series(ax, &sinhLo);
+  simd_vector_t coshHi = simd_cosh_series(ax, &coshLo);
+
+  simd_vector_t quotient = sinhHi / coshHi;
+  simd_vector_t product = simd_two_product(quotient, coshHi, &productLo);
+  simd_vector_t remainder = ((sinhHi - product) - productLo) + sinhLo - quotient * coshLo;
+  simd_vector_t small = quotient + remainder / coshHi;
+
+  simd_vector_t big = 1.0 - 2.0 / (e * e + 1.0);
+
+  return simd_xor_sign(simd_select(ax < 1.0, small, big), (simd_mask_t) x);
+}
+
+
+// The division is correctly rounded like the scalar one, so no lane needs libm.
+SIMD_INLINE simd_vector_t simd_recip_kernel(simd_vector_t x, simd_mask_t* slow)
+{
+  *slow = (simd_mask_t) {0};
+  return 1.0 / x;
+}
+
+
+// Defines the public function which applies a kernel to every vector of the values and patches
+// the slow lanes with the libm function.
+#define _SIMD_DEFINE_FUNC(name, kernel, scalar)                                   \
+  void name(double* values, size_t count)                                         \
+  {                                                                               \
+    simd_vector_t* vectors = (simd_vector_t*) values;                             \
+                                                                                  \
+    for (size_t i = 0; i < count / SIMD_VECTOR_SIZE; ++i)                         \
+    {                                                                             \
+      simd_mask_t slow;                                                           \
+      simd_vector_t x = vectors[i];                                               \
+      vectors[i] = kernel(x, &slow);                                              \
+                                                                                  \
+      if (!simd_any(slow))                                                        \
+        continue;                                                                 \
+                                                                                  \
+      for (size_t lane = 0; lane < SIMD_VECTOR_SIZE; ++lane)                      \
+        if (slow[lane])                                                           \
+          vectors[i][lane] = scalar(x[lane]);                                     \
+    }                                                                             \
+  }
+
+_SIMD_DEFINE_FUNC(simd_sqrt,  simd_sqrt_kernel,  sqrt)
+_SIMD_DEFINE_FUNC(simd_exp,   simd_exp_kernel,   exp)
+_SIMD_DEFINE_FUNC(simd_sin,   simd_sin_kernel,   sin)
+_SIMD_DEFINE_FUNC(simd_asin,  simd_asin_kernel,  asin)
+_SIMD_DEFINE_FUNC(simd_sinh,  simd_sinh_kernel,  sinh)
+_SIMD_DEFINE_FUNC(simd_cos,   simd_cos_kernel,   cos)
+_SIMD_DEFINE_FUNC(simd_acos,  simd_acos_kernel,  acos)
+_SIMD_DEFINE_FUNC(simd_cosh,  simd_cosh_kernel,  cosh)
+_SIMD_DEFINE_FUNC(simd_tan,   simd_tan_kernel,   tan)
+_SIMD_DEFINE_FUNC(simd_atan,  simd_atan_kernel,  atan)
+_SIMD_DEFINE_FUNC(simd_tanh,  simd_tanh_kernel,  tanh)
+_SIMD_DEFINE_FUNC(simd_ln,    simd_ln_kernel,    log)
+_SIMD_DEFINE_FUNC(simd_log10, simd_log10_kernel, log10)
+_SIMD_DEFINE_FUNC(simd_recip, simd_recip_kernel, node_recip)
+
+// Every vectorized kernel. The math tests check these against libm for every vector size.
+static_assert(NF_COUNT == 14, "Amount of node-function-types has changed");
+const simd_func_impl_t simdKernelImpls[NF_COUNT] = {
+  [NF_SQRT]  = simd_sqrt,
+  [NF_EXP]   = simd_exp,
+
+  [NF_SIN]   = simd_sin,
+  [NF_ASIN]  = simd_asin,
+  [NF_SINH]  = simd_sinh,
+
+  [NF_COS]   = simd_cos,
+  [NF_ACOS]  = simd_acos,
+  [NF_COSH]  = simd_cosh,
+
+  [NF_TAN]   = simd_tan,
+  [NF_ATAN]  = simd_atan,
+  [NF_TANH]  = simd_tanh,
+
+  [NF_LN]    = simd_ln,
+  [NF_LOG10] = simd_log10,
+
+  [NF_RECIP] = simd_recip,
+};
+
+
+// Applies the libm function to every value.
+#define _SIMD_DEFINE_LIBM_FUNC(name, scalar)                                      \
+  void name(double* values, size_t count)                                         \
+  {                                                                               \
+    for (size_t i = 0; i < count; ++i)                                            \
+      values[i] = scalar(values[i]);                                              \
+  }
+
+_SIMD_DEFINE_LIBM_FUNC(simd_sqrt_libm,  sqrt)
+_SIMD_DEFINE_LIBM_FUNC(simd_exp_libm,   exp)
+_SIMD_DEFINE_LIBM_FUNC(simd_sin_libm,   sin)
+_SIMD_DEFINE_LIBM_FUNC(simd_asin_libm,  asin)
+_SIMD_DEFINE_LIBM_FUNC(simd_sinh_libm,  sinh)
+_SIMD_DEFINE_LIBM_FUNC(simd_cos_libm,   cos)
+_SIMD_DEFINE_LIBM_FUNC(simd_acos_libm,  acos)
+_SIMD_DEFINE_LIBM_FUNC(simd_cosh_libm,  cosh)
+_SIMD_DEFINE_LIBM_FUNC(simd_tan_libm,   tan)
+_SIMD_DEFINE_LIBM_FUNC(simd_atan_libm,  atan)
+_SIMD_DEFINE_LIBM_FUNC(simd_tanh_libm,  tanh)
+_SIMD_DEFINE_LIBM_FUNC(simd_ln_libm,    log)
+_SIMD_DEFINE_LIBM_FUNC(simd_log10_libm, log10)
+_SIMD_DEFINE_LIBM_FUNC(simd_recip_libm, node_recip)
+
+// How much faster the kernels are than libm, measured with the math functions benchmark of '-bm'
+// (median of 5 runs) for small and for wide arguments. asin and acos only take small arguments, so
+// their small speedup counts for both.
+//
+//                          2 lanes       4 lanes       8 lanes
+//                          small  wide   small  wide   small  wide
+#define SIMD_SPEEDUP_SQRT   2.38,  2.35,  2.39,  2.32,  2.35,  2.38
+#define SIMD_SPEEDUP_EXP    1.26,  1.27,  2.25,  2.21,  3.07,  3.19
+#define SIMD_SPEEDUP_SIN    0.97,  1.58,  2.29,  3.94,  3.12,  5.37
+#define SIMD_SPEEDUP_ASIN   0.68,  0.68,  1.18,  1.18,  1.89,  1.89
+#define SIMD_SPEEDUP_SINH   1.90,  1.39,  3.87,  2.65,  4.65,  3.22
+#define SIMD_SPEEDUP_COS    0.81,  1.87,  2.05,  4.41,  2.65,  6.12
+#define SIMD_SPEEDUP_ACOS   0.73,  0.73,  1.33,  1.33,  2.16,  2.16
+#define SIMD_SPEEDUP_COSH   1.86,  1.50,  3.47,  2.81,  4.54,  3.65
+#define SIMD_SPEEDUP_TAN    0.96,  2.30,  2.31,  5.22,  3.24,  7.27
+#define SIMD_SPEEDUP_ATAN   0.97,  1.03,  1.81,  1.82,  2.97,  3.20
+#define SIMD_SPEEDUP_TANH   0.95,  0.38,  2.00,  0.76,  2.74,  1.09
+#define SIMD_SPEEDUP_LN     0.98,  0.89,  2.25,  2.03,  2.97,  2.90
+#define SIMD_SPEEDUP_LOG10  1.26,  1.29,  3.08,  2.92,  4.13,  4.04
+#define SIMD_SPEEDUP_RECIP  1.95,  2.02,  2.00,  1.98,  1.95,  2.03
+
+// A kernel gets used if the geometric mean of its small and wide speedup with the current vector
+// size is above 1, which is the case if their product is.
+#if SIMD_VECTOR_SIZE == 8
+  #define _SIMD_SPEEDUP_PRODUCT(s2, w2, s4, w4, s8, w8) ((s8) * (w8))
+#elif SIMD_VECTOR_SIZE == 4
+  #define _SIMD_SPEEDUP_PRODUCT(s2, w2, s4, w4, s8, w8) ((s4) * (w4))
+#else
+  #define _SIMD_SPEEDUP_PRODUCT(s2, w2, s4, w4, s8, w8) ((s2) * (w2))
+#endif
+
+#define SIMD_SPEEDUP_PRODUCT(...) _SIMD_SPEEDUP_PRODUCT(__VA_ARGS__)
+#define _SIMD_MEASURED(kernel, libm, ...) (SIMD_SPEEDUP_PRODUCT(__VA_ARGS__) > 1.0 ? (kernel) : (libm))
+
+// The product of the measured speedups with the current vector size for every function.
+const double simdKernelSpeedupProducts[NF_COUNT] = {
+  [NF_SQRT]  = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_SQRT),
+  [NF_EXP]   = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_EXP),
+
+  [NF_SIN]   = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_SIN),
+  [NF_ASIN]  = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_ASIN),
+  [NF_SINH]  = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_SINH),
+
+  [NF_COS]   = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_COS),
+  [NF_ACOS]  = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_ACOS),
+  [NF_COSH]  = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_COSH),
+
+  [NF_TAN]   = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_TAN),
+  [NF_ATAN]  = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_ATAN),
+  [NF_TANH]  = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_TANH),
+
+  [NF_LN]    = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_LN),
+  [NF_LOG10] = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_LOG10),
+
+  [NF_RECIP] = SIMD_SPEEDUP_PRODUCT(SIMD_SPEEDUP_RECIP),
+};
+
+// The functions the batch evaluation uses: The kernel if it was measured to be faster than libm
+// with the current vector size, else libm for every lane.
+const simd_func_impl_t simdFunctionImpls[NF_COUNT] = {
+  [NF_SQRT]  = _SIMD_MEASURED(simd_sqrt,  simd_sqrt_libm,  SIMD_SPEEDUP_SQRT),
+  [NF_EXP]   = _SIMD_MEASURED(simd_exp,   simd_exp_libm,   SIMD_SPEEDUP_EXP),
+
+  [NF_SIN]   = _SIMD_MEASURED(simd_sin,   simd_sin_libm,   SIMD_SPEEDUP_SIN),
+  [NF_ASIN]  = _SIMD_MEASURED(simd_asin,  simd_asin_libm,  SIMD_SPEEDUP_ASIN),
+  [NF_SINH]  = _SIMD_MEASURED(simd_sinh,  simd_sinh_libm,  SIMD_SPEEDUP_SINH),
+
+  [NF_COS]   = _SIMD_MEASURED(simd_cos,   simd_cos_libm,   SIMD_SPEEDUP_COS),
+  [NF_ACOS]  = _SIMD_MEASURED(simd_acos,  simd_acos_libm,  SIMD_SPEEDUP_ACOS),
+  [NF_COSH]  = _SIMD_MEASURED(simd_cosh,  simd_cosh_libm,  SIMD_SPEEDUP_COSH),
+
+  [NF_TAN]   = _SIMD_MEASURED(simd_tan,   simd_tan_libm,   SIMD_SPEEDUP_TAN),
+  [NF_ATAN]  = _SIMD_MEASURED(simd_atan,  simd_atan_libm,  SIMD_SPEEDUP_ATAN),
+  [NF_TANH]  = _SIMD_MEASURED(simd_tanh,  simd_tanh_libm,  SIMD_SPEEDUP_TANH),
+
+  [NF_LN]    = _SIMD_MEASURED(simd_ln,    simd_ln_libm,    SIMD_SPEEDUP_LN),
+  [NF_LOG10] = _SIMD_MEASURED(simd_log10, simd_log10_libm, SIMD_SPEEDUP_LOG10),
+
+  [NF_RECIP] = _SIMD_MEASURED(simd_recip, simd_recip_libm, SIMD_SPEEDUP_RECIP),
+};
+
+#endif // _SIMDMATH_H_
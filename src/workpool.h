@@ -0,0 +1,198 @@
+#ifndef _WORKPOOL_H_
+#define _WORKPOOL_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include "helpers.h"
+
+
+// The work pool runs 'taskCount' independent tasks on a fixed amount of workers. Every worker
+// starts with an even share of the task indices. When its own share is done it steals half of the
+// remaining tasks of another worker, so long running tasks don't leave the other workers idle.
+//
+// The tasks of a worker are a range of indices packed into a single atomic word. The owner takes
+// tasks from the front and thieves take from the back, both with a compare-and-swap on the whole
+// range, so no locks are needed.
+#define WORK_POOL_MAX_WORKERS 256
+// Overrides the amount of workers, f.e. to leave cores free for other jobs.
+#define WORK_POOL_WORKERS_ENV "CCALC_THREADS"
+// Keeps the queues on their own cache line, so the workers don't slow each other down.
+#define WORK_POOL_CACHE_LINE 64
+
+
+// Gets called once for every task on the thread of 'worker'.
+typedef void (*work_func_t)(void* context, size_t worker, size_t task);
+
+typedef struct {
+  // The begin of the range in the lower and the end in the upper 32 bits.
+  _Alignas(WORK_POOL_CACHE_LINE) _Atomic uint64_t range;
+} work_queue_t;
+
+typedef struct {
+  work_queue_t* queues;
+  size_t workerCount;
+  work_func_t func;
+  void* context;
+} work_pool_t;
+
+typedef struct {
+  work_pool_t* pool;
+  size_t worker;
+} work_thread_arg_t;
+
+
+#define _WORK_RANGE_PACK(begin, end) ((uint64_t) (begin) | ((uint64_t) (end) << 32))
+#define _WORK_RANGE_BEGIN(range)     ((uint32_t) (range))
+#define _WORK_RANGE_END(range)       ((uint32_t) ((range) >> 32))
+
+
+// Returns the amount of workers to use. Defaults to the amount of online cores.
+size_t work_pool_default_workers()
+{
+  const char* env = getenv(WORK_POOL_WORKERS_ENV);
+  long count = env ? strtol(env, NULL, 10) : 0;
+
+  if (count <= 0)
+    count = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (count <= 0)
+    return 1;
+
+  return (size_t) count < WORK_POOL_MAX_WORKERS ? (size_t) count : WORK_POOL_MAX_WORKERS;
+}
+
+
+// Takes the first task of the own queue.
+static bool work_queue_pop(work_queue_t* queue, size_t* task)
+{
+  uint64_t range = atomic_load_explicit(&queue->range, memory_order_relaxed);
+  uint32_t begin;
+
+  do {
+    begin = _WORK_RANGE_BEGIN(range);
+    uint32_t end = _WORK_RANGE_END(range);
+
+    if (begin >= end)
+      return false;
+
+    if (atomic_compare_exchange_weak(&queue->range, &range, _WORK_RANGE_PACK(begin + 1, end)))
+      break;
+  } while (true);
+
+  *task = begin;
+  return true;
+}
+
+// Takes the back half of the remaining tasks of another queue.
+static bool work_queue_steal(work_queue_t* queue, uint32_t* stolenBegin, uint32_t* stolenEnd)
+{
+  uint64_t range = atomic_load_explicit(&queue->range, memory_order_relaxed);
+  uint32_t end, take;
+
+  do {
+    uint32_t begin = _WORK_RANGE_BEGIN(range);
+    end = _WORK_RANGE_END(range);
+
+    if (begin >= end)
+      return false;
+
+    take = (end - begin + 1) / 2;
+
+    if (atomic_compare_exchange_weak(&queue->range, &range, _WORK_RANGE_PACK(begin, end - take)))
+      break;
+  } while (true);
+
+  *stolenBegin = end - take;
+  *stolenEnd = end;
+  return true;
+}
+
+
+static void work_pool_worker(work_pool_t* pool, size_t worker)
+{
+  work_queue_t* own = &pool->queues[worker];
+
+  while (true)
+  {
+    size_t task;
+    while (work_queue_pop(own, &task))
+      pool->func(pool->context, worker, task);
+
+    // The own queue is empty, so only thieves look at it and they can't take anything from it.
+    // That makes it safe to store the stolen range without a compare-and-swap.
+    bool stolen = false;
+
+    for (size_t i = 1; i < pool->workerCount && !stolen; ++i)
+    {
+      uint32_t begin, end;
+      size_t victim = (worker + i) % pool->workerCount;
+
+      if (work_queue_steal(&pool->queues[victim], &begin, &end))
+      {
+        atomic_store(&own->range, _WORK_RANGE_PACK(begin, end));
+        stolen = true;
+      }
+    }
+
+    // Tasks never get added, so when every queue is empty the work is done.
+    if (!stolen)
+      return;
+  }
+}
+
+static int work_pool_thread(void* arg)
+{
+  work_thread_arg_t* threadArg = (work_thread_arg_t*) arg;
+  work_pool_worker(threadArg->pool, threadArg->worker);
+  return 0;
+}
+
+
+// Runs 'func' for every task between 0 and 'taskCount' and returns when all of them are done.
+// The calling thread works as worker 0. If a thread can't be created its tasks get stolen by the
+// other workers, so every task still runs exactly once.
+void work_pool_run(size_t workerCount, size_t taskCount, work_func_t func, void* context)
+{
+  assert(func);
+  assert(taskCount <= UINT32_MAX && "Too many tasks!");
+
+  if (workerCount == 0) workerCount = 1;
+  if (workerCount > WORK_POOL_MAX_WORKERS) workerCount = WORK_POOL_MAX_WORKERS;
+  if (workerCount > taskCount) workerCount = taskCount > 0 ? taskCount : 1;
+
+  work_queue_t queues[WORK_POOL_MAX_WORKERS];
+  thrd_t threads[WORK_POOL_MAX_WORKERS];
+  bool started[WORK_POOL_MAX_WORKERS] = {0};
+  work_thread_arg_t args[WORK_POOL_MAX_WORKERS];
+
+  work_pool_t pool = {
+    .queues = queues,
+    .workerCount = workerCount,
+    .func = func,
+    .context = context,
+  };
+
+  for (size_t w = 0; w < workerCount; ++w)
+  {
+    size_t begin = taskCount * w / workerCount;
+    size_t end = taskCount * (w + 1) / workerCount;
+    atomic_store(&queues[w].range, _WORK_RANGE_PACK(begin, end));
+  }
+
+  for (size_t w = 1; w < workerCount; ++w)
+  {
+    args[w] = (work_thread_arg_t) { .pool = &pool, .worker = w };
+    started[w] = thrd_create(&threads[w], work_pool_thread, &args[w]) == thrd_success;
+  }
+
+  work_pool_worker(&pool, 0);
+
+  for (size_t w = 1; w < workerCount; ++w)
+    if (started[w])
+      thrd_join(threads[w], NULL);
+}
+
+#endif // _WORKPOOL_H_